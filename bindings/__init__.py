@@ -8,5 +8,12 @@ __version__ = "0.0.1"
 __author__ = "Simon Fischer <sf@simon-fischer.info>"
 
 
-from .sprite import PySprite, PyText, PyCanvasObjectList, EdgeBehavior
-from .panelwriter import PyAnimationLoop, PyRGBPanel, PanelOptions
+from .sprite import (
+    PySprite, PyText, PyVideo, PyLiveFeed, PyAnimationStream, PyGroup,
+    PyParticleSystem, PyTileMap, PyImageScroller, PyShape, PyCanvasObjectList,
+    PyTimeline, EdgeBehavior, ObjectEvent, ShapeKind, load_asset_pack
+)
+from .panelwriter import (
+    PyAnimationLoop, PyRGBPanel, PanelOptions, configure_worker_thread
+)
+from .shared_table import SharedTableClient
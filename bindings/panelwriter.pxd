@@ -2,10 +2,11 @@
 Bindings for the main loop that runs the panel animations.
 """
 
-from .sprite cimport CanvasObjectList
+from .sprite cimport CanvasObjectList, PyCanvasObjectListBase, mutex, ThreadOptions
 
 from libcpp cimport bool
-from libc.stdint cimport uint8_t, uint32_t
+from libcpp.string cimport string
+from libc.stdint cimport uint8_t, uint32_t, uint64_t
 
 cdef extern from "canvas.h" namespace "rgb_matrix":
     cdef cppclass Canvas:
@@ -69,6 +70,7 @@ cdef extern from "led-matrix.h" namespace "rgb_matrix::RGBMatrix":
 cdef class PanelOptions:
     cdef Options __options
     cdef RuntimeOptions __rt_options
+    cdef LoopOptions loop_options
     cdef bytes __py_encoded_hardware_mapping
     cdef bytes __py_encoded_led_rgb_sequence
     cdef bytes __py_encoded_pixel_mapper_config
@@ -82,19 +84,84 @@ cdef class PyRGBPanel:
 
 cdef extern from "led-loop.cc":
     pass
+cdef extern from "command.cc":
+    pass
+cdef extern from "command-trace.cc":
+    pass
+cdef extern from "control-server.cc":
+    pass
+cdef extern from "shared-table.cc":
+    pass
+cdef extern from "post-process.cc":
+    pass
+cdef extern from "event-queue.cc":
+    pass
+cdef extern from "event-queue.h" namespace "led_loop":
+    cdef struct EventRecord:
+        uint32_t frame
+        uint8_t type
+        double x
+        double y
+        char id[55]
 cdef extern from "led-loop.h" namespace "led_loop":
     ctypedef long long int tmillis_t
 
+    cdef struct FrameTick:
+        uint32_t frame
+        tmillis_t present_ms
+        uint64_t ticks
+
     cdef struct LoopOptions:
         LoopOptions() except +
         tmillis_t frame_time_ms
+        ThreadOptions thread
+        ThreadOptions workers
+        bool lock_memory
+
+    cdef struct LoopStats:
+        uint32_t frames
+        uint32_t missed_deadlines
+        tmillis_t last_frame_ms
+        tmillis_t max_frame_ms
+        bool thread_configured
+        bool memory_locked
 
     cdef cppclass AnimationLoop:
-        AnimationLoop(RGBMatrix*, CanvasObjectList*, LoopOptions*) except +
+        AnimationLoop(RGBMatrix*, CanvasObjectList*, LoopOptions*, mutex*) except +
         void startLoop()
         void endLoop()
+        uint32_t getFrameCount() const
+        void getStats(LoopStats*)
+        const LoopOptions& getOptions() const
+        int getTickFd() const
+        bool readTick(FrameTick*)
+        void setEventMask(uint8_t)
+        uint8_t getEventMask() const
+        int getEventFd() const
+        size_t readEvents(EventRecord*, size_t)
+        uint64_t getDroppedEvents() const
+        bool startTrace(string)
+        void stopTrace()
+        bool startControlServer(string)
+        void stopControlServer()
+        bool startSharedTable(string, uint32_t)
+        void stopSharedTable()
+        void setFade(double, uint32_t)
+        void setGamma(double)
+        void setTint(uint8_t, uint8_t, uint8_t)
+        void setInvert(bool)
+        void setLayer(CanvasObjectList*, mutex*)
+        void setLayerAlpha(double, uint32_t)
+        bool addScene(string, CanvasObjectList*, mutex*)
+        bool removeScene(string)
+        bool switchScene(string, uint32_t)
+        string getActiveScene() const
 
 cdef class PyAnimationLoop:
     cdef AnimationLoop* c_al
     cdef PyRGBPanel rgb
+    cdef PyCanvasObjectListBase sprites
+    cdef PyCanvasObjectListBase layer
+    cdef dict scenes
+    cdef object event_dispatcher
     cdef CanvasObjectList* c_cvos
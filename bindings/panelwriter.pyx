@@ -13,12 +13,45 @@ Framebuffer::hardware_mapping_ is only visible inside the same module.
 from cython.operator cimport dereference as deref
 from libcpp cimport bool
 from libc.stdint cimport uint8_t, uint32_t, uintptr_t
+from libcpp.vector cimport vector
+
+import asyncio
+import select
+import threading
 
 from .sprite cimport PyCanvasObjectListBase
+from .sprite cimport setTraceEventsEnabled, flushTraceEvents, clearTraceEvents
+from .sprite cimport (configureWorkerThread, describeThreadOptions,
+                      SCHED_OTHER, SCHED_FIFO, SCHED_RR, ALL_OBJECT_EVENTS)
+from . import sprite
 
 
 from .utility cimport pystr_to_chars, cstr_to_pystr
 
+# This module has its own trace event rings (the ones of the animation loop),
+# bindings.trace_events combines them with the ones of the sprite module
+def _trace_events_enable(bool enabled):
+    setTraceEventsEnabled(enabled)
+
+def _trace_events_flush(str fname):
+    return flushTraceEvents(fname.encode("UTF-8"))
+
+def _trace_events_clear():
+    clearTraceEvents()
+
+def configure_worker_thread(str name="worker"):
+    """Apply the worker_sched_policy and worker_cpus of the running
+    PyAnimationLoop to the calling thread, e.g. a loader thread of a script."""
+    return configureWorkerThread(name.encode("UTF-8"))
+
+SCHED_POLICIES = {"other": SCHED_OTHER, "fifo": SCHED_FIFO, "rr": SCHED_RR}
+cdef str policy_name(int policy):
+    for name, value in SCHED_POLICIES.items():
+        if value == policy:
+            return name
+    return str(policy)
+
+
 cdef class PyRGBPanel:
     def __cinit__(self, PanelOptions options=None, **kw_options):
         if options == None:
@@ -92,6 +125,7 @@ cdef class PanelOptions:
         }
         self.__options = Options()
         self.__rt_options = RuntimeOptions()
+        self.loop_options = LoopOptions()
         options = dict(DEFAULT_PANEL_OPTIONS, **options)
         for key, value in options.items():
             if not hasattr(self, key):
@@ -196,18 +230,71 @@ cdef class PanelOptions:
         def __get__(self): return self.__rt_options.drop_privileges
         def __set__(self, uint8_t value): self.__rt_options.drop_privileges = value
 
+    # Animation loop options. rgbmatrix drops to the daemon user after setup,
+    # so privileges are kept when real-time scheduling or mlockall is wanted
+    property sched_policy:
+        """"other", "fifo" or "rr" for the animation thread"""
+        def __get__(self): return policy_name(self.loop_options.thread.policy)
+        def __set__(self, str value):
+            self.loop_options.thread.policy = SCHED_POLICIES[value]
+            if value != "other":
+                self.__rt_options.drop_privileges = 0
+
+    property sched_priority:
+        def __get__(self): return self.loop_options.thread.priority
+        def __set__(self, int value): self.loop_options.thread.priority = value
+
+    property cpus:
+        """CPUs the animation thread may run on, empty for all"""
+        def __get__(self): return list(self.loop_options.thread.cpus)
+        def __set__(self, value): self.loop_options.thread.cpus = list(value)
+
+    property worker_sched_policy:
+        """Policy for decoder, live feed, prefetch and control server threads"""
+        def __get__(self): return policy_name(self.loop_options.workers.policy)
+        def __set__(self, str value):
+            self.loop_options.workers.policy = SCHED_POLICIES[value]
+            if value != "other":
+                self.__rt_options.drop_privileges = 0
+
+    property worker_sched_priority:
+        def __get__(self): return self.loop_options.workers.priority
+        def __set__(self, int value): self.loop_options.workers.priority = value
+
+    property worker_cpus:
+        def __get__(self): return list(self.loop_options.workers.cpus)
+        def __set__(self, value): self.loop_options.workers.cpus = list(value)
+
+    property lock_memory:
+        """mlockall when the loop starts, so page faults cannot stall a frame"""
+        def __get__(self): return self.loop_options.lock_memory
+        def __set__(self, bool value):
+            self.loop_options.lock_memory = value
+            if value:
+                self.__rt_options.drop_privileges = 0
+
 
 cdef class PyAnimationLoop:
     def __cinit__(self, PyCanvasObjectListBase sprites, **options):
-        cdef LoopOptions cl_options = LoopOptions()
-        if "frame_time_ms" in options:
-            cl_options.frame_time_ms = options.pop("frame_time_ms")
+        frame_time_ms = options.pop("frame_time_ms", None)
         self.rgb = PyRGBPanel(**options)
+        cdef LoopOptions cl_options = self.rgb.options.loop_options
+        if frame_time_ms is not None:
+            cl_options.frame_time_ms = frame_time_ms
+        # the sprite module has its own copy of the worker options (its video
+        # and image objects start the decoder and prefetch threads)
+        sprite._set_worker_thread_options(cl_options.workers.policy,
+                                          cl_options.workers.priority,
+                                          list(cl_options.workers.cpus))
+        self.sprites = sprites
+        self.scenes = {"": sprites}
         self.c_cvos = &sprites.c_cvos
+        # the loop locks the same mutex as the list's bulk updates
         self.c_al = new AnimationLoop(
             self.rgb.__matrix,
             self.c_cvos,
-            &cl_options
+            &cl_options,
+            sprites.c_mutex
         )
 
     def __dealloc__(self):
@@ -219,4 +306,228 @@ cdef class PyAnimationLoop:
 
     def end(self):
         print("Stopping Animation Loop")
+        self.on_event(None)
         deref(self.c_al).endLoop()
+
+    def start_trace(self, str fname):
+        """Record every change to the scene into a command trace that can be
+        replayed with bin/shapeshifter-replay."""
+        if not deref(self.c_al).startTrace(fname.encode("UTF-8")):
+            raise IOError(f"Cannot open trace file '{fname}'")
+
+    def stop_trace(self):
+        deref(self.c_al).stopTrace()
+
+    def start_control_server(self, str socket_path):
+        """Accept JSON lines and binary commands on a Unix socket, see
+        command_sender.py. They are applied at the next frame boundary."""
+        if not deref(self.c_al).startControlServer(socket_path.encode("UTF-8")):
+            raise IOError(f"Cannot listen on '{socket_path}'")
+
+    def stop_control_server(self):
+        deref(self.c_al).stopControlServer()
+
+    def start_shared_table(self, str name="shapeshifter", uint32_t capacity=256):
+        """Publish the objects in /dev/shm/<name>, other processes can then
+        move them with bindings.shared_table.SharedTableClient."""
+        if not deref(self.c_al).startSharedTable(name.encode("UTF-8"), capacity):
+            raise IOError(f"Cannot create shared table '{name}'")
+
+    def stop_shared_table(self):
+        deref(self.c_al).stopSharedTable()
+
+    # Color effects over the whole frame, applied through lookup tables after
+    # all objects are drawn. frames=0 changes the value at the next frame
+    def fade(self, double brightness, uint32_t frames=0):
+        """Fade the whole frame to brightness (0..1) over frames frames,
+        without touching the PWM settings of the panel."""
+        deref(self.c_al).setFade(brightness, frames)
+
+    def set_gamma(self, double gamma):
+        deref(self.c_al).setGamma(gamma)
+
+    def set_tint(self, uint8_t red, uint8_t green, uint8_t blue):
+        deref(self.c_al).setTint(red, green, blue)
+
+    def set_invert(self, bool invert):
+        deref(self.c_al).setInvert(invert)
+
+    def set_layer(self, PyCanvasObjectListBase layer):
+        """Draw a second object list on its own and blend it over the frame
+        with crossfade(). None removes the layer."""
+        if layer is None:
+            deref(self.c_al).setLayer(NULL, NULL)
+        else:
+            deref(self.c_al).setLayer(&layer.c_cvos, layer.c_mutex)
+        self.layer = layer
+
+    def crossfade(self, double alpha, uint32_t frames=0):
+        """Move the alpha of the layer (0 hidden, 1 covers the frame) to
+        alpha over frames frames."""
+        deref(self.c_al).setLayerAlpha(alpha, frames)
+
+    # Scenes: separate object lists of which only the active one is stepped
+    # and drawn. The list given to the constructor is the scene ""
+    def add_scene(self, str name, PyCanvasObjectListBase scene):
+        """Register an object list as a scene. It can be filled before or
+        after, also from another thread; nothing of it runs until
+        switch_scene(name)."""
+        if not deref(self.c_al).addScene(name.encode("UTF-8"), &scene.c_cvos,
+                                         scene.c_mutex):
+            raise ValueError(f"Cannot replace the shown scene '{name}'")
+        self.scenes[name] = scene
+
+    def remove_scene(self, str name):
+        if not deref(self.c_al).removeScene(name.encode("UTF-8")):
+            raise ValueError(f"Scene '{name}' is shown or does not exist")
+        return self.scenes.pop(name)
+
+    def switch_scene(self, str name, uint32_t frames=0):
+        """Show the scene from the next frame on. With frames > 0 it is
+        crossfaded in over that many frames (this uses the layer)."""
+        if not deref(self.c_al).switchScene(name.encode("UTF-8"), frames):
+            raise KeyError(name)
+
+    property active_scene:
+        def __get__(self): return cstr_to_pystr(deref(self.c_al).getActiveScene())
+
+    property frame_count:
+        def __get__(self): return deref(self.c_al).getFrameCount()
+
+    property stats:
+        """Frame timing and how the real-time options were applied. A missed
+        deadline is a frame that took longer than frame_time_ms."""
+        def __get__(self):
+            cdef LoopStats stats
+            deref(self.c_al).getStats(&stats)
+            cdef LoopOptions cl_options = deref(self.c_al).getOptions()
+            return {
+                "frames": stats.frames,
+                "missed_deadlines": stats.missed_deadlines,
+                "last_frame_ms": stats.last_frame_ms,
+                "max_frame_ms": stats.max_frame_ms,
+                "thread_configured": stats.thread_configured,
+                "memory_locked": stats.memory_locked,
+                "thread": cstr_to_pystr(describeThreadOptions(cl_options.thread)),
+                "workers": cstr_to_pystr(describeThreadOptions(cl_options.workers)),
+            }
+
+    # Frame ticks: the loop signals an eventfd after every presented frame, so
+    # drivers can select() on fileno() or await next_tick() instead of sleeping
+    def fileno(self):
+        return deref(self.c_al).getTickFd()
+
+    def read_tick(self):
+        """Return (frame, present_ms, ticks) of the latest presented frame, or
+        None if no frame was presented since the last call. ticks > 1 means
+        frames were presented in between. Never blocks."""
+        cdef FrameTick tick
+        if not deref(self.c_al).readTick(&tick):
+            return None
+        return tick.frame, tick.present_ms, tick.ticks
+
+    async def next_tick(self):
+        """Wait in the running asyncio loop for the next presented frame."""
+        loop = asyncio.get_running_loop()
+        fd = self.fileno()
+        tick = self.read_tick()
+        while tick is None:
+            readable = loop.create_future()
+            loop.add_reader(fd, readable.set_result, None)
+            try:
+                await readable
+            finally:
+                loop.remove_reader(fd)
+            tick = self.read_tick()
+        return tick
+
+    # Object events: the loop queues goal reached, edge hit, left and entered
+    # screen while it steps the objects, so drivers do not have to poll
+    # position and speed. Nothing is queued until watch_events is called
+    def watch_events(self, int mask=ALL_OBJECT_EVENTS):
+        """Queue the ObjectEvent flags in mask from the next frame on, 0
+        stops queueing."""
+        deref(self.c_al).setEventMask(mask)
+
+    def events_fileno(self):
+        """eventfd that becomes readable after a frame that queued events."""
+        return deref(self.c_al).getEventFd()
+
+    def drain_events(self, size_t max_events=256):
+        """Return up to max_events queued events as (ObjectEvent, id, frame,
+        (x, y)) tuples in the order they happened, [] if there are none.
+        Never blocks. IDs longer than 54 bytes are truncated."""
+        cdef vector[EventRecord] records
+        records.resize(max_events)
+        cdef size_t n = deref(self.c_al).readEvents(records.data(), max_events)
+        cdef size_t i
+        events = []
+        for i in range(n):
+            events.append((sprite.ObjectEvent(records[i].type),
+                           (<bytes> records[i].id).decode("UTF-8", "replace"),
+                           records[i].frame,
+                           (records[i].x, records[i].y)))
+        return events
+
+    async def next_events(self):
+        """Wait in the running asyncio loop until events were queued."""
+        loop = asyncio.get_running_loop()
+        fd = self.events_fileno()
+        events = self.drain_events()
+        while not events:
+            readable = loop.create_future()
+            loop.add_reader(fd, readable.set_result, None)
+            try:
+                await readable
+            finally:
+                loop.remove_reader(fd)
+            events = self.drain_events()
+        return events
+
+    property dropped_events:
+        """Events lost because the queue was full (1024 by default)."""
+        def __get__(self): return deref(self.c_al).getDroppedEvents()
+
+    def on_event(self, callback, int mask=ALL_OBJECT_EVENTS):
+        """Call callback(event, id, frame, position) for every event on a
+        dispatcher thread, right after the frame that queued it. None stops
+        the dispatcher (end() does too)."""
+        if self.event_dispatcher is not None:
+            self.event_dispatcher.stop()
+            self.event_dispatcher = None
+        if callback is None:
+            return
+        self.watch_events(mask)
+        self.event_dispatcher = _EventDispatcher(self, callback)
+
+
+class _EventDispatcher:
+    """Waits on the event fd of a PyAnimationLoop and hands the events to a
+    callback. Exceptions of the callback are printed, it keeps running."""
+    def __init__(self, loop, callback):
+        self.loop = loop
+        self.callback = callback
+        self.stopped = threading.Event()
+        self.thread = threading.Thread(target=self.run, name="event dispatcher",
+                                       daemon=True)
+        self.thread.start()
+
+    def run(self):
+        fd = self.loop.events_fileno()
+        while not self.stopped.is_set():
+            # the timeout only bounds how long stop() waits
+            readable, _, _ = select.select([fd], [], [], 0.1)
+            if not readable:
+                continue
+            for event in self.loop.drain_events():
+                if self.stopped.is_set():
+                    return
+                try:
+                    self.callback(*event)
+                except Exception as exc:    # pylint: disable=broad-except
+                    print(f"Event callback failed: {exc!r}")
+
+    def stop(self):
+        self.stopped.set()
+        if self.thread is not threading.current_thread():
+            self.thread.join()
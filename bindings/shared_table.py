@@ -0,0 +1,139 @@
+"""
+Pure Python client for the shared memory table published by the daemon
+(bin/shapeshifter -m <name> or PyAnimationLoop.start_shared_table).
+The layout and the sequence lock protocol are described in shared-table.h.
+"""
+
+import mmap
+import os
+import struct
+import threading
+
+HEADER = struct.Struct("=4sHHII48x")
+MAGIC = b"SSST"
+VERSION = 1
+ENTRY_SIZE = 128
+
+# offsets inside an entry
+USED = 0
+GENERATION = 4
+ID = 8
+ID_SIZE = 56
+SEQUENCE = 64
+WRITES = 68
+VALUES = 80
+U32 = struct.Struct("=I")
+POSITION = struct.Struct("=dd")
+DOUBLE = struct.Struct("=d")
+INT = struct.Struct("=i")
+
+# SharedField: index of the write counter and offset of the value
+FIELDS = {
+    "position": (0, VALUES, POSITION),
+    "speed": (1, VALUES + 16, DOUBLE),
+    "direction": (2, VALUES + 24, DOUBLE),
+    "visible": (3, VALUES + 32, INT),
+    "z": (4, VALUES + 36, INT),
+}
+
+
+def _fence():
+    """Full memory barrier between the stores before and after it. Python has
+    no fences, but taking and releasing a lock runs the atomic instructions of
+    the platform's mutex (dmb on ARM), which order this thread's stores like
+    the release fences of the C++ writer in shared-table.cc."""
+    lock = threading.Lock()
+    lock.acquire()
+    lock.release()
+
+
+class SharedTableClient:
+    """Writes object parameters straight into the daemon's memory. The values
+    are picked up at the next frame, nothing is sent."""
+
+    def __init__(self, name="shapeshifter"):
+        fd = os.open("/dev/shm/" + name.lstrip("/"), os.O_RDWR)
+        try:
+            self._mm = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+        magic, version, entry_size, self.capacity, _ = HEADER.unpack_from(self._mm)
+        if magic != MAGIC or version != VERSION or entry_size != ENTRY_SIZE:
+            self._mm.close()
+            raise ValueError(f"'{name}' is not a shared table of this version")
+        self._slots = {}
+
+    def close(self):
+        self._mm.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    @property
+    def frame(self):
+        """Frame counter of the daemon, stops moving if the daemon is gone."""
+        return U32.unpack_from(self._mm, 12)[0]
+
+    def _entry(self, object_id):
+        cached = self._slots.get(object_id)
+        if cached is not None:
+            offset, generation = cached
+            if (U32.unpack_from(self._mm, offset + USED)[0]
+                    and U32.unpack_from(self._mm, offset + GENERATION)[0] == generation):
+                return offset
+            del self._slots[object_id]
+        key = object_id.encode("UTF-8")
+        for slot in range(self.capacity):
+            offset = HEADER.size + slot * ENTRY_SIZE
+            generation = U32.unpack_from(self._mm, offset + GENERATION)[0]
+            if (not U32.unpack_from(self._mm, offset + USED)[0]
+                    or self._mm[offset + ID:offset + ID + ID_SIZE].rstrip(b"\0") != key
+                    or U32.unpack_from(self._mm, offset + GENERATION)[0] != generation):
+                continue
+            self._slots[object_id] = (offset, generation)
+            return offset
+        raise KeyError(object_id)
+
+    def update(self, object_id, **values):
+        """Set any of position=(x, y), speed, direction, visible and z of one
+        object at once, e.g. update("nemo", position=(10, 20), speed=0)."""
+        # pack everything first, a bad name or value must not leave the
+        # sequence odd (readers would skip the object forever)
+        packed = []
+        for name, value in values.items():
+            if name not in FIELDS:
+                raise KeyError(f"Unknown field '{name}'")
+            index, value_offset, layout = FIELDS[name]
+            if name == "position":
+                packed.append((index, value_offset, layout.pack(*value)))
+            else:
+                packed.append((index, value_offset, layout.pack(value)))
+        offset = self._entry(object_id)
+        sequence = (U32.unpack_from(self._mm, offset + SEQUENCE)[0] + 1) | 1
+        U32.pack_into(self._mm, offset + SEQUENCE, sequence)
+        _fence()
+        for index, value_offset, data in packed:
+            start = offset + value_offset
+            self._mm[start:start + len(data)] = data
+            counter = offset + WRITES + index
+            self._mm[counter] = (self._mm[counter] + 1) & 0xff
+        _fence()
+        U32.pack_into(self._mm, offset + SEQUENCE, (sequence + 1) & 0xffffffff)
+
+    def set_position(self, object_id, x, y):
+        self.update(object_id, position=(x, y))
+
+    def set_speed(self, object_id, speed):
+        self.update(object_id, speed=speed)
+
+    def set_direction(self, object_id, direction):
+        self.update(object_id, direction=direction)
+
+    def set_visible(self, object_id, visible):
+        self.update(object_id, visible=int(bool(visible)))
+
+    def set_z(self, object_id, z):
+        self.update(object_id, z=z)
@@ -4,11 +4,73 @@ Bindings for the sprites.h module.
 
 from libcpp cimport bool
 from libcpp.string cimport string
+from libc.stdint cimport uint8_t, int32_t, uint32_t, uint64_t
 from libcpp.map cimport map as cmap
+from libcpp.vector cimport vector
 
 
 cdef extern from "sprite.cc":
     pass
+cdef extern from "<mutex>" namespace "std":
+    cdef cppclass mutex:
+        mutex() except +
+        void lock() nogil
+        void unlock() nogil
+cdef extern from "asset-pack.cc":
+    pass
+cdef extern from "video.cc":
+    pass
+cdef extern from "live-feed.cc":
+    pass
+cdef extern from "animation-stream.cc":
+    pass
+cdef extern from "timeline.cc":
+    pass
+cdef extern from "group.cc":
+    pass
+cdef extern from "particle-system.cc":
+    pass
+cdef extern from "tile-map.cc":
+    pass
+cdef extern from "image-scroller.cc":
+    pass
+cdef extern from "shape.cc":
+    pass
+cdef extern from "trace-events.cc":
+    pass
+cdef extern from "frame-arena.cc":
+    pass
+cdef extern from "pixel-canvas.cc":
+    pass
+cdef extern from "realtime.cc":
+    pass
+cdef extern from "<sched.h>":
+    int SCHED_OTHER
+    int SCHED_FIFO
+    int SCHED_RR
+cdef extern from "realtime.h" namespace "Sprites":
+    cdef struct ThreadOptions:
+        int policy
+        int priority
+        vector[int] cpus
+    void setWorkerThreadOptions(const ThreadOptions&)
+    ThreadOptions getWorkerThreadOptions()
+    bool configureWorkerThread(const char*)
+    string describeThreadOptions(const ThreadOptions&)
+cdef extern from "trace-events.h":
+    void setTraceEventsEnabled "Sprites::TraceEvents::setEnabled"(bool)
+    void setTraceThreadName "Sprites::TraceEvents::setThreadName"(const char*)
+    bool flushTraceEvents "Sprites::TraceEvents::flush"(string)
+    void clearTraceEvents "Sprites::TraceEvents::clear"()
+    uint64_t traceBegin "Sprites::TraceEvents::begin"() nogil
+    void traceEnd "Sprites::TraceEvents::end"(const char*, const char*, uint64_t) nogil
+    void lockTraced "Sprites::lockTraced"(mutex*, const char*) nogil
+cdef extern from "graphics.h" namespace "rgb_matrix":
+    cdef struct Color:
+        uint8_t r
+        uint8_t g
+        uint8_t b
+
 cdef extern from "sprite.h" namespace "Sprites":
     ctypedef string CanvasObjectID
 
@@ -30,6 +92,15 @@ cdef extern from "sprite.h" namespace "Sprites":
         STOP = 5         # does not work fully (can still creep into edge)
         DISAPPEAR = 6
 
+    cpdef enum ObjectEvent:         # flags, see PyAnimationLoop.watch_events
+        GOAL_REACHED = 1
+        EDGE_HIT = 2
+        LEFT_SCREEN = 4
+        ENTERED_SCREEN = 8
+        ALL_OBJECT_EVENTS = 15
+
+    cdef cppclass Timeline
+
     cdef cppclass CanvasObject:
         CanvasObject() except +
 
@@ -42,6 +113,7 @@ cdef extern from "sprite.h" namespace "Sprites":
         const string getContent() const
 
         void doStep()
+        uint8_t getStepEvents() const
 
         void setVisible(bool)
         bool getVisible() const
@@ -54,20 +126,38 @@ cdef extern from "sprite.h" namespace "Sprites":
         const double getDirection()
         void setSpeed(const double)
         const double getSpeed() const
+        void setZ(const int)
+        int getZ() const
+        void setTimeline(Timeline*)
+        void setOpacity(const double)
+        double getOpacity() const
+        void setTint(uint8_t, uint8_t, uint8_t)
+        const Color& getTint() const
+        void setFlip(const bool, const bool)
+        bool getFlipX() const
+        bool getFlipY() const
+        void setQuarterTurns(const int)
+        int getQuarterTurns() const
+        void setOwnedByList(bool)
+        bool isOwnedByList() const
+        uint64_t getSerial() const
 
     cdef cppclass Sprite(CanvasObject):
         Sprite() except +
-        Sprite(string) except +
+        Sprite(string) nogil except +
         Sprite(string, double) except +
 
         int getWidth()
-        void setWidth(int)
+        void setWidth(int) nogil
         int getHeight()
-        void setHeight(int)
-        void setRotation(double)
+        void setHeight(int) nogil
+        void setRotation(double) nogil
         const double getRotation() const
 
         const Pixel getPixel(int, int) const
+        void setPixel(size_t, size_t, char, char, char)
+        void setPixels(const uint8_t*, size_t, size_t, const uint8_t*) nogil
+        uint8_t* getPixelData()
 
     cdef cppclass Text(CanvasObject):
         Text() except +
@@ -78,18 +168,197 @@ cdef extern from "sprite.h" namespace "Sprites":
         const string getText() const
         void setKerning(int)
         const int getKerning() const
+        void setColor(uint8_t, uint8_t, uint8_t)
+        const Color& getColor() const
+
+cdef extern from "asset-pack.h":
+    bool loadAssetPack "Sprites::AssetPack::load"(string)
+
+cdef extern from "video.h" namespace "Sprites":
+    cdef cppclass Video(CanvasObject):
+        Video() except +
+        Video(string, size_t, size_t) except +
+
+        void setWidth(int)
+        void setHeight(int)
+        void setFrameRate(double)
+        const double getFrameRate() const
+        void setLoop(bool)
+        bool getLoop() const
+        size_t getDroppedFrames() const
+
+cdef extern from "live-feed.h" namespace "Sprites":
+    cdef enum PixelFormat:
+        RGB24
+        BGR24
+        RGB565
+    PixelFormat resolvePixelFormat(string)
+
+    cdef cppclass LiveFeed(CanvasObject):
+        LiveFeed() except +
+        LiveFeed(string, size_t, size_t, PixelFormat) except +
+
+        size_t getFramesReceived() const
+        size_t getFramesShown() const
+
+cdef extern from "animation-stream.h" namespace "Sprites":
+    cdef cppclass AnimationStream(CanvasObject):
+        AnimationStream() except +
+        AnimationStream(string) except +
+
+        unsigned int getFrameCount() const
+        unsigned int getFrameTime() const
+
+cdef extern from "group.h" namespace "Sprites":
+    cdef cppclass Group(CanvasObject):
+        Group() except +
+        Group(string) except +
+
+        void add(CanvasObject*)
+        CanvasObject* remove(const CanvasObjectID&)
+        CanvasObject* find(const CanvasObjectID&) const
+        const vector[CanvasObject*]& getChildren() const
+
+cdef extern from "particle-system.h" namespace "Sprites":
+    cdef struct EmitterSettings:
+        double rate
+        uint32_t min_lifetime
+        uint32_t max_lifetime
+        double min_speed
+        double max_speed
+        double direction
+        double spread
+        double gravity_x
+        double gravity_y
+        double drag
+        uint8_t start_color[3]
+        uint8_t end_color[3]
+        double area_width
+        double area_height
 
+    cdef cppclass ParticleSystem(CanvasObject):
+        ParticleSystem() except +
+        ParticleSystem(string, size_t) except +
+
+        void setSettings(const EmitterSettings&)
+        const EmitterSettings& getSettings() const
+        void burst(size_t)
+        size_t getCount() const
+        size_t getCapacity() const
+
+cdef extern from "tile-map.h" namespace "Sprites":
+    cdef cppclass TileMap(CanvasObject):
+        TileMap() except +
+        TileMap(string, size_t, size_t, size_t, size_t) nogil except +
+
+        size_t getTileCount() const
+        void setMapSize(size_t, size_t)
+        size_t getColumns() const
+        size_t getRows() const
+        void setTile(size_t, size_t, int32_t)
+        int32_t getTile(size_t, size_t) const
+        void setTiles(const vector[int32_t]&)
+        void fill(int32_t)
+        void setScroll(const Point&)
+        const Point& getScroll() const
+        void setViewport(size_t, size_t)
+        void setWrapScroll(bool)
+        bool getWrapScroll() const
+
+cdef extern from "image-scroller.h" namespace "Sprites":
+    cdef cppclass ImageScroller(CanvasObject):
+        ImageScroller() except +
+        ImageScroller(string, size_t) nogil except +
+
+        size_t getImageWidth() const
+        size_t getImageHeight() const
+        void setScroll(const Point&)
+        const Point& getScroll() const
+        void setScrollSpeed(const Point&)
+        const Point& getScrollSpeed() const
+        void setViewport(size_t, size_t)
+        void setWrapScroll(bool)
+        bool getWrapScroll() const
+        size_t getBlockReads() const
+
+cdef extern from "shape.h" namespace "Sprites":
+    cpdef enum ShapeKind:
+        SHAPE_LINE
+        SHAPE_RECT
+        SHAPE_ROUNDED_RECT
+        SHAPE_ELLIPSE
+        SHAPE_POLYGON
+
+    cdef cppclass Shape(CanvasObject):
+        Shape() except +
+        Shape(string, ShapeKind) except +
+
+        void setKind(ShapeKind)
+        ShapeKind getKind() const
+        void setSize(double, double)
+        double getSizeX() const
+        double getSizeY() const
+        void setPoints(const vector[Point]&)
+        const vector[Point]& getPoints() const
+        void setRadius(double)
+        double getRadius() const
+        void setLineWidth(double)
+        double getLineWidth() const
+        void setColor(uint8_t, uint8_t, uint8_t)
+        const Color& getColor() const
+        void setAntialias(bool)
+        bool getAntialias() const
+
+cdef extern from "timeline.h" namespace "Sprites":
+    ctypedef enum Easing:
+        pass
+    ctypedef enum TimelineProperty:
+        pass
+    Easing resolveEasing(string)
+    TimelineProperty resolveTimelineProperty(string)
+
+    cdef cppclass Keyframe:
+        Keyframe(uint32_t, Easing, double, double, double) except +
+
+    cdef cppclass Timeline:
+        Timeline() except +
+        Timeline(const Timeline&) except +
+        void addKeyframe(TimelineProperty, const Keyframe&)
+        void setDelay(uint32_t)
+        void setRepeat(int)
+        void reset()
+        uint32_t getLength() const
+        void captureBase(CanvasObject*) except +
+        void prerender() nogil except +
+
+cdef extern from "sprite.h" namespace "Sprites":
     ctypedef cmap[CanvasObjectID, CanvasObject*] CanvasObjectList
     ctypedef cmap[CanvasObjectID, CanvasObject*].iterator CanvasObjectListIterator
 
+    size_t setPositions(CanvasObjectList*, const vector[CanvasObjectID]&,
+                        const vector[Point]&, mutex*) nogil
+    size_t setSpeeds(CanvasObjectList*, const vector[CanvasObjectID]&,
+                     const vector[double]&, mutex*) nogil
+    size_t setVisibilities(CanvasObjectList*, const vector[CanvasObjectID]&,
+                           const vector[bool]&, mutex*) nogil
+
 cdef class PyCanvasObject:
     cdef CanvasObject* c_cvo
     cdef CanvasObject* _cvo(self)
     cdef bool _ptr_owner
     cdef bool _is_initialized
+    cdef object py_list
+    cdef _set_list(self, py_list)
+    cdef mutex* _lock_list(self)
+    cdef _set_content(self, const string&)
 
 cdef class PySprite(PyCanvasObject):
     cdef Sprite* c_spr
+    cdef Py_ssize_t _shape[3]
+    cdef Py_ssize_t _strides[3]
+    cdef int _exports
+    cdef _check_exports(self)
+    cdef _set_content(self, const string&)
     @staticmethod
     cdef PySprite from_ptr(Sprite*, bool owner=*)
 
@@ -98,9 +367,60 @@ cdef class PyText(PyCanvasObject):
     @staticmethod
     cdef PyText from_ptr(Text*, bool owner=*)
 
+cdef class PyVideo(PyCanvasObject):
+    cdef Video* c_vid
+    @staticmethod
+    cdef PyVideo from_ptr(Video*, bool owner=*)
+
+cdef class PyLiveFeed(PyCanvasObject):
+    cdef LiveFeed* c_feed
+    @staticmethod
+    cdef PyLiveFeed from_ptr(LiveFeed*, bool owner=*)
+
+cdef class PyAnimationStream(PyCanvasObject):
+    cdef AnimationStream* c_stream
+    @staticmethod
+    cdef PyAnimationStream from_ptr(AnimationStream*, bool owner=*)
+
+
+cdef class PyGroup(PyCanvasObject):
+    cdef Group* c_grp
+    cdef dict py_children
+    cdef _set_list(self, py_list)
+    @staticmethod
+    cdef PyGroup from_ptr(Group*, bool owner=*)
+
+cdef class PyParticleSystem(PyCanvasObject):
+    cdef ParticleSystem* c_ps
+    @staticmethod
+    cdef PyParticleSystem from_ptr(ParticleSystem*, bool owner=*)
+
+cdef class PyTileMap(PyCanvasObject):
+    cdef TileMap* c_map
+    @staticmethod
+    cdef PyTileMap from_ptr(TileMap*, bool owner=*)
+
+cdef class PyImageScroller(PyCanvasObject):
+    cdef ImageScroller* c_scroller
+    @staticmethod
+    cdef PyImageScroller from_ptr(ImageScroller*, bool owner=*)
+
+cdef class PyShape(PyCanvasObject):
+    cdef Shape* c_shape
+    @staticmethod
+    cdef PyShape from_ptr(Shape*, bool owner=*)
+
+cdef class PyTimeline:
+    cdef Timeline* c_tl
+    cdef dict _track_ends
 
 cdef class PyCanvasObjectListBase:
     cdef CanvasObjectList c_cvos
+    cdef mutex* c_mutex
     cdef py_sprites
+    cdef dict py_serials
+    cdef vector[CanvasObjectID] _ids2vector(self, ids) except *
+    cdef _forget(self, str)
+    cdef _release(self, str, CanvasObject*)
     cdef cvo2py(self, CanvasObject*)
     cdef it2py(self, CanvasObjectListIterator)
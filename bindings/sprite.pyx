@@ -4,6 +4,10 @@
 
 from libcpp cimport bool
 from libcpp.typeinfo cimport type_info
+from libc.stdint cimport uint8_t, int32_t, uint32_t, uint64_t
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+from cpython.buffer cimport PyObject_GetBuffer, PyBuffer_Release, PyBUF_CONTIG_RO
 from cython.operator cimport dereference as deref
 from cython.operator cimport address, typeid, postincrement
 
@@ -19,81 +23,398 @@ from .magick cimport InitializeMagick
 InitializeMagick(NULL)
 
 
+def load_asset_pack(str fname):
+    """Map an asset pack made by bin/shapeshifter-pack. Sprites whose file name
+    is in the pack take their pixels from it instead of decoding the file."""
+    if not loadAssetPack(pystr_to_chars(fname)):
+        raise IOError(f"Cannot load asset pack '{fname}'")
+
+
+# Trace events of this module, bindings.trace_events combines them with the
+# ones of the animation loop
+def _trace_events_enable(bool enabled):
+    if enabled:
+        setTraceThreadName(b"python")
+    setTraceEventsEnabled(enabled)
+
+def _trace_events_flush(str fname):
+    return flushTraceEvents(fname.encode("UTF-8"))
+
+def _trace_events_clear():
+    clearTraceEvents()
+
+# The decoder, feed and prefetch threads of this module's objects read their
+# own copy of the worker options, PyAnimationLoop sets both
+def _set_worker_thread_options(int policy, int priority, cpus):
+    cdef ThreadOptions options
+    options.policy = policy
+    options.priority = priority
+    options.cpus = cpus
+    setWorkerThreadOptions(options)
+
+cdef inline void trace_end(const char* name, uint64_t start_us) nogil:
+    if start_us != 0:
+        traceEnd(name, b"python", start_us)
+
+
+# A non-owning wrapper of the matching Python type
+cdef object wrap_cvo(CanvasObject* c_cvo):
+    if typeid(deref(c_cvo)) == typeid(Text):
+        return PyText.from_ptr(<Text*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(Sprite):
+        return PySprite.from_ptr(<Sprite*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(Video):
+        return PyVideo.from_ptr(<Video*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(LiveFeed):
+        return PyLiveFeed.from_ptr(<LiveFeed*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(AnimationStream):
+        return PyAnimationStream.from_ptr(<AnimationStream*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(Group):
+        return PyGroup.from_ptr(<Group*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(ParticleSystem):
+        return PyParticleSystem.from_ptr(<ParticleSystem*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(TileMap):
+        return PyTileMap.from_ptr(<TileMap*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(ImageScroller):
+        return PyImageScroller.from_ptr(<ImageScroller*>c_cvo)
+    if typeid(deref(c_cvo)) == typeid(Shape):
+        return PyShape.from_ptr(<Shape*>c_cvo)
+    else:
+        raise TypeError
+
+
 cdef class PyCanvasObjectListBase():
     # cdef CanvasObjectList c_cvos
+    # cdef mutex* c_mutex
     # cdef py_sprites
     # cdef cvo2py(self, CanvasObject*)
     # cdef it2py(self, CanvasObjectListIterator)
+    # cdef vector[CanvasObjectID] _ids2vector(self, ids) except *
 
     def __cinit__(self, **dict_of_pysprites):
         self.py_sprites = {}
+        # serials of the objects the cached wrappers were made for
+        self.py_serials = {}
+        # shared with the AnimationLoop that draws this list
+        self.c_mutex = new mutex()
+
+    def __dealloc__(self):
+        # objects created by commands belong to the list
+        cdef CanvasObjectListIterator it = self.c_cvos.begin()
+        cdef CanvasObject* c_cvo
+        while it != self.c_cvos.end():
+            c_cvo = deref(it).second
+            if c_cvo.isOwnedByList():
+                del c_cvo
+            postincrement(it)
+        del self.c_mutex
 
+    # The animation loop changes the list when it applies commands, so every
+    # access to c_cvos holds c_mutex
     def __getitem__(self, str key):
-        it = self.c_cvos.find(pystr_to_chars(key))
-        if it == self.c_cvos.end():
-            raise KeyError
-        cdef CanvasObject* c_cvo = deref(it).second
-        if typeid(deref(c_cvo)) == typeid(Text):
-            return PyText.from_ptr(<Text*>c_cvo)
-        if typeid(deref(c_cvo)) == typeid(Sprite):
-            return PySprite.from_ptr(<Sprite*>c_cvo)
-        else:
-            raise TypeError
+        cdef CanvasObjectID c_key = pystr_to_chars(key)
+        cdef PyCanvasObject py_cvo = self.py_sprites.get(key)
+        cdef CanvasObject* c_cvo = NULL
+        lockTraced(self.c_mutex, b"wait list lock")
+        try:
+            it = self.c_cvos.find(c_key)
+            if it != self.c_cvos.end():
+                c_cvo = deref(it).second
+                # wrappers are cached; objects added or replaced by commands
+                # need a new one, even if they reuse the old address
+                if (py_cvo is None or py_cvo._cvo() != c_cvo
+                        or self.py_serials.get(key) != c_cvo.getSerial()):
+                    py_cvo = self.cvo2py(c_cvo)
+                    py_cvo._set_list(self)
+                    self.py_sprites[key] = py_cvo
+                    self.py_serials[key] = c_cvo.getSerial()
+        finally:
+            self.c_mutex.unlock()
+        if c_cvo == NULL:
+            # a command removed it, drop the wrapper (and the object with it)
+            self._forget(key)
+            self.py_serials.pop(key, None)
+            raise KeyError(key)
+        return py_cvo
 
     def __setitem__(self, str key, PyCanvasObject cv_obj):
-        if self.c_cvos.find(pystr_to_chars(key)) != self.c_cvos.end():
-            print("overwriting")
         cv_obj.ID = key
+        cdef CanvasObjectID c_key = pystr_to_chars(key)
         cdef CanvasObject* c_cvo = cv_obj._cvo()
-        self.c_cvos[pystr_to_chars(key)] = c_cvo
+        cdef CanvasObject* replaced = NULL
+        cdef uint64_t start_us = traceBegin()
+        lockTraced(self.c_mutex, b"wait list lock")
+        it = self.c_cvos.find(c_key)
+        if it != self.c_cvos.end() and deref(it).second != c_cvo:
+            replaced = deref(it).second
+        self.c_cvos[c_key] = c_cvo
+        self.c_mutex.unlock()
+        trace_end(b"PyCanvasObjectList.__setitem__", start_us)
+        if replaced != NULL:
+            print("overwriting")
+            self._release(key, replaced)
+            self._forget(key)
         # need to keep a reference to the cvo (easiest to do this inside the py_cvo)
+        cv_obj._set_list(self)
         self.py_sprites[key] = cv_obj
+        self.py_serials[key] = c_cvo.getSerial()
 
     def __delitem__(self, str key):
-        it = self.c_cvos.find(pystr_to_chars(key))
-        if it == self.c_cvos.end():
-            raise KeyError
-        else:
+        cdef CanvasObjectID c_key = pystr_to_chars(key)
+        cdef CanvasObject* removed = NULL
+        cdef uint64_t start_us = traceBegin()
+        lockTraced(self.c_mutex, b"wait list lock")
+        it = self.c_cvos.find(c_key)
+        if it != self.c_cvos.end():
+            removed = deref(it).second
             self.c_cvos.erase(it)
-        self.py_sprite.pop(key)
+        self.c_mutex.unlock()
+        trace_end(b"PyCanvasObjectList.__delitem__", start_us)
+        if removed == NULL:
+            self._forget(key)
+            raise KeyError(key)
+        self._release(key, removed)
+        self._forget(key)
 
-    cdef cvo2py(self, CanvasObject* c_cvo):
-        if typeid(deref(c_cvo)) == typeid(Text):
-            return PyText.from_ptr(<Text*>c_cvo)
-        if typeid(deref(c_cvo)) == typeid(Sprite):
-            return PySprite.from_ptr(<Sprite*>c_cvo)
+    cdef _forget(self, str key):
+        """Drop the cached wrapper of key, which no longer draws with this list."""
+        cdef PyCanvasObject py_cvo = self.py_sprites.pop(key, None)
+        self.py_serials.pop(key, None)
+        if py_cvo is not None and py_cvo.py_list is self:
+            py_cvo._set_list(None)
+
+    cdef _release(self, str key, CanvasObject* c_cvo):
+        """An object left the list. One created by a command is handed to its
+        cached wrapper, or deleted if there is none."""
+        cdef PyCanvasObject py_cvo
+        if not c_cvo.isOwnedByList():
+            return
+        c_cvo.setOwnedByList(False)
+        py_cvo = self.py_sprites.get(key)
+        if (py_cvo is not None and py_cvo._cvo() == c_cvo
+                and self.py_serials.get(key) == c_cvo.getSerial()):
+            py_cvo._ptr_owner = True
         else:
-            raise TypeError
+            del c_cvo
+
+    cdef vector[CanvasObjectID] _ids2vector(self, ids) except *:
+        cdef vector[CanvasObjectID] c_ids
+        c_ids.reserve(len(ids))
+        for key in ids:
+            c_ids.push_back(pystr_to_chars(key))
+        return c_ids
+
+    def set_positions(self, ids, positions):
+        """Move the objects ids[i] to positions[i] = (x, y), all in the same
+        frame. positions can be any sequence of pairs, e.g. an (n, 2) array.
+        Returns the number of objects found."""
+        cdef vector[CanvasObjectID] c_ids = self._ids2vector(ids)
+        cdef vector[Point] c_positions
+        cdef size_t n_updated
+        cdef uint64_t start_us = traceBegin()
+        c_positions.reserve(c_ids.size())
+        for x, y in positions:
+            c_positions.push_back(Point(x, y))
+        with nogil:
+            n_updated = setPositions(&self.c_cvos, c_ids, c_positions,
+                                     self.c_mutex)
+            trace_end(b"PyCanvasObjectList.set_positions", start_us)
+        return n_updated
+
+    def set_speeds(self, ids, speeds):
+        """Set the speed of the objects ids[i] to speeds[i] in the same frame."""
+        cdef vector[CanvasObjectID] c_ids = self._ids2vector(ids)
+        cdef vector[double] c_speeds
+        cdef size_t n_updated
+        cdef uint64_t start_us = traceBegin()
+        c_speeds.reserve(c_ids.size())
+        for speed in speeds:
+            c_speeds.push_back(speed)
+        with nogil:
+            n_updated = setSpeeds(&self.c_cvos, c_ids, c_speeds, self.c_mutex)
+            trace_end(b"PyCanvasObjectList.set_speeds", start_us)
+        return n_updated
+
+    def set_visible(self, ids, visible):
+        """Show or hide the objects ids[i] in the same frame. visible is either
+        a sequence of flags or one flag for all of them."""
+        cdef vector[CanvasObjectID] c_ids = self._ids2vector(ids)
+        cdef vector[bool] c_visible
+        cdef size_t n_updated
+        cdef uint64_t start_us = traceBegin()
+        if not hasattr(visible, "__iter__"):
+            c_visible.assign(c_ids.size(), <bint>visible)
+        else:
+            for value in visible:
+                c_visible.push_back(<bint>value)
+        with nogil:
+            n_updated = setVisibilities(&self.c_cvos, c_ids, c_visible,
+                                        self.c_mutex)
+            trace_end(b"PyCanvasObjectList.set_visible", start_us)
+        return n_updated
+
+    cdef cvo2py(self, CanvasObject* c_cvo):
+        return wrap_cvo(c_cvo)
 
     cdef it2py(self, CanvasObjectListIterator it):
         cdef CanvasObject* c_cvo = deref(it).second
         return self.cvo2py(c_cvo)
 
     def __iter__(self):
-        cdef CanvasObjectListIterator it = self.c_cvos.begin()
+        # iterate over a snapshot, the lock must not be held between yields
+        cdef vector[CanvasObjectID] c_ids
+        cdef CanvasObjectID c_id
+        cdef CanvasObjectListIterator it
+        lockTraced(self.c_mutex, b"wait list lock")
+        it = self.c_cvos.begin()
         while it != self.c_cvos.end():
-            key = cstr_to_pystr(deref(it).first)
-            yield key
+            c_ids.push_back(deref(it).first)
             postincrement(it)
-        return
+        self.c_mutex.unlock()
+        for c_id in c_ids:
+            yield cstr_to_pystr(c_id)
 
     def __len__(self):
-        return self.c_cvos.size()
+        cdef size_t size
+        lockTraced(self.c_mutex, b"wait list lock")
+        size = self.c_cvos.size()
+        self.c_mutex.unlock()
+        return size
+
+
+    def set_timeline(self, ids, PyTimeline timeline):
+        """Give every object in ids its own copy of the timeline (or remove
+        the timelines with None). All of them start in the same frame.
+        Rotation and scale steps are rendered while the list is unlocked,
+        the animation only waits for the copies to be taken and handed over."""
+        if isinstance(ids, str):
+            ids = [ids]
+        cdef vector[CanvasObjectID] c_ids = self._ids2vector(ids)
+        cdef vector[CanvasObjectID] c_target_ids
+        cdef vector[CanvasObject*] c_targets
+        cdef vector[uint64_t] c_serials
+        cdef vector[Timeline*] c_timelines
+        cdef CanvasObject* c_cvo
+        cdef Timeline* c_tl
+        cdef size_t i
+        cdef uint64_t start_us = traceBegin()
+        if timeline is None:
+            lockTraced(self.c_mutex, b"wait list lock")
+            try:
+                for c_id in c_ids:
+                    it = self.c_cvos.find(c_id)
+                    if it != self.c_cvos.end():
+                        deref(it).second.setTimeline(NULL)
+            finally:
+                self.c_mutex.unlock()
+                trace_end(b"PyCanvasObjectList.set_timeline", start_us)
+            return
+        try:
+            # copy the timeline for every object, take the image it starts
+            # from and render the steps without holding the list
+            lockTraced(self.c_mutex, b"wait list lock")
+            try:
+                for c_id in c_ids:
+                    it = self.c_cvos.find(c_id)
+                    if it == self.c_cvos.end():
+                        continue
+                    c_cvo = deref(it).second
+                    c_tl = new Timeline(deref(timeline.c_tl))
+                    c_timelines.push_back(c_tl)
+                    c_target_ids.push_back(c_id)
+                    c_targets.push_back(c_cvo)
+                    c_serials.push_back(c_cvo.getSerial())
+                    c_tl.captureBase(c_cvo)
+            finally:
+                self.c_mutex.unlock()
+            with nogil:
+                for i in range(c_timelines.size()):
+                    c_timelines[i].prerender()
+        except:
+            for i in range(c_timelines.size()):
+                c_tl = c_timelines[i]
+                del c_tl
+            trace_end(b"PyCanvasObjectList.set_timeline", start_us)
+            raise
+        # hand them over to the objects that are still in the list
+        lockTraced(self.c_mutex, b"wait list lock")
+        try:
+            for i in range(c_timelines.size()):
+                c_tl = c_timelines[i]
+                c_timelines[i] = NULL
+                # skip objects that were removed meanwhile, also if another
+                # one took the ID or the address
+                it = self.c_cvos.find(c_target_ids[i])
+                if (it != self.c_cvos.end() and deref(it).second == c_targets[i]
+                        and c_targets[i].getSerial() == c_serials[i]):
+                    c_targets[i].setTimeline(c_tl)
+                else:
+                    del c_tl
+        finally:
+            self.c_mutex.unlock()
+            for i in range(c_timelines.size()):
+                c_tl = c_timelines[i]
+                if c_tl != NULL:
+                    del c_tl
+            trace_end(b"PyCanvasObjectList.set_timeline", start_us)
 
 
 class PyCanvasObjectList(PyCanvasObjectListBase, collections.abc.MutableMapping):
     pass
 
 
+cdef class PyTimeline:
+    """Keyframe tracks that are uploaded once and played by the render loop,
+    e.g.
+        tl = PyTimeline(repeat=-1)
+        tl.key("position", 0, (0, 10)).to("position", (150, 10), 60, "ease_in_out")
+        tl.to("visible", 0, 30, "step").to("visible", 1, 30, "step")
+        sprites.set_timeline(["nemo", "dorie"], tl)
+    Properties are position (x, y), visible, rotation (degrees), scale and
+    color (r, g, b); frames count from the start of the timeline."""
+    # cdef Timeline* c_tl
+    # cdef dict _track_ends
+
+    def __cinit__(self, int repeat=0, uint32_t delay=0):
+        self.c_tl = new Timeline()
+        self.c_tl.setRepeat(repeat)
+        self.c_tl.setDelay(delay)
+        self._track_ends = {}
+
+    def __dealloc__(self):
+        del self.c_tl
+
+    def key(self, str prop, uint32_t frame, value, str easing="linear"):
+        """Set prop to value at frame; easing shapes the way there."""
+        values = list(value) if hasattr(value, "__iter__") else [value]
+        values += [0] * (3 - len(values))
+        self.c_tl.addKeyframe(
+            resolveTimelineProperty(pystr_to_chars(prop)),
+            Keyframe(frame, resolveEasing(pystr_to_chars(easing)),
+                     values[0], values[1], values[2]))
+        self._track_ends[prop] = max(self._track_ends.get(prop, 0), frame)
+        return self
+
+    def to(self, str prop, value, uint32_t frames, str easing="linear"):
+        """Append a keyframe frames after the last keyframe of prop."""
+        return self.key(prop, self._track_ends.get(prop, 0) + frames, value, easing)
+
+    property length:
+        def __get__(self): return self.c_tl.getLength()
+
+
 cdef class PyCanvasObject:
     # cdef CanvasObject* c_cvo
     # cdef CanvasObject* _cvo(self)
     # cdef bool _ptr_owner
     # cdef bool _is_initialized
+    # cdef object py_list
 
     def __cinit__(self, *args, **kwargs):
         self._is_initialized = False
         self._ptr_owner = True
+        # the PyCanvasObjectList that draws this object, if any
+        self.py_list = None
 
     def __init__(self, *args, **kwargs):
         if not self._is_initialized:
@@ -106,6 +427,19 @@ cdef class PyCanvasObject:
     cdef CanvasObject* _cvo(self):
         return self.c_cvo
 
+    cdef _set_list(self, py_list):
+        self.py_list = py_list
+
+    cdef mutex* _lock_list(self):
+        """Lock the mutex of the list that draws this object, for changes
+        that the animation loop must not see halfway. Returns NULL if the
+        object is in no list."""
+        if self.py_list is None:
+            return NULL
+        cdef mutex* c_mutex = (<PyCanvasObjectListBase> self.py_list).c_mutex
+        lockTraced(c_mutex, b"wait list lock")
+        return c_mutex
+
     def do_step(self):
         self._cvo().doStep()
 
@@ -113,9 +447,20 @@ cdef class PyCanvasObject:
         def __get__(self): return self._cvo().getID().decode("UTF-8")
         def __set__(self, str value): self._cvo().setID(pystr_to_chars(value))
 
+    # New content replaces what the animation loop draws
     property fname:
         def __get__(self): return self._cvo().getContent()
-        def __set__(self, str value): self._cvo().setContent(value)
+        def __set__(self, str value):
+            cdef string c_value = value.encode("UTF-8")
+            self._set_content(c_value)
+
+    cdef _set_content(self, const string& c_value):
+        cdef mutex* c_mutex = self._lock_list()
+        try:
+            self._cvo().setContent(c_value)
+        finally:
+            if c_mutex != NULL:
+                c_mutex.unlock()
 
     property visible:
         def __get__(self): return self._cvo().getVisible()
@@ -144,6 +489,10 @@ cdef class PyCanvasObject:
         def __get__(self): return self._cvo().getSpeed()
         def __set__(self, double value): self._cvo().setSpeed(value)
 
+    property z:
+        def __get__(self): return self._cvo().getZ()
+        def __set__(self, int value): self._cvo().setZ(value)
+
     property edge_behavior:
         def __get__(self): return self._cvo().getEdgeBehavior()
         def __set__(self, value): self._cvo().setEdgeBehavior(value)
@@ -164,14 +513,36 @@ cdef class PySprite(PyCanvasObject):
     extension_types.html#existing-pointers-instantiation"""
     # cdef Sprite* c_spr
     # cdef PySprite from_ptr(Sprite*, bool owner=*)
+    # cdef Py_ssize_t _shape[3]
+    # cdef Py_ssize_t _strides[3]
+    # cdef int _exports
 
     def __cinit__(self, str fname):
+        self._exports = 0
         if fname == "":
             self._is_initialized = False
             return
+        # decoding can take a while, let other threads (e.g. the one that
+        # drives the animation) run meanwhile
+        cdef string c_fname = fname.encode("UTF-8")
+        cdef Sprite* c_spr
+        with nogil:
+            c_spr = new Sprite(c_fname)
+        self.c_spr = c_spr
         self._is_initialized = True
         self._ptr_owner = True
-        self.c_spr = new Sprite(pystr_to_chars(fname))
+
+    @staticmethod
+    def from_buffer(data, int width, int height, opacity=None):
+        """Create a sprite from packed RGB bytes (anything that supports the
+        buffer protocol, e.g. a numpy array of shape (height, width, 3) and
+        dtype uint8) and optional opacities (height x width bytes)."""
+        cdef PySprite py_sprite = PySprite.__new__(PySprite, "")
+        py_sprite.c_spr = new Sprite()
+        py_sprite._ptr_owner = True
+        py_sprite._is_initialized = True
+        py_sprite.set_pixels(data, width, height, opacity)
+        return py_sprite
 
     @staticmethod
     cdef PySprite from_ptr(Sprite* sprite, bool owner=False):
@@ -188,19 +559,130 @@ cdef class PySprite(PyCanvasObject):
     cdef CanvasObject* _cvo(self):
         return self.c_spr
 
+    cdef _check_exports(self):
+        if self._exports > 0:
+            raise BufferError("Release the pixel buffer before changing the size")
+
+    cdef _set_content(self, const string& c_value):
+        self._check_exports()
+        PyCanvasObject._set_content(self, c_value)
+
+    # Resizing and rotating redo the image, without holding the GIL but under
+    # the list's mutex, as the animation loop reads the pixels while drawing
     property width:
-        def __set__(self, int value): self.c_spr.setWidth(value)
+        def __set__(self, int value):
+            self._check_exports()
+            cdef mutex* c_mutex = self._lock_list()
+            with nogil:
+                self.c_spr.setWidth(value)
+                if c_mutex != NULL:
+                    c_mutex.unlock()
 
     property height:
-        def __set__(self, int value): self.c_spr.setHeight(value)
+        def __set__(self, int value):
+            self._check_exports()
+            cdef mutex* c_mutex = self._lock_list()
+            with nogil:
+                self.c_spr.setHeight(value)
+                if c_mutex != NULL:
+                    c_mutex.unlock()
 
     property rotation:
         def __get__(self): return self.c_spr.getRotation()
-        def __set__(self, double value): self.c_spr.setRotation(value)
+        def __set__(self, double value):
+            self._check_exports()
+            cdef mutex* c_mutex = self._lock_list()
+            with nogil:
+                self.c_spr.setRotation(value)
+                if c_mutex != NULL:
+                    c_mutex.unlock()
+
+    # Render attributes, applied while drawing (the pixels stay as they are)
+    property opacity:
+        def __get__(self): return self.c_spr.getOpacity()
+        def __set__(self, double value): self.c_spr.setOpacity(value)
+
+    property tint:
+        def __get__(self):
+            cdef Color tint = self.c_spr.getTint()
+            return (tint.r, tint.g, tint.b)
+        def __set__(self, (uint8_t, uint8_t, uint8_t) value):
+            self.c_spr.setTint(value[0], value[1], value[2])
+
+    property flip_x:
+        def __get__(self): return self.c_spr.getFlipX()
+        def __set__(self, bool value):
+            self.c_spr.setFlip(value, self.c_spr.getFlipY())
+
+    property flip_y:
+        def __get__(self): return self.c_spr.getFlipY()
+        def __set__(self, bool value):
+            self.c_spr.setFlip(self.c_spr.getFlipX(), value)
+
+    property quarter_turns:
+        def __get__(self): return self.c_spr.getQuarterTurns()
+        def __set__(self, int value): self.c_spr.setQuarterTurns(value)
+
+    # The pixels are exported without copying as a writable buffer of shape
+    # (height, width, 3), e.g. numpy.asarray(sprite)[:] = frame
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        self._shape[0] = self.c_spr.getHeight()
+        self._shape[1] = self.c_spr.getWidth()
+        self._shape[2] = 3
+        self._strides[0] = self._shape[1] * 3
+        self._strides[1] = 3
+        self._strides[2] = 1
+        buffer.buf = self.c_spr.getPixelData()
+        buffer.format = b"B"
+        buffer.internal = NULL
+        buffer.itemsize = 1
+        buffer.len = self._shape[0] * self._shape[1] * 3
+        buffer.ndim = 3
+        buffer.obj = self
+        buffer.readonly = 0
+        buffer.shape = self._shape
+        buffer.strides = self._strides
+        buffer.suboffsets = NULL
+        self._exports += 1
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        self._exports -= 1
+
+    def set_pixels(self, data, int width, int height, opacity=None):
+        """Replace the image with packed RGB bytes (one memcpy)."""
+        self._check_exports()
+        cdef Py_buffer rgb_view
+        cdef Py_buffer opacity_view
+        cdef const uint8_t* c_opacity = NULL
+        cdef mutex* c_mutex
+        PyObject_GetBuffer(data, &rgb_view, PyBUF_CONTIG_RO)
+        try:
+            if rgb_view.len != width * height * 3:
+                raise ValueError(f"Expected {width * height * 3} bytes")
+            if opacity is not None:
+                PyObject_GetBuffer(opacity, &opacity_view, PyBUF_CONTIG_RO)
+                if opacity_view.len != width * height:
+                    PyBuffer_Release(&opacity_view)
+                    raise ValueError(f"Expected {width * height} opacity bytes")
+                c_opacity = <const uint8_t*>opacity_view.buf
+            c_mutex = self._lock_list()
+            with nogil:
+                self.c_spr.setPixels(<const uint8_t*>rgb_view.buf, width, height,
+                                     c_opacity)
+                if c_mutex != NULL:
+                    c_mutex.unlock()
+            if opacity is not None:
+                PyBuffer_Release(&opacity_view)
+        finally:
+            PyBuffer_Release(&rgb_view)
+
+    def set_color(self, int x, int y, int red, int green, int blue):
+        self.c_spr.setPixel(x, y, red, green, blue)
 
     # def get_overlap(self, PySprite sprite):
     #     cdef Sprite* c_spr_other = sprite.c_spr
-    #     cdef Points ps = self.c_spr.getOverlap(c_spr_other)
+    #     cdef Points ps
+    #     self.c_spr.getOverlap(c_spr_other, &ps)
     #     p_str = ""
     #     cdef PointsIterator it = ps.begin()
     #     i = 0
@@ -242,3 +724,677 @@ cdef class PyText(PyCanvasObject):
 
     cdef CanvasObject* _cvo(self):
         return self.c_txt
+
+    def set_color(self, uint8_t red, uint8_t green, uint8_t blue):
+        self.c_txt.setColor(red, green, blue)
+
+    property color:
+        def __get__(self):
+            cdef Color color = self.c_txt.getColor()
+            return (color.r, color.g, color.b)
+        def __set__(self, (uint8_t, uint8_t, uint8_t) value):
+            self.c_txt.setColor(value[0], value[1], value[2])
+
+    # Render attributes, applied while drawing (the pixels stay as they are)
+    property opacity:
+        def __get__(self): return self.c_txt.getOpacity()
+        def __set__(self, double value): self.c_txt.setOpacity(value)
+
+    property tint:
+        def __get__(self):
+            cdef Color tint = self.c_txt.getTint()
+            return (tint.r, tint.g, tint.b)
+        def __set__(self, (uint8_t, uint8_t, uint8_t) value):
+            self.c_txt.setTint(value[0], value[1], value[2])
+
+    property flip_x:
+        def __get__(self): return self.c_txt.getFlipX()
+        def __set__(self, bool value):
+            self.c_txt.setFlip(value, self.c_txt.getFlipY())
+
+    property flip_y:
+        def __get__(self): return self.c_txt.getFlipY()
+        def __set__(self, bool value):
+            self.c_txt.setFlip(self.c_txt.getFlipX(), value)
+
+    property quarter_turns:
+        def __get__(self): return self.c_txt.getQuarterTurns()
+        def __set__(self, int value): self.c_txt.setQuarterTurns(value)
+
+
+cdef class PyVideo(PyCanvasObject):
+    """A video that is decoded in the background (needs ffmpeg) and scaled to
+    width x height pixels."""
+    # cdef Video* c_vid
+    # cdef PyVideo from_ptr(Video*, bool owner=*)
+
+    def __cinit__(self, str fname, int width=192, int height=64, **kwargs):
+        if fname == "":
+            self._is_initialized = False
+            return
+        self.c_vid = new Video(pystr_to_chars(fname), width, height)
+        self._is_initialized = True
+        self._ptr_owner = True
+        for key, value in kwargs.items():
+            setattr(self, key, value)
+
+    @staticmethod
+    cdef PyVideo from_ptr(Video* video, bool owner=False):
+        cdef PyVideo py_video = PyVideo.__new__(PyVideo, "")
+        py_video.c_vid = video
+        py_video._is_initialized = True
+        py_video._ptr_owner = owner
+        return py_video
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_vid
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_vid
+
+    property width:
+        def __set__(self, int value): self.c_vid.setWidth(value)
+
+    property height:
+        def __set__(self, int value): self.c_vid.setHeight(value)
+
+    property fps:
+        def __get__(self): return self.c_vid.getFrameRate()
+        def __set__(self, double value): self.c_vid.setFrameRate(value)
+
+    property loop:
+        def __get__(self): return self.c_vid.getLoop()
+        def __set__(self, bool value): self.c_vid.setLoop(value)
+
+    property dropped_frames:
+        def __get__(self): return self.c_vid.getDroppedFrames()
+
+
+cdef class PyLiveFeed(PyCanvasObject):
+    """Shows raw frames of width x height pixels that another process writes
+    to a pipe, FIFO or Unix socket (fname "-" reads stdin).
+    format is one of "rgb24", "bgr24" or "rgb565"."""
+    # cdef LiveFeed* c_feed
+    # cdef PyLiveFeed from_ptr(LiveFeed*, bool owner=*)
+
+    def __cinit__(self, str fname, int width=192, int height=64,
+                  str format="rgb24"):
+        if fname == "":
+            self._is_initialized = False
+            return
+        self.c_feed = new LiveFeed(
+            pystr_to_chars(fname), width, height,
+            resolvePixelFormat(pystr_to_chars(format))
+        )
+        self._is_initialized = True
+        self._ptr_owner = True
+
+    @staticmethod
+    cdef PyLiveFeed from_ptr(LiveFeed* feed, bool owner=False):
+        cdef PyLiveFeed py_feed = PyLiveFeed.__new__(PyLiveFeed, "")
+        py_feed.c_feed = feed
+        py_feed._is_initialized = True
+        py_feed._ptr_owner = owner
+        return py_feed
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_feed
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_feed
+
+    property frames_received:
+        def __get__(self): return self.c_feed.getFramesReceived()
+
+    property frames_shown:
+        def __get__(self): return self.c_feed.getFramesShown()
+
+
+cdef class PyAnimationStream(PyCanvasObject):
+    """Plays an animation stream made by bin/shapeshifter-bake from a
+    memory-mapped file, one frame per loop frame."""
+    # cdef AnimationStream* c_stream
+    # cdef PyAnimationStream from_ptr(AnimationStream*, bool owner=*)
+
+    def __cinit__(self, str fname):
+        if fname == "":
+            self._is_initialized = False
+            return
+        self.c_stream = new AnimationStream(pystr_to_chars(fname))
+        self._is_initialized = True
+        self._ptr_owner = True
+
+    @staticmethod
+    cdef PyAnimationStream from_ptr(AnimationStream* stream, bool owner=False):
+        cdef PyAnimationStream py_stream = PyAnimationStream.__new__(
+            PyAnimationStream, "")
+        py_stream.c_stream = stream
+        py_stream._is_initialized = True
+        py_stream._ptr_owner = owner
+        return py_stream
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_stream
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_stream
+
+    property frame_count:
+        def __get__(self): return self.c_stream.getFrameCount()
+
+    property frame_time_ms:
+        def __get__(self): return self.c_stream.getFrameTime()
+
+
+cdef class PyGroup(PyCanvasObject):
+    """Objects that move, wrap and hide together. Children added with add()
+    are positioned relative to the group, which then owns them."""
+    # cdef Group* c_grp
+    # cdef dict py_children
+    # cdef PyGroup from_ptr(Group*, bool owner=*)
+
+    def __cinit__(self, str name):
+        self.py_children = {}
+        if name == "":
+            self._is_initialized = False
+            return
+        self.c_grp = new Group(pystr_to_chars(name))
+        self._is_initialized = True
+        self._ptr_owner = True
+
+    @staticmethod
+    cdef PyGroup from_ptr(Group* group, bool owner=False):
+        cdef PyGroup py_group = PyGroup.__new__(PyGroup, "")
+        py_group.c_grp = group
+        py_group._is_initialized = True
+        py_group._ptr_owner = owner
+        return py_group
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_grp
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_grp
+
+    cdef _set_list(self, py_list):
+        self.py_list = py_list
+        for py_child in self.py_children.values():
+            (<PyCanvasObject> py_child)._set_list(py_list)
+
+    # The animation loop walks the children of groups in its list, so they
+    # only change under the list's mutex (see PyCanvasObject._lock_list)
+    def add(self, PyCanvasObject child):
+        cdef mutex* c_mutex = self._lock_list()
+        try:
+            self.c_grp.add(child._cvo())
+        finally:
+            if c_mutex != NULL:
+                c_mutex.unlock()
+        child._ptr_owner = False
+        child._set_list(self.py_list)
+        self.py_children[child.ID] = child
+
+    def remove(self, str key):
+        """Take the child out of the group; it is positioned on the panel
+        (with its former relative position) and owned by Python again."""
+        cdef CanvasObject* c_child
+        cdef mutex* c_mutex = self._lock_list()
+        try:
+            c_child = self.c_grp.remove(pystr_to_chars(key))
+        finally:
+            if c_mutex != NULL:
+                c_mutex.unlock()
+        if c_child == NULL:
+            raise KeyError(key)
+        cdef PyCanvasObject py_child = self.py_children.pop(key, None)
+        if py_child is None or py_child._cvo() != c_child:
+            py_child = wrap_cvo(c_child)
+        py_child._ptr_owner = True
+        py_child._set_list(None)
+        return py_child
+
+    def __getitem__(self, str key):
+        cdef CanvasObject* c_child
+        cdef mutex* c_mutex = self._lock_list()
+        try:
+            c_child = self.c_grp.find(pystr_to_chars(key))
+        finally:
+            if c_mutex != NULL:
+                c_mutex.unlock()
+        if c_child == NULL:
+            raise KeyError(key)
+        cdef PyCanvasObject py_child = self.py_children.get(key)
+        if py_child is None or py_child._cvo() != c_child:
+            py_child = wrap_cvo(c_child)
+            py_child._set_list(self.py_list)
+            self.py_children[key] = py_child
+        return py_child
+
+    def __iter__(self):
+        # iterate over a snapshot, the lock must not be held between yields
+        cdef vector[CanvasObjectID] c_ids
+        cdef CanvasObjectID c_id
+        cdef mutex* c_mutex = self._lock_list()
+        try:
+            for c_child in self.c_grp.getChildren():
+                c_ids.push_back(c_child.getID())
+        finally:
+            if c_mutex != NULL:
+                c_mutex.unlock()
+        for c_id in c_ids:
+            yield cstr_to_pystr(c_id)
+
+    def __len__(self):
+        cdef size_t size
+        cdef mutex* c_mutex = self._lock_list()
+        size = self.c_grp.getChildren().size()
+        if c_mutex != NULL:
+            c_mutex.unlock()
+        return size
+
+
+cdef class PyParticleSystem(PyCanvasObject):
+    """Thousands of additive single-pixel particles (snow, sparks, confetti)
+    born at the position of the object. Speeds and gravity are in pixels per
+    frame, lifetimes in frames, colors fade from start_color to end_color."""
+    # cdef ParticleSystem* c_ps
+    # cdef PyParticleSystem from_ptr(ParticleSystem*, bool owner=*)
+
+    def __cinit__(self, str name, size_t capacity=4096, **settings):
+        if name == "":
+            self._is_initialized = False
+            return
+        self.c_ps = new ParticleSystem(pystr_to_chars(name), capacity)
+        self._is_initialized = True
+        self._ptr_owner = True
+        for key, value in settings.items():
+            if not hasattr(PyParticleSystem, key):
+                raise TypeError(f"Unknown emitter setting '{key}'")
+            setattr(self, key, value)
+
+    @staticmethod
+    cdef PyParticleSystem from_ptr(ParticleSystem* ps, bool owner=False):
+        cdef PyParticleSystem py_ps = PyParticleSystem.__new__(PyParticleSystem, "")
+        py_ps.c_ps = ps
+        py_ps._is_initialized = True
+        py_ps._ptr_owner = owner
+        return py_ps
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_ps
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_ps
+
+    def burst(self, size_t n):
+        self.c_ps.burst(n)
+
+    property count:
+        def __get__(self): return self.c_ps.getCount()
+
+    property capacity:
+        def __get__(self): return self.c_ps.getCapacity()
+
+    property rate:
+        def __get__(self): return self.c_ps.getSettings().rate
+        def __set__(self, double rate):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.rate = rate
+            self.c_ps.setSettings(s)
+
+    property lifetime:
+        def __get__(self):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            return (s.min_lifetime, s.max_lifetime)
+        def __set__(self, lifetime):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.min_lifetime, s.max_lifetime = lifetime
+            self.c_ps.setSettings(s)
+
+    property speed:
+        def __get__(self):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            return (s.min_speed, s.max_speed)
+        def __set__(self, speed):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.min_speed, s.max_speed = speed
+            self.c_ps.setSettings(s)
+
+    property direction:
+        def __get__(self): return self.c_ps.getSettings().direction
+        def __set__(self, double direction):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.direction = direction
+            self.c_ps.setSettings(s)
+
+    property spread:
+        def __get__(self): return self.c_ps.getSettings().spread
+        def __set__(self, double spread):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.spread = spread
+            self.c_ps.setSettings(s)
+
+    property gravity:
+        def __get__(self):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            return (s.gravity_x, s.gravity_y)
+        def __set__(self, gravity):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.gravity_x, s.gravity_y = gravity
+            self.c_ps.setSettings(s)
+
+    property drag:
+        def __get__(self): return self.c_ps.getSettings().drag
+        def __set__(self, double drag):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.drag = drag
+            self.c_ps.setSettings(s)
+
+    property start_color:
+        def __get__(self):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            return tuple(s.start_color[i] for i in range(3))
+        def __set__(self, color):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.start_color[0], s.start_color[1], s.start_color[2] = color
+            self.c_ps.setSettings(s)
+
+    property end_color:
+        def __get__(self):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            return tuple(s.end_color[i] for i in range(3))
+        def __set__(self, color):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.end_color[0], s.end_color[1], s.end_color[2] = color
+            self.c_ps.setSettings(s)
+
+    property area:
+        def __get__(self):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            return (s.area_width, s.area_height)
+        def __set__(self, area):
+            cdef EmitterSettings s = self.c_ps.getSettings()
+            s.area_width, s.area_height = area
+            self.c_ps.setSettings(s)
+
+
+cdef class PyTileMap(PyCanvasObject):
+    """A grid of columns x rows tiles cut from one sprite sheet (the atlas),
+    which is decoded once for all tile maps using it. Tiles are indexed with
+    map[column, row]; -1 is an empty tile. Only the viewport (by default the
+    panel size) is drawn, starting at the scroll offset."""
+    # cdef TileMap* c_map
+    # cdef PyTileMap from_ptr(TileMap*, bool owner=*)
+
+    def __cinit__(self, str atlas, size_t tile_width=8, size_t tile_height=8,
+                  size_t columns=0, size_t rows=0):
+        if atlas == "":
+            self._is_initialized = False
+            return
+        cdef string c_atlas = atlas.encode("UTF-8")
+        cdef TileMap* c_map
+        with nogil:
+            c_map = new TileMap(c_atlas, tile_width, tile_height, columns, rows)
+        self.c_map = c_map
+        self._is_initialized = True
+        self._ptr_owner = True
+
+    @staticmethod
+    cdef PyTileMap from_ptr(TileMap* tile_map, bool owner=False):
+        cdef PyTileMap py_map = PyTileMap.__new__(PyTileMap, "")
+        py_map.c_map = tile_map
+        py_map._is_initialized = True
+        py_map._ptr_owner = owner
+        return py_map
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_map
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_map
+
+    def __getitem__(self, key):
+        column, row = key
+        return self.c_map.getTile(column, row)
+
+    # Tiles are changed under the mutex of the list that draws the map, so a
+    # frame never sees a half written or reallocated map
+    def __setitem__(self, key, int32_t index):
+        cdef size_t column = key[0]
+        cdef size_t row = key[1]
+        cdef mutex* c_mutex = self._lock_list()
+        self.c_map.setTile(column, row, index)
+        if c_mutex != NULL:
+            c_mutex.unlock()
+
+    def set_tiles(self, indices):
+        """Replace all tiles with indices in row major order (a flat iterable
+        or one iterable per row)."""
+        cdef vector[int32_t] c_indices
+        for item in indices:
+            if hasattr(item, "__iter__"):
+                for index in item:
+                    c_indices.push_back(index)
+            else:
+                c_indices.push_back(item)
+        cdef mutex* c_mutex = self._lock_list()
+        self.c_map.setTiles(c_indices)
+        if c_mutex != NULL:
+            c_mutex.unlock()
+
+    def fill(self, int32_t index):
+        cdef mutex* c_mutex = self._lock_list()
+        self.c_map.fill(index)
+        if c_mutex != NULL:
+            c_mutex.unlock()
+
+    property tile_count:
+        def __get__(self): return self.c_map.getTileCount()
+
+    property map_size:
+        def __get__(self): return self.c_map.getColumns(), self.c_map.getRows()
+        def __set__(self, size):
+            cdef size_t columns = size[0]
+            cdef size_t rows = size[1]
+            cdef mutex* c_mutex = self._lock_list()
+            self.c_map.setMapSize(columns, rows)
+            if c_mutex != NULL:
+                c_mutex.unlock()
+
+    property scroll:
+        def __get__(self):
+            cdef Point offset = self.c_map.getScroll()
+            return offset.x, offset.y
+        def __set__(self, offset):
+            self.c_map.setScroll(Point(offset[0], offset[1]))
+
+    property viewport:
+        def __get__(self): return self.c_map.getWidth(), self.c_map.getHeight()
+        def __set__(self, size):
+            self.c_map.setViewport(size[0], size[1])
+
+    property wrap_scroll:
+        def __get__(self): return self.c_map.getWrapScroll()
+        def __set__(self, bint value): self.c_map.setWrapScroll(value)
+
+
+cdef class PyImageScroller(PyCanvasObject):
+    """Pans a viewport (by default the panel size) across an image of any
+    size, e.g. a long banner. The image is decoded once into a block file in
+    /tmp; only up to cache_blocks blocks of 64x64 pixels are kept in memory.
+    Set scroll_speed to pan with the animation loop."""
+    # cdef ImageScroller* c_scroller
+    # cdef PyImageScroller from_ptr(ImageScroller*, bool owner=*)
+
+    def __cinit__(self, str fname, size_t cache_blocks=32):
+        if fname == "":
+            self._is_initialized = False
+            return
+        cdef string c_fname = fname.encode("UTF-8")
+        cdef ImageScroller* c_scroller
+        with nogil:
+            c_scroller = new ImageScroller(c_fname, cache_blocks)
+        self.c_scroller = c_scroller
+        self._is_initialized = True
+        self._ptr_owner = True
+
+    @staticmethod
+    cdef PyImageScroller from_ptr(ImageScroller* scroller, bool owner=False):
+        cdef PyImageScroller py_scroller = PyImageScroller.__new__(
+            PyImageScroller, "")
+        py_scroller.c_scroller = scroller
+        py_scroller._is_initialized = True
+        py_scroller._ptr_owner = owner
+        return py_scroller
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_scroller
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_scroller
+
+    property image_size:
+        def __get__(self):
+            return self.c_scroller.getImageWidth(), self.c_scroller.getImageHeight()
+
+    property scroll:
+        def __get__(self):
+            cdef Point offset = self.c_scroller.getScroll()
+            return offset.x, offset.y
+        def __set__(self, offset):
+            self.c_scroller.setScroll(Point(offset[0], offset[1]))
+
+    property scroll_speed:
+        def __get__(self):
+            cdef Point speed = self.c_scroller.getScrollSpeed()
+            return speed.x, speed.y
+        def __set__(self, speed):
+            self.c_scroller.setScrollSpeed(Point(speed[0], speed[1]))
+
+    property viewport:
+        def __get__(self):
+            return self.c_scroller.getWidth(), self.c_scroller.getHeight()
+        def __set__(self, size):
+            self.c_scroller.setViewport(size[0], size[1])
+
+    property wrap_scroll:
+        def __get__(self): return self.c_scroller.getWrapScroll()
+        def __set__(self, bint value): self.c_scroller.setWrapScroll(value)
+
+    property block_reads:
+        def __get__(self): return self.c_scroller.getBlockReads()
+
+
+cdef class PyShape(PyCanvasObject):
+    """A line, rectangle, rounded rectangle, ellipse or polygon that is
+    filled straight into the canvas, e.g. bars, boxes and grid lines without
+    image files. Changing size, radius or points only changes numbers, the
+    shape is not rasterized into an image. Points are relative to the
+    position, line_width 0 fills the shape and otherwise draws its outline."""
+    # cdef Shape* c_shape
+    # cdef PyShape from_ptr(Shape*, bool owner=*)
+
+    def __cinit__(self, str name, ShapeKind kind=SHAPE_RECT, **attributes):
+        if name == "":
+            self._is_initialized = False
+            return
+        self.c_shape = new Shape(pystr_to_chars(name), kind)
+        self._is_initialized = True
+        self._ptr_owner = True
+        for key, value in attributes.items():
+            if not hasattr(PyShape, key):
+                raise TypeError(f"Unknown shape attribute '{key}'")
+            setattr(self, key, value)
+
+    @staticmethod
+    cdef PyShape from_ptr(Shape* shape, bool owner=False):
+        cdef PyShape py_shape = PyShape.__new__(PyShape, "")
+        py_shape.c_shape = shape
+        py_shape._is_initialized = True
+        py_shape._ptr_owner = owner
+        return py_shape
+
+    def __dealloc__(self):
+        if self._ptr_owner:
+            del self.c_shape
+
+    cdef CanvasObject* _cvo(self):
+        return self.c_shape
+
+    property kind:
+        def __get__(self): return ShapeKind(self.c_shape.getKind())
+        def __set__(self, ShapeKind kind): self.c_shape.setKind(kind)
+
+    property size:
+        """The box of rectangles and ellipses, e.g. the length of a bar"""
+        def __get__(self):
+            return self.c_shape.getSizeX(), self.c_shape.getSizeY()
+        def __set__(self, size):
+            self.c_shape.setSize(size[0], size[1])
+
+    property points:
+        """Two points for a line (pixel centers), any number for a polygon"""
+        def __get__(self):
+            cdef vector[Point] c_points = self.c_shape.getPoints()
+            cdef size_t i
+            points = []
+            for i in range(c_points.size()):
+                points.append((c_points[i].x, c_points[i].y))
+            return points
+        def __set__(self, points):
+            cdef vector[Point] c_points
+            for x, y in points:
+                c_points.push_back(Point(x, y))
+            self.c_shape.setPoints(c_points)
+
+    property radius:
+        def __get__(self): return self.c_shape.getRadius()
+        def __set__(self, double value): self.c_shape.setRadius(value)
+
+    property line_width:
+        def __get__(self): return self.c_shape.getLineWidth()
+        def __set__(self, double value): self.c_shape.setLineWidth(value)
+
+    property color:
+        def __get__(self):
+            cdef Color color = self.c_shape.getColor()
+            return (color.r, color.g, color.b)
+        def __set__(self, (uint8_t, uint8_t, uint8_t) value):
+            self.c_shape.setColor(value[0], value[1], value[2])
+
+    property antialias:
+        def __get__(self): return self.c_shape.getAntialias()
+        def __set__(self, bool value): self.c_shape.setAntialias(value)
+
+    # Render attributes; flips and quarter turns are applied to the outline
+    property opacity:
+        def __get__(self): return self.c_shape.getOpacity()
+        def __set__(self, double value): self.c_shape.setOpacity(value)
+
+    property tint:
+        def __get__(self):
+            cdef Color tint = self.c_shape.getTint()
+            return (tint.r, tint.g, tint.b)
+        def __set__(self, (uint8_t, uint8_t, uint8_t) value):
+            self.c_shape.setTint(value[0], value[1], value[2])
+
+    property flip_x:
+        def __get__(self): return self.c_shape.getFlipX()
+        def __set__(self, bool value):
+            self.c_shape.setFlip(value, self.c_shape.getFlipY())
+
+    property flip_y:
+        def __get__(self): return self.c_shape.getFlipY()
+        def __set__(self, bool value):
+            self.c_shape.setFlip(self.c_shape.getFlipX(), value)
+
+    property quarter_turns:
+        def __get__(self): return self.c_shape.getQuarterTurns()
+        def __set__(self, int value): self.c_shape.setQuarterTurns(value)
@@ -0,0 +1,51 @@
+"""
+Chrome trace events of the animation loop and the bindings
+(see trace-events.h). The sprite and the panelwriter module each compiled
+their own copy of the C++ library and keep their own event rings, so this
+switches both and merges their events into one file that chrome://tracing
+or https://ui.perfetto.dev can open.
+"""
+
+import json
+import os
+import tempfile
+
+from . import panelwriter, sprite
+
+MODULES = (sprite, panelwriter)
+
+
+def start():
+    """Start recording events (the previous ones are kept)."""
+    for module in MODULES:
+        module._trace_events_enable(True)    # pylint: disable=protected-access
+
+
+def stop():
+    """Stop recording events, they can still be flushed."""
+    for module in MODULES:
+        module._trace_events_enable(False)   # pylint: disable=protected-access
+
+
+def clear():
+    """Drop all recorded events."""
+    for module in MODULES:
+        module._trace_events_clear()         # pylint: disable=protected-access
+
+
+def flush(fname):
+    """Write the recorded events of both modules to fname."""
+    events = []
+    for module in MODULES:
+        fd, tmp_fname = tempfile.mkstemp(suffix=".json")
+        os.close(fd)
+        try:
+            # pylint: disable=protected-access
+            if not module._trace_events_flush(tmp_fname):
+                raise OSError(f"Could not write trace events to {tmp_fname}")
+            with open(tmp_fname, encoding="utf-8") as tmp_file:
+                events.extend(json.load(tmp_file)["traceEvents"])
+        finally:
+            os.remove(tmp_fname)
+    with open(fname, "w", encoding="utf-8") as trace_file:
+        json.dump({"traceEvents": events}, trace_file)
@@ -4,8 +4,9 @@
 
 import time
 import json
+import socket
 
-FIFO_PATH = "/tmp/led-fifo"
+SOCKET_PATH = "/tmp/shapeshifter.sock"     # bin/shapeshifter -s <path>
 
 def main():
     start_position = {"x": 5, "y" : 40}
@@ -24,9 +25,9 @@ def send_dict(**kwargs):
 
 def send_message(message):
     message_string = json.dumps(message)
-    with open(FIFO_PATH, "w") as fifo:
-        fifo.write(f"{message_string}\n")
-        fifo.flush()
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(SOCKET_PATH)
+        sock.sendall(f"{message_string}\n".encode("UTF-8"))
     print(f"Send message: {message_string}")
 
 def add_sprite(sprite_id, file, **kwargs):
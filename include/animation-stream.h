@@ -0,0 +1,86 @@
+#ifndef ANIMATION_STREAM_H
+#define ANIMATION_STREAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "canvas.h"
+#include "sprite.h"
+
+namespace Sprites {
+
+  // An animation stream holds pre-rendered frames as deltas to the frame
+  // before. Layout: StreamHeader, frame data, index of frame_count + 2
+  // uint64 offsets (padded to 8 bytes, older streams may not be). Delta i (i < frame_count) turns frame i-1 into frame i
+  // (frame -1 is black), delta frame_count turns the last frame back into
+  // the first one, so the stream loops without a keyframe. A delta is a
+  // sequence of runs: u32 pixels to skip, u32 pixels to copy, RGB data.
+  struct StreamHeader {
+    StreamHeader();
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_count;
+    uint32_t frame_time_ms;
+    uint64_t index_offset;
+  };
+
+  class AnimationStreamWriter {
+  public:
+    AnimationStreamWriter();
+    ~AnimationStreamWriter();
+
+    bool open(const std::string& filename, size_t width, size_t height,
+              uint32_t frame_time_ms);
+    void addFrame(const uint8_t* rgb);
+    bool close();
+
+  private:
+    void writeDelta(const uint8_t* from, const uint8_t* to);
+
+    FILE* file;
+    StreamHeader header;
+    std::vector<uint8_t> first_frame;
+    std::vector<uint8_t> last_frame;
+    std::vector<uint64_t> index;
+  };
+
+  // Plays an animation stream by mmap-ing it and applying one delta per
+  // frame to a frame buffer that is allocated once when the file is opened.
+  // Black pixels are transparent, so a stream can be a layer or the whole
+  // scene.
+  class AnimationStream : public CanvasObject {
+  public:
+    AnimationStream();
+    AnimationStream(const std::string filename);
+    ~AnimationStream();
+
+    void setContent(const std::string& filename);
+    const std::string& getContent() const;
+    uint32_t getFrameCount() const;
+    uint32_t getFrameTime() const;
+
+    void doStep();
+    void draw(rgb_matrix::Canvas* canvas) const;
+
+  protected:
+    void unmap();
+    void applyDelta(const uint32_t delta);
+    uint64_t getDeltaOffset(const uint32_t delta) const;
+
+    std::string filename;
+    const uint8_t* data;
+    size_t data_size;
+    const StreamHeader* header;
+    const uint8_t* index;         // read with memcpy, may be unaligned
+    std::vector<uint8_t> frame;
+    uint32_t next_frame;
+  };
+
+} // end namespace Sprites
+
+#endif
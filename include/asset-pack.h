@@ -0,0 +1,67 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <cstdint>
+#include <string>
+
+namespace Sprites {
+
+  // An asset pack holds pre-decoded images (packed RGB plus one opacity byte
+  // per pixel) so that sprites can use them straight from the mmap-ed file.
+  // Layout: PackHeader, pixel data, PackEntry index sorted by name and height.
+  // Packs are written by bin/shapeshifter-pack.
+  struct PackHeader {
+    PackHeader();
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t entry_count;
+    uint32_t reserved2;
+    uint64_t index_offset;
+  };
+
+  struct PackEntry {
+    static const uint32_t NATIVE_SIZE = 1;
+    char name[112];
+    uint32_t width;
+    uint32_t height;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t pixel_offset;    // width * height * 3 bytes RGB
+    uint64_t mask_offset;     // width * height bytes opacity
+  };
+
+  struct PackedImage {
+    PackedImage();
+    const uint8_t* pixels;
+    const uint8_t* mask;
+    size_t width;
+    size_t height;
+  };
+
+  class AssetPack {
+  public:
+    AssetPack();
+    ~AssetPack();
+
+    bool open(const std::string& filename);
+    void close();
+    size_t size() const;
+    // height 0 finds the image in its original size
+    bool find(const std::string& name, size_t height, PackedImage* image) const;
+
+    // Packs loaded here stay mapped for the whole runtime. Sprite::setContent
+    // looks up every file name in them before decoding the file.
+    static bool load(const std::string& filename);
+    static bool lookup(const std::string& name, size_t height, PackedImage* image);
+
+  private:
+    const uint8_t* data;
+    size_t data_size;
+    const PackHeader* header;
+    const PackEntry* entries;
+  };
+
+} // end namespace Sprites
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef COMMAND_TRACE_H
+#define COMMAND_TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+
+#include "command.h"
+#include "led-loop.h"
+#include "sprite.h"
+
+
+namespace led_loop {
+
+  // A command trace is a binary file that starts with a TraceHeader and
+  // continues with records of the form
+  //   u32 frame, u32 milliseconds since start, u16 length, encoded Message.
+  // Every scene mutation between two frames is recorded in the frame it
+  // becomes visible, so replaying the trace frame by frame is deterministic.
+  // Only Sprites loaded from a file and Texts, without a Timeline, can be
+  // recreated by commands; other objects are left out of the trace entirely
+  // (with one warning each), an object that gets a Timeline is recorded as
+  // removed.
+  struct TraceHeader {
+    TraceHeader();
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t frame_time_ms;
+  };
+
+  class CommandTraceWriter {
+  public:
+    CommandTraceWriter();
+    ~CommandTraceWriter();
+
+    bool open(const std::string& filename, const tmillis_t frame_time_ms);
+    void close();
+    bool isOpen() const;
+
+    // Compares the scene with its state after the last frame and records the
+    // differences as messages. Called before the objects are stepped.
+    void capture(const uint32_t frame, Sprites::CanvasObjectList* canvas_objects);
+    // Remembers the state of the scene after the objects were stepped.
+    void snapshot(Sprites::CanvasObjectList* canvas_objects);
+    void record(const uint32_t frame, const Message& msg);
+
+  private:
+    enum ObjectKind { OTHER_OBJECT, SPRITE_OBJECT, TEXT_OBJECT };
+    struct ObjectState {
+      ObjectState();
+      ObjectKind kind;
+      std::string content;
+      std::string font;
+      Sprites::Point position;
+      Sprites::Point position_goal;
+      int goal_steps;
+      double speed;
+      double direction;
+      double rotation;
+      double resize;
+      bool visible;
+      Sprites::EdgeBehavior edge_behavior;
+      int z;
+      double opacity;
+      int tint;                 // 0xRRGGBB
+      bool flip_x;
+      bool flip_y;
+      int quarter_turns;
+    };
+    static ObjectState getState(const Sprites::CanvasObject* cvo);
+
+    FILE* file;
+    tmillis_t start_ms;
+    std::string buffer;
+    std::map<Sprites::CanvasObjectID, ObjectState> states;
+    // IDs of objects that no command can create, they are left out
+    std::set<Sprites::CanvasObjectID> untraced;
+  };
+
+  class CommandTraceReader {
+  public:
+    CommandTraceReader();
+    ~CommandTraceReader();
+
+    bool open(const std::string& filename);
+    void close();
+    tmillis_t getFrameTime() const;
+    bool atEnd() const;
+
+    // Applies all records up to and including the given frame. The caller
+    // holds the data mutex.
+    size_t replay(const uint32_t frame, Sprites::CanvasObjectList* canvas_objects);
+
+  private:
+    bool readRecord();
+
+    FILE* file;
+    TraceHeader header;
+    bool has_record;
+    uint32_t record_frame;
+    Message record;
+    std::string buffer;
+  };
+
+} // end namespace led_loop
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <string>
+
+#include "sprite.h"
+
+
+namespace led_loop {
+
+  enum Command {
+    INVALID_COMMAND,
+    UNKNOWN_COMMAND,
+    NO_COMMAND,
+    ADD_SPRITE,
+    ADD_TEXT,
+    REMOVE_SPRITE,
+    SET,
+    ADD,
+    TARGET
+  };
+
+  // A single scene mutation. Fields that are NaN, empty or undefined are left
+  // untouched when the message is applied.
+  struct Message {
+    Message();
+    void print() const;
+
+    Command command;
+    Sprites::CanvasObjectID id;
+    std::string filename;     // image for ADD_SPRITE, text for ADD_TEXT / SET
+    std::string font;
+    Sprites::Point position;
+    double speed;
+    double direction;
+    double rotation;
+    double resize;
+    int duration;             // in frames (TARGET only)
+    int visible;              // -1: undefined
+    Sprites::EdgeBehavior edge_behavior;
+    int z;                    // INT_MIN: undefined
+    double opacity;
+    int tint;                 // 0xRRGGBB, -1: undefined
+    int flip_x;               // -1: undefined
+    int flip_y;               // -1: undefined
+    int quarter_turns;        // -1: undefined
+  };
+
+  Command resolveCommand(const std::string& str);
+  const char* commandName(const Command command);
+  Sprites::EdgeBehavior resolveEdgeBehavior(const std::string& str);
+
+  // Objects created by ADD_SPRITE / ADD_TEXT belong to the list (see
+  // CanvasObject::setOwnedByList) and are deleted again when a command
+  // removes or replaces them; other objects are only taken out of the list.
+  // The caller holds the data mutex, so ADD_SPRITE decodes its image while
+  // the frame waits: a large image not found in an AssetPack stalls the
+  // animation for the time of the decode. Returns non-zero on failure.
+  int applyCommand(const Message& msg, Sprites::CanvasObjectList* canvas_objects);
+
+  // Compact binary encoding (host byte order): u8 command, u16 field mask,
+  // u8 ID length, ID, followed by the fields that are set.
+  void encodeMessage(const Message& msg, std::string* out);
+  // Returns the number of bytes consumed or 0 if data does not hold a message.
+  size_t decodeMessage(const char* data, size_t len, Message* msg);
+
+} // end namespace led_loop
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "command.h"
+#include "led-loop.h"
+
+
+namespace led_loop {
+
+  // Parses one JSON object as sent by command_sender.py, e.g.
+  //   {"command": "target", "ID": "bremen", "position": {"x": 5, "y": 3},
+  //    "duration": 3000}
+  // The duration is given in ms and converted to frames.
+  bool parseJSONMessage(const std::string& line, const tmillis_t frame_time_ms,
+                        Message* msg);
+
+  // Accepts any number of clients on a Unix stream socket. Every client can
+  // mix two framings on the same connection:
+  //   - newline-delimited JSON objects (see parseJSONMessage)
+  //   - binary messages: a 0x00 byte, u16 payload length (host byte order)
+  //     and the payload from encodeMessage
+  // Everything received is parsed on the server thread and queued; the
+  // AnimationLoop takes the whole queue at the next frame boundary.
+  class ControlServer {
+  public:
+    ControlServer();
+    ~ControlServer();
+
+    bool start(const std::string& socket_path, const tmillis_t frame_time_ms);
+    void stop();
+    bool isRunning() const;
+
+    // Moves all messages received since the last call into messages
+    void takeMessages(std::vector<Message>* messages);
+    size_t getClientCount() const;
+
+    static const uint8_t BINARY_MARKER = 0x00;
+    // A client that sends this much without a complete message is dropped
+    static const size_t MAX_PENDING_BYTES = 1 << 16;
+
+  private:
+    void serve();
+    void acceptClients();
+    bool readClient(const int fd);
+    void parse(std::string* buffer, std::vector<Message>* messages) const;
+    void dropClient(const int fd);
+
+    std::string socket_path;
+    tmillis_t frame_time_ms;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    volatile bool is_running;
+    std::thread server_thread;
+    std::map<int, std::string> clients;   // fd -> unparsed input
+    mutable std::mutex queue_mutex;
+    std::vector<Message> queue;
+    std::atomic<size_t> client_count;
+  };
+
+} // end namespace led_loop
+
+#endif
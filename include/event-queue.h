@@ -0,0 +1,58 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "sprite.h"
+
+
+namespace led_loop {
+
+  // One Sprites::ObjectEvent of one object, see AnimationLoop::setEventMask
+  struct EventRecord {
+    uint32_t frame;     // the frame in which the object stepped
+    uint8_t type;       // a single Sprites::ObjectEvent flag
+    double x;           // world position after the step
+    double y;
+    char id[55];        // the object's ID, truncated and NUL terminated
+  };
+
+  // A bounded ring for the events of the animation loop. The loop is the
+  // only producer and never blocks or allocates: a full ring drops the
+  // event and counts it. Readers may be on any thread (they serialize
+  // among themselves) and can wait on an eventfd that becomes readable
+  // when a frame queued events.
+  class EventQueue {
+  public:
+    // The capacity is rounded up to a power of two
+    EventQueue(const uint32_t capacity = 1024);
+    ~EventQueue();
+
+    // Producer side, only called by the animation thread
+    bool push(const uint32_t frame, const uint8_t type,
+              const Sprites::CanvasObject& object);
+    // Wake readers if anything was pushed since the last call
+    void signal();
+
+    // Consumer side. Never blocks; returns the number of events copied
+    size_t pop(EventRecord* events, const size_t max_events);
+    int getFd() const;
+    uint64_t getDropped() const;
+
+  private:
+    std::vector<EventRecord> ring;
+    uint32_t mask;
+    std::atomic<uint32_t> head;     // next slot to write, producer only
+    std::atomic<uint32_t> tail;     // next slot to read, consumers only
+    std::atomic<uint64_t> dropped;
+    std::mutex consumer_mutex;
+    bool pushed;
+    int fd;
+  };
+
+} // end namespace led_loop
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+
+namespace Sprites {
+
+  // Bump allocator for temporaries that only live while one frame is
+  // prepared. Everything is released at once by reset(), which the animation
+  // loop calls at the start of every frame. If a frame needed more than the
+  // capacity, the excess comes from the heap and the arena grows to the
+  // high water mark at the next reset, so steady frames never allocate.
+  class FrameArena {
+  public:
+    FrameArena(const size_t capacity = 64 * 1024);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(const size_t size,
+                   const size_t alignment = alignof(std::max_align_t));
+    template <typename T>
+    T* allocate(const size_t n) {
+      return static_cast<T*>(this->allocate(n * sizeof(T), alignof(T)));
+    }
+    void reset();
+    size_t getCapacity() const;
+    size_t getUsed() const;
+
+    // The arena of the frame that is prepared on the calling thread, nullptr
+    // outside of a frame (e.g. when Python draws an object itself)
+    static FrameArena* current();
+
+  private:
+    friend class ArenaScope;
+
+    char* buffer;
+    size_t capacity;
+    size_t used;
+    size_t high_water;
+    std::vector<void*> overflow;
+  };
+
+  // Makes an arena current() on this thread for its lifetime
+  class ArenaScope {
+  public:
+    ArenaScope(FrameArena* arena);
+    ~ArenaScope();
+  private:
+    FrameArena* previous;
+  };
+
+} // end namespace Sprites
+
+#endif
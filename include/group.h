@@ -0,0 +1,49 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <string>
+#include <vector>
+
+#include "canvas.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+  // A CanvasObject made of other CanvasObjects. Children are positioned
+  // relative to the group and move with it: speed, direction, edge behavior
+  // and visibility of the group apply to the whole subtree, and moving the
+  // group only marks the cached world positions of its children as stale.
+  // Children still step on their own (relative) motion and timelines.
+  class Group : public CanvasObject {
+  public:
+    Group();
+    Group(const std::string name);
+    ~Group();
+
+    // Takes ownership of the child. Like the list a drawn group is in, its
+    // children only change under the loop's data mutex
+    void add(CanvasObject* child);
+    // Gives up ownership of the child again, nullptr if there is none
+    CanvasObject* remove(const CanvasObjectID& id);
+    CanvasObject* find(const CanvasObjectID& id) const;
+    const std::vector<CanvasObject*>& getChildren() const;
+
+    void setContent(const std::string& name);
+    const std::string& getContent() const;
+
+    void doStep();
+    void draw(rgb_matrix::Canvas* canvas) const;
+    void invalidateWorldPosition();
+
+  private:
+    void updateBounds();
+
+    std::string name;
+    std::vector<CanvasObject*> children;
+    mutable std::vector<CanvasObject*> draw_order;
+  };
+
+} // end namespace Sprites
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef IMAGE_SCROLLER_H
+#define IMAGE_SCROLLER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "canvas.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+  // Pans a viewport (by default the panel) across an image of any size. The
+  // image is decoded once into a block file (BLOCK_SIZE x BLOCK_SIZE RGBA
+  // blocks, kept next to other caches in /tmp and reused while the image
+  // file is unchanged). The decode keeps the pixels in a disk backed pixel
+  // cache, so its heap peaks at about 32 MB plus one band of BLOCK_SIZE rows. Only a bounded number of blocks is held in memory;
+  // the ones in the viewport are read on demand and a background thread
+  // reads the next ones in the scroll direction ahead of time.
+  class ImageScroller : public CanvasObject {
+  public:
+    static const size_t BLOCK_SIZE = 64;
+
+    ImageScroller();
+    ImageScroller(const std::string filename, const size_t cache_blocks = 32);
+    ~ImageScroller();
+
+    void setContent(const std::string& filename);
+    const std::string& getContent() const;
+    size_t getImageWidth() const;
+    size_t getImageHeight() const;
+
+    void setScroll(const Point& offset);
+    const Point& getScroll() const;
+    // Pixels per frame the scroll offset moves by in doStep
+    void setScrollSpeed(const Point& speed);
+    const Point& getScrollSpeed() const;
+    void setViewport(const size_t width, const size_t height);
+    void setWrapScroll(const bool wrap_scroll);
+    bool getWrapScroll() const;
+    // Blocks read from the file so far, to check the prefetching
+    size_t getBlockReads() const;
+
+    void doStep();
+    void draw(rgb_matrix::Canvas* canvas) const;
+
+  private:
+    struct Block {
+      Block();
+      int64_t key;          // block row * blocks per row + block column
+      uint64_t last_used;
+      std::vector<uint8_t> rgba;
+    };
+
+    void openBlockFile();
+    void closeBlockFile();
+    void resizeCache();
+    const uint8_t* getBlock(const int64_t key) const;   // with cache_mutex
+    Block* findSlot(const int64_t key) const;
+    bool readBlock(const int64_t key, uint8_t* rgba) const;
+    void wantedBlocks(const Point& offset, std::vector<int64_t>* keys) const;
+    void prefetchLoop();
+
+    std::string filename;
+    size_t image_width;
+    size_t image_height;
+    size_t blocks_x;
+    size_t blocks_y;
+    int fd;
+    size_t data_offset;
+    Point scroll;
+    Point scroll_speed;
+    bool wrap_scroll;
+    size_t min_cache_blocks;
+
+    mutable std::mutex cache_mutex;
+    mutable std::vector<Block> cache;
+    mutable uint64_t use_clock;
+    mutable std::atomic<size_t> block_reads;
+    std::vector<int64_t> prefetch_keys;
+    std::condition_variable prefetch_wanted;
+    bool prefetching;
+    std::thread prefetch_thread;
+  };
+
+} // end namespace Sprites
+
+#endif
@@ -1,13 +1,26 @@
 #ifndef LED_LOOP_H
 #define LED_LOOP_H
 
+#include <atomic>
+#include <cstdint>
+#include <map>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 
+#include "command.h"
+#include "event-queue.h"
+#include "frame-arena.h"
 #include "led-matrix.h"
+#include "realtime.h"
 #include "sprite.h"
 
 
+namespace Sprites {
+  class PixelCanvas;
+}
+
 namespace led_loop {
 
   typedef long long int tmillis_t;
@@ -15,11 +28,46 @@ namespace led_loop {
   tmillis_t getTimeInMillis();
   void sleepMillis(tmillis_t milli_seconds);
 
+  // Sent after every presented frame, see AnimationLoop::getTickFd
+  struct FrameTick {
+    FrameTick();
+    uint32_t frame;         // frame counter after the swap
+    tmillis_t present_ms;   // when SwapOnVSync returned (getTimeInMillis)
+    uint64_t ticks;         // frames since the last readTick, >1 means missed
+  };
+
   struct LoopOptions {
     LoopOptions();
     tmillis_t frame_time_ms;
+    Sprites::ThreadOptions thread;    // the animation thread
+    Sprites::ThreadOptions workers;   // see Sprites::setWorkerThreadOptions
+    bool lock_memory;
+  };
+
+  // See AnimationLoop::getStats
+  struct LoopStats {
+    LoopStats();
+    uint32_t frames;
+    uint32_t missed_deadlines;    // frames that took longer than frame_time_ms
+    tmillis_t last_frame_ms;
+    tmillis_t max_frame_ms;
+    bool thread_configured;       // the thread options could be applied
+    bool memory_locked;
   };
 
+  // An object list with the mutex that guards it
+  struct Scene {
+    Scene(Sprites::CanvasObjectList* objects = nullptr,
+          std::mutex* objects_mutex = nullptr);
+    Sprites::CanvasObjectList* objects;
+    std::mutex* objects_mutex;
+  };
+
+  class CommandTraceWriter;
+  class ControlServer;
+  class PostProcess;
+  class SharedTable;
+
   class AnimationLoop {
     public:
       AnimationLoop();
@@ -27,6 +75,11 @@ namespace led_loop {
                     Sprites::CanvasObjectList* canvas_objects,
                     LoopOptions* options = nullptr,
                     std::mutex* data_mutex = nullptr);
+      // Off-hardware loop, e.g. rendering into a Sprites::PixelCanvas
+      AnimationLoop(rgb_matrix::Canvas* canvas,
+                    Sprites::CanvasObjectList* canvas_objects,
+                    LoopOptions* options = nullptr,
+                    std::mutex* data_mutex = nullptr);
       ~AnimationLoop();
       void startLoop();
       const std::thread& getThread() const;
@@ -34,22 +87,116 @@ namespace led_loop {
 
       void prepareFrame();
       void doFrame();
+      uint32_t getFrameCount() const;
+      void getStats(LoopStats* stats);
+      const LoopOptions& getOptions() const;
+
+      // eventfd that becomes readable after each presented frame, for use
+      // with poll/select or an asyncio reader. -1 if it could not be created
+      int getTickFd() const;
+      // Consume pending ticks without blocking; false if there were none
+      bool readTick(FrameTick* tick);
+
+      // Queue the Sprites::ObjectEvent flags in mask of every stepped object
+      // (also children of groups and layer objects); 0 turns it off again
+      void setEventMask(const uint8_t mask);
+      uint8_t getEventMask() const;
+      // eventfd that becomes readable after a frame that queued events
+      int getEventFd() const;
+      // Take up to max_events queued events without blocking
+      size_t readEvents(EventRecord* events, const size_t max_events);
+      // Events lost because nobody read the full queue
+      uint64_t getDroppedEvents() const;
+
+      bool startTrace(const std::string& filename);
+      void stopTrace();
+
+      // Accept commands on a Unix socket (see control-server.h); they are
+      // applied at the start of the next frame
+      bool startControlServer(const std::string& socket_path);
+      void stopControlServer();
+      // Publish the objects in a shared memory table (see shared-table.h)
+      bool startSharedTable(const std::string& name, const uint32_t capacity = 256);
+      void stopSharedTable();
+
+      // Global color effects over the finished frame (see post-process.h).
+      // Fades move to their target over the given number of frames
+      void setFade(const double brightness, const uint32_t frames = 0);
+      void setGamma(const double gamma);
+      void setTint(const uint8_t red, const uint8_t green, const uint8_t blue);
+      void setInvert(const bool invert);
+      // A second list of objects that is drawn on its own and blended over
+      // the frame with the layer alpha, e.g. to crossfade to another scene.
+      // It is only stepped while its alpha is above 0
+      void setLayer(Sprites::CanvasObjectList* layer_objects,
+                    std::mutex* layer_mutex = nullptr);
+      void setLayerAlpha(const double alpha, const uint32_t frames = 0);
+
+      // Named scenes: only the active one is stepped and drawn, the others
+      // cost nothing per frame and can be built in another thread (under
+      // their own mutex). The list given to the constructor is the scene "".
+      // A switch happens at the next frame boundary; with frames > 0 the new
+      // scene is crossfaded in through the layer first
+      bool addScene(const std::string& name,
+                    Sprites::CanvasObjectList* objects,
+                    std::mutex* objects_mutex = nullptr);
+      // Fails for the active scene and one that is being switched to
+      bool removeScene(const std::string& name);
+      bool switchScene(const std::string& name, const uint32_t frames = 0);
+      std::string getActiveScene() const;
 
       void lock_canvas_objects();
       void unlock_canvas_objects();
       void setMutex(std::mutex* data_mutex);
       std::mutex* getMutex() const;
-      rgb_matrix::FrameCanvas* getCanvas();
+      rgb_matrix::Canvas* getCanvas();
     private:
       void animation_loop();
+      void setOptions(LoopOptions* options, std::mutex* data_mutex);
+      void signalTick();
+      void drawObjects(Sprites::CanvasObjectList* canvas_objects,
+                       std::vector<Sprites::CanvasObject*>* draw_order,
+                       rgb_matrix::Canvas* canvas);
+      void queueEvents(const Sprites::CanvasObject* object, const uint8_t mask);
+      PostProcess* getPostProcess();
+      void updateScene();
+      bool isSceneShown(const std::string& name) const;
 
       std::mutex* data_mutex;
       volatile bool is_running;
       std::thread animation_thread;
       rgb_matrix::RGBMatrix* matrix;
-      rgb_matrix::FrameCanvas* canvas;
+      rgb_matrix::Canvas* canvas;
       Sprites::CanvasObjectList* canvas_objects;
       tmillis_t frame_time_ms;
+      uint32_t frame_count;
+      LoopOptions options;
+      LoopStats stats;
+      CommandTraceWriter* trace_writer;
+      ControlServer* control_server;
+      std::vector<Message> pending_messages;
+      SharedTable* shared_table;
+      std::vector<Sprites::CanvasObject*> draw_order;
+      // Temporaries of prepareFrame, reset at the start of every frame
+      Sprites::FrameArena frame_arena;
+      PostProcess* post_process;
+      Sprites::PixelCanvas* frame_buffer;
+      Sprites::PixelCanvas* layer_buffer;
+      Sprites::CanvasObjectList* layer_objects;
+      std::mutex* layer_mutex;
+      std::vector<Sprites::CanvasObject*> layer_draw_order;
+      std::map<std::string, Scene> scenes;
+      std::string active_scene;
+      std::string next_scene;
+      bool scene_pending;
+      bool in_transition;
+      uint32_t transition_frames;
+      std::mutex* objects_mutex;
+      int tick_fd;
+      std::mutex tick_mutex;
+      FrameTick last_tick;
+      std::atomic<uint8_t> event_mask;
+      EventQueue event_queue;
   };
 
 } // end namespace led_loop
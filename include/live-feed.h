@@ -0,0 +1,70 @@
+#ifndef LIVE_FEED_H
+#define LIVE_FEED_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "canvas.h"
+#include "sprite.h"
+
+namespace Sprites {
+
+  enum PixelFormat {
+    RGB24,
+    BGR24,
+    RGB565      // little endian, as written by e.g. ffmpeg -pix_fmt rgb565le
+  };
+  PixelFormat resolvePixelFormat(const std::string& str);
+  size_t bytesPerPixel(const PixelFormat format);
+
+  // Shows raw frames that another process writes to a pipe, a FIFO or a Unix
+  // stream socket ("-" reads stdin). A reader thread reads every frame
+  // directly into the back slot of a triple buffer and publishes it when it
+  // is complete; doStep() picks up the latest complete frame. Faster
+  // producers overwrite frames that were never shown, slower ones leave the
+  // last frame on the panel. The pixels are converted while drawing.
+  class LiveFeed : public CanvasObject {
+  public:
+    LiveFeed();
+    LiveFeed(const std::string source, size_t width, size_t height,
+             PixelFormat format = RGB24);
+    ~LiveFeed();
+
+    // Switches to another source, call it under the list's mutex
+    void setContent(const std::string& source);
+    const std::string& getContent() const;
+    const PixelFormat& getFormat() const;
+    size_t getFramesReceived() const;
+    size_t getFramesShown() const;
+
+    void doStep();
+    void draw(rgb_matrix::Canvas* canvas) const;
+
+  protected:
+    static const uint8_t FRESH_FRAME = 4;
+
+    void startReader();
+    void stopReader();
+    void readLoop(uint8_t back);
+    int openSource() const;
+
+    std::string source;
+    PixelFormat format;
+    size_t frame_size;
+    std::vector<uint8_t> buffers;   // three frames
+    std::atomic<uint8_t> middle;    // slot index | FRESH_FRAME
+    uint8_t front;
+    bool has_frame;
+    std::atomic<size_t> frames_received;
+    size_t frames_shown;
+
+    std::atomic<bool> reading;
+    std::thread reader_thread;
+  };
+
+} // end namespace Sprites
+
+#endif
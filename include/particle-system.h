@@ -0,0 +1,83 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "canvas.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+  // How new particles are born and how they age. Speeds and gravity are in
+  // pixels per frame, angles in degrees like CanvasObject::setDirection.
+  struct EmitterSettings {
+    EmitterSettings();
+    double rate;              // particles per frame, fractions accumulate
+    uint32_t min_lifetime;    // frames
+    uint32_t max_lifetime;
+    double min_speed;
+    double max_speed;
+    double direction;
+    double spread;            // particles leave within direction +- spread/2
+    double gravity_x;
+    double gravity_y;
+    double drag;              // velocity factor per frame
+    uint8_t start_color[3];
+    uint8_t end_color[3];     // reached at the end of the lifetime
+    double area_width;        // particles are born in this box at the
+    double area_height;       // position of the emitter
+  };
+
+  // Thousands of single-pixel particles in one CanvasObject. Particles live in
+  // preallocated arrays (one per attribute), dead ones are swapped with the
+  // last live one, and overlapping particles add up their colors in an
+  // accumulation buffer before it is drawn. Nothing is allocated after the
+  // constructor.
+  class ParticleSystem : public CanvasObject {
+  public:
+    ParticleSystem();
+    ParticleSystem(const std::string name, const size_t capacity = 4096);
+
+    void setContent(const std::string& name);
+    const std::string& getContent() const;
+
+    void setSettings(const EmitterSettings& settings);
+    const EmitterSettings& getSettings() const;
+    // Spawn n particles at once (e.g. confetti), as far as there is room
+    void burst(const size_t n);
+    size_t getCount() const;
+    size_t getCapacity() const;
+
+    void doStep();
+    void draw(rgb_matrix::Canvas* canvas) const;
+
+  private:
+    void spawn(size_t n);
+    void update();
+    uint32_t nextRandom();
+    float uniform(const float min, const float max);
+
+    std::string name;
+    EmitterSettings settings;
+    size_t capacity;
+    size_t count;
+    double spawn_debt;
+    uint32_t rng_state;
+    // structure of arrays, capacity entries each
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> age;       // 0 at birth, 1 at death
+    std::vector<float> aging;     // 1 / lifetime
+    // RGB sums per panel pixel, only the box around live particles is used;
+    // 32 bits, 16 bits overflowed with 257 white particles on one pixel
+    mutable std::vector<uint32_t> accumulator;
+  };
+
+} // end namespace Sprites
+
+#endif
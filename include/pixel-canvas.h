@@ -0,0 +1,42 @@
+#ifndef PIXEL_CANVAS_H
+#define PIXEL_CANVAS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "canvas.h"
+#include "sprite.h"
+
+namespace Sprites {
+
+  // A canvas that is not backed by the panel, but by packed RGB bytes in
+  // memory. Used to render frames off-hardware (e.g. when replaying traces).
+  class PixelCanvas : public rgb_matrix::Canvas {
+  public:
+    PixelCanvas(int width = 192, int height = 64);
+    ~PixelCanvas();
+
+    int width() const;
+    int height() const;
+    void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue);
+    void Clear();
+    void Fill(uint8_t red, uint8_t green, uint8_t blue);
+    // Mix the color over the pixel, alpha 255 replaces it
+    void blendPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue,
+                    uint8_t alpha);
+
+    const Pixel getPixel(int x, int y) const;
+    uint8_t* getData();
+    const uint8_t* getData() const;
+    size_t getSize() const;
+    void copyTo(rgb_matrix::Canvas* canvas) const;
+
+  private:
+    int canvas_width;
+    int canvas_height;
+    std::vector<uint8_t> data;
+  };
+
+} // end namespace Sprites
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <cstdint>
+
+#include "pixel-canvas.h"
+
+
+namespace led_loop {
+
+  // Global color effects over the finished frame. Fade (brightness), gamma,
+  // tint and invert are folded into one 256 entry lookup table per channel,
+  // and a second rendered layer can be blended over the frame with alpha.
+  // Fade and alpha can move to a target over a number of frames; the tables
+  // are only rebuilt when one of the values changed. The cost per frame does
+  // not depend on the number of objects on the panel.
+  class PostProcess {
+  public:
+    PostProcess();
+
+    void setFade(const double brightness, const uint32_t frames = 0);
+    double getFade() const;
+    void setGamma(const double gamma);
+    void setTint(const uint8_t red, const uint8_t green, const uint8_t blue);
+    void setInvert(const bool invert);
+    void setLayerAlpha(const double alpha, const uint32_t frames = 0);
+    double getLayerAlpha() const;
+
+    // Advance fade and alpha by one frame, call once per frame
+    void step();
+    // False if the frame would come out unchanged
+    bool isActive() const;
+    // frame = lut(frame * (1 - alpha) + layer * alpha), layer may be nullptr
+    void apply(Sprites::PixelCanvas* frame,
+               const Sprites::PixelCanvas* layer) const;
+
+  private:
+    // A value that moves linearly to its target
+    struct Ramp {
+      Ramp(const double value);
+      void set(const double target, const uint32_t frames);
+      bool advance();
+      double value;
+      double target;
+      double increment;
+      uint32_t frames_left;
+    };
+    void buildLUT();
+
+    Ramp fade;
+    Ramp alpha;
+    double gamma;
+    uint8_t tint[3];
+    bool invert;
+    bool identity;
+    bool lut_stale;
+    uint8_t lut[3][256];
+  };
+
+} // end namespace led_loop
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace Sprites {
+
+  // How a thread is scheduled (see sched(7)). The priority (1..99) only
+  // applies to SCHED_FIFO and SCHED_RR. Without cpus the thread may run on
+  // any CPU. Real-time policies, high priorities and mlockall need root or
+  // CAP_SYS_NICE / CAP_IPC_LOCK (rgbmatrix drops privileges after setup).
+  struct ThreadOptions {
+    ThreadOptions();
+    bool isRealtime() const;
+    int policy;
+    int priority;
+    std::vector<int> cpus;
+  };
+
+  // Apply to the calling thread. Failures are printed, the thread keeps
+  // running with what could be applied
+  bool applyThreadOptions(const ThreadOptions& options, const char* name);
+  // Options for the worker threads (video decoders, live feeds, prefetchers,
+  // the control server); they call configureWorkerThread when they start
+  void setWorkerThreadOptions(const ThreadOptions& options);
+  ThreadOptions getWorkerThreadOptions();
+  bool configureWorkerThread(const char* name);
+  // mlockall the current and future memory, so page faults cannot stall
+  // a frame
+  bool lockMemory();
+
+  // e.g. "SCHED_FIFO priority 50 on CPUs 2,3"
+  std::string describeThreadOptions(const ThreadOptions& options);
+  // "other", "fifo" or "rr", optionally followed by ":<priority>"
+  bool parseSchedPolicy(const std::string& str, ThreadOptions* options);
+  // e.g. "3" or "0,2-3"
+  bool parseCpuList(const std::string& str, std::vector<int>* cpus);
+
+  // The loop clock, in milliseconds of a steady clock: when the animation
+  // loop started the frame that is prepared on the calling thread, so every
+  // object of a frame sees the same time. Outside of a frame (e.g. when
+  // Python steps an object itself) it is the current time
+  int64_t getFrameMillis();
+  // Reads the clock once and makes it getFrameMillis() on this thread for
+  // its lifetime
+  class FrameClockScope {
+  public:
+    FrameClockScope();
+    ~FrameClockScope();
+  private:
+    int64_t previous;
+  };
+
+} // end namespace Sprites
+
+#endif
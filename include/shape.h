@@ -0,0 +1,116 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "canvas.h"
+#include "graphics.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+  enum ShapeKind {
+    SHAPE_LINE,             // from the first to the second point
+    SHAPE_RECT,             // fills the size
+    SHAPE_ROUNDED_RECT,
+    SHAPE_ELLIPSE,          // inscribed in the size
+    SHAPE_POLYGON           // the points, closed
+  };
+
+  // A vector shape that is filled scanline by scanline straight into the
+  // canvas, so animating its size, radius or points only changes numbers.
+  // The outline is kept as fixed point edges (1/256 pixel) relative to the
+  // position and only rebuilt when a parameter or the flips / quarter turns
+  // change; curves are flattened to segments. Filling uses the nonzero
+  // winding rule at pixel centers, or with antialiasing 4 sub-scanlines and
+  // exact horizontal coverage. Points of lines and polygons are relative to
+  // the position, a line's points are pixel centers.
+  class Shape : public CanvasObject {
+  public:
+    Shape();
+    Shape(const std::string name, const ShapeKind kind = SHAPE_RECT);
+
+    void setContent(const std::string& name);
+    const std::string& getContent() const;
+
+    void setKind(const ShapeKind kind);
+    ShapeKind getKind() const;
+    // The box of rectangles and ellipses
+    void setSize(const double width, const double height);
+    double getSizeX() const;
+    double getSizeY() const;
+    void setPoints(const Points& points);
+    const Points& getPoints() const;
+    // Corner radius of SHAPE_ROUNDED_RECT
+    void setRadius(const double radius);
+    double getRadius() const;
+    // 0 fills the shape, otherwise only an outline of this width is drawn
+    // (the thickness of a line, which is at least 1)
+    void setLineWidth(const double line_width);
+    double getLineWidth() const;
+    void setColor(const uint8_t r, const uint8_t g, const uint8_t b);
+    const rgb_matrix::Color& getColor() const;
+    void setAntialias(const bool antialias);
+    bool getAntialias() const;
+
+    void doStep();
+    void draw(rgb_matrix::Canvas* canvas) const;
+
+  private:
+    // x at y_top and dx/dy are 16.16, the ys 24.8 fixed point
+    struct Edge {
+      int32_t y_top;
+      int32_t y_bottom;
+      int64_t x_top;
+      int64_t slope;
+      int winding;
+    };
+    struct Crossing {
+      int32_t x;
+      int winding;
+    };
+
+    void invalidate();
+    bool isStale() const;
+    void rebuild() const;
+    void addContour(const Points& contour, const bool reverse) const;
+    void addRect(const double x0, const double y0, const double x1,
+                 const double y1, const double radius, const bool reverse) const;
+    void addEllipse(const double cx, const double cy, const double rx,
+                    const double ry, const bool reverse) const;
+    void addSegment(const Point& a, const Point& b, const double width) const;
+    // The box before flips and quarter turns
+    Point getBox() const;
+    Point transform(const Point& p) const;
+
+    std::string name;
+    ShapeKind kind;
+    double size_x;
+    double size_y;
+    Points points;
+    double radius;
+    double line_width;
+    rgb_matrix::Color color;
+    bool antialias;
+    // outline cache, reused between rebuilds
+    mutable bool dirty;
+    mutable bool built_flip_x;
+    mutable bool built_flip_y;
+    mutable int built_quarter_turns;
+    mutable Point box;
+    mutable std::vector<Edge> edges;       // sorted by y_top
+    mutable int32_t min_x;                 // bounds of the edges, 24.8
+    mutable int32_t min_y;
+    mutable int32_t max_x;
+    mutable int32_t max_y;
+    mutable Points contour;
+    mutable std::vector<Crossing> crossings;
+    mutable std::vector<uint16_t> coverage;
+  };
+
+} // end namespace Sprites
+
+#endif
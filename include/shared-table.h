@@ -0,0 +1,127 @@
+#ifndef SHARED_TABLE_H
+#define SHARED_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sprite.h"
+
+
+namespace led_loop {
+
+  // A POSIX shared memory object (/dev/shm/<name>) with a SharedTableHeader
+  // followed by capacity SharedEntry slots. The daemon binds one slot to each
+  // canvas object (used, generation, id); external processes look the slot up
+  // by ID and write the parameters under a sequence lock:
+  //   sequence += 1 (odd), write values, bump writes[field], sequence += 1
+  // Once per frame the AnimationLoop copies every slot whose sequence changed
+  // and applies the fields whose write counter moved. No syscalls on either
+  // side. There must only be one writer per slot at a time.
+  struct SharedTableHeader {
+    char magic[4];            // "SSST"
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t capacity;
+    std::atomic<uint32_t> frame;   // bumped by the daemon every frame
+    uint8_t reserved[48];
+  };
+
+  enum SharedField {
+    SHARED_POSITION,
+    SHARED_SPEED,
+    SHARED_DIRECTION,
+    SHARED_VISIBLE,
+    SHARED_Z,
+    N_SHARED_FIELDS
+  };
+
+  struct SharedEntry {
+    // written by the daemon
+    std::atomic<uint32_t> used;
+    std::atomic<uint32_t> generation;   // bumped when the slot is rebound
+    char id[56];
+    // written by clients
+    std::atomic<uint32_t> sequence;
+    uint8_t writes[8];        // per SharedField write counters
+    double x;
+    double y;
+    double speed;
+    double direction;
+    int32_t visible;
+    int32_t z;
+    uint8_t reserved[8];
+  };
+
+  static_assert(sizeof(SharedTableHeader) == 64, "Shared table layout changed");
+  static_assert(sizeof(SharedEntry) == 128, "Shared table layout changed");
+
+  // Daemon side, owned by the AnimationLoop
+  class SharedTable {
+  public:
+    SharedTable();
+    ~SharedTable();
+
+    bool create(const std::string& name, const uint32_t capacity);
+    void close();
+    bool isOpen() const;
+
+    // Binds slots to new objects, frees the slots of removed objects and
+    // applies everything clients wrote since the last call. The caller holds
+    // the data mutex.
+    void sync(Sprites::CanvasObjectList* canvas_objects);
+
+  private:
+    void bind(const uint32_t slot, const Sprites::CanvasObjectID& id);
+    void unbind(const uint32_t slot);
+    void apply(const uint32_t slot, Sprites::CanvasObject* cvo);
+
+    std::string name;
+    SharedTableHeader* header;
+    SharedEntry* entries;
+    size_t size;
+    std::map<Sprites::CanvasObjectID, uint32_t> slots;
+    std::vector<uint32_t> free_slots;
+    std::vector<uint32_t> last_sequence;
+    std::vector<uint8_t> last_writes;     // 8 counters per slot
+    std::vector<uint32_t> seen_in_frame;
+    uint32_t frame;
+  };
+
+  // Client side for other C++ processes, see also bindings/shared_table.py
+  class SharedTableClient {
+  public:
+    SharedTableClient();
+    ~SharedTableClient();
+
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const;
+
+    bool setPosition(const Sprites::CanvasObjectID& id, const Sprites::Point& p);
+    bool setSpeed(const Sprites::CanvasObjectID& id, const double speed);
+    bool setDirection(const Sprites::CanvasObjectID& id, const double direction);
+    bool setVisible(const Sprites::CanvasObjectID& id, const bool visible);
+    bool setZ(const Sprites::CanvasObjectID& id, const int z);
+
+  private:
+    SharedEntry* find(const Sprites::CanvasObjectID& id);
+    template <typename Write>
+    bool write(const Sprites::CanvasObjectID& id, const SharedField field,
+               Write write_value);
+
+    SharedTableHeader* header;
+    SharedEntry* entries;
+    size_t size;
+    struct CachedSlot {
+      uint32_t slot;
+      uint32_t generation;
+    };
+    std::map<Sprites::CanvasObjectID, CachedSlot> cache;
+  };
+
+} // end namespace led_loop
+
+#endif
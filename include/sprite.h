@@ -2,6 +2,8 @@
 #define SPRITE_H
 
 #include <vector>
+#include <mutex>
+#include <cstdint>
 #include <cstring>
 
 #include <Magick++.h>
@@ -20,6 +22,15 @@ namespace Sprites {
     STOP,
     DISAPPEAR
   };
+  // What happened to an object during its last doStep, as bit flags. Edges
+  // and the screen only apply to objects outside of a Group
+  enum ObjectEvent {
+    GOAL_REACHED = 1,     // the steps of reachPosition ran out
+    EDGE_HIT = 2,         // bounced (BOUNCE) or stopped (STOP) at an edge
+    LEFT_SCREEN = 4,
+    ENTERED_SCREEN = 8,
+    ALL_OBJECT_EVENTS = 15
+  };
   struct PanelSize {
     PanelSize(size_t x = 192, size_t y = 64);
     size_t x;
@@ -52,21 +63,26 @@ namespace Sprites {
   // typedef std::string SpriteID;
   typedef std::string CanvasObjectID;
 
+  class Timeline;
+  class Group;
+  class PixelCanvas;
+
   class CanvasObject {
   public:
     CanvasObject();
     CanvasObject(const std::string source);
     virtual ~CanvasObject();
 
-    virtual void setID(CanvasObjectID);
+    virtual void setID(const CanvasObjectID& id);
     virtual const CanvasObjectID& getID() const;
     virtual void setVisible(bool visible);
     virtual bool getVisible() const;
+    bool getVisibleSetting() const;
     // virtual bool getWrapped() const;
     virtual void setEdgeBehavior(const EdgeBehavior edge_behavior);
     virtual const EdgeBehavior& getEdgeBehavior() const;
 
-    virtual void setContent(const std::string filename); // = 0;
+    virtual void setContent(const std::string& filename); // = 0;
     virtual const std::string& getContent() const; // = 0;
     virtual void setWidth(int width); // = 0;
     virtual size_t getWidth() const;
@@ -74,17 +90,60 @@ namespace Sprites {
     virtual size_t getHeight() const;
 
     virtual void doStep();
-    virtual void draw(rgb_matrix::FrameCanvas* canvas) const; // = 0;
+    // ObjectEvent flags of the last doStep
+    uint8_t getStepEvents() const;
+    virtual void draw(rgb_matrix::Canvas* canvas) const; // = 0;
 
     virtual void setPosition(const Point p);
     virtual void reachPosition(const Point p, const uint steps);
+    const Point& getPositionGoal() const;
+    int getGoalSteps() const;
     virtual const Point& getPosition() const;
     virtual void setDirection(const double ang);
     virtual const double& getDirection() const;
     virtual void setSpeed(const double speed);
     virtual const double& getSpeed() const;
+    // Objects with a higher z are drawn on top, equal z in ID order
+    void setZ(const int z);
+    int getZ() const;
+    // Takes ownership, the timeline is stepped at the end of doStep. Call
+    // Timeline::prepare first, or a Sprite's rotation and scale steps are
+    // rendered while the animation plays
+    void setTimeline(Timeline* timeline);
+    Timeline* getTimeline() const;
+
+    // Inside a Group the position is relative to the group. The position on
+    // the panel is cached until the object or one of its ancestors moves.
+    Group* getParent() const;
+    const Point& getWorldPosition() const;
+    virtual void invalidateWorldPosition();
+
+    // Render attributes, applied while drawing without touching the source
+    // pixels (Sprite and Text apply them). The tint multiplies the channels,
+    // opacity darkens the object on the panel and blends it over what is
+    // below on a PixelCanvas. Flips and clockwise quarter turns happen in
+    // the object's box, which keeps its top left corner.
+    void setOpacity(const double opacity);
+    double getOpacity() const;
+    void setTint(const uint8_t r, const uint8_t g, const uint8_t b);
+    const rgb_matrix::Color& getTint() const;
+    void setFlip(const bool horizontal, const bool vertical);
+    bool getFlipX() const;
+    bool getFlipY() const;
+    void setQuarterTurns(const int quarter_turns);
+    int getQuarterTurns() const;
+    bool hasRenderAttributes() const;
+
+    // Objects created by commands belong to the list they are in (see
+    // led_loop::applyCommand), all others to whoever added them, e.g. a
+    // Python wrapper. A list only deletes the objects it owns
+    void setOwnedByList(const bool owned);
+    bool isOwnedByList() const;
+    // Unique per process, tells apart objects allocated at the same address
+    uint64_t getSerial() const;
 
   protected:
+    friend class Group;
     Point wrap_edge(double x, double y);
 
     CanvasObjectID id;
@@ -101,22 +160,80 @@ namespace Sprites {
     bool visible;
     bool out_of_bounds;
     bool wrapped;
+    uint8_t step_events;
 
     Point position;
     double direction;
     double speed;
     Point position_goal;
     int goal_steps;
+    int z;
+    Timeline* timeline;
+    Group* parent;
+    mutable Point world_position;
+    mutable bool world_dirty;
+    uint8_t opacity;
+    rgb_matrix::Color tint;
+    bool flip_x;
+    bool flip_y;
+    int quarter_turns;
+    bool owned_by_list;
+    uint64_t serial;
   };
 
 
+  // Applies the render attributes of an object to what is drawn through it.
+  // Maps a pixel of the box (box_x, box_y, box_width, box_height) on the
+  // canvas through the flips and turns; SetPixel takes canvas coordinates
+  // for objects that draw through library code (e.g. Text), blit loops map
+  // themselves and call put.
+  class RenderCanvas : public rgb_matrix::Canvas {
+  public:
+    RenderCanvas(rgb_matrix::Canvas* target, const CanvasObject& object,
+                 const int box_x, const int box_y, const int box_width,
+                 const int box_height);
+
+    int mapX(const int x, const int y) const {
+      return this->origin_x + x * this->x_step.x + y * this->y_step.x;
+    }
+    int mapY(const int x, const int y) const {
+      return this->origin_y + x * this->x_step.y + y * this->y_step.y;
+    }
+    // Tint and opacity, at canvas coordinates
+    void put(const int x, const int y, uint8_t red, uint8_t green, uint8_t blue);
+
+    int width() const;
+    int height() const;
+    void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue);
+    void Clear();
+    void Fill(uint8_t red, uint8_t green, uint8_t blue);
+
+  private:
+    struct Step { int x; int y; };
+
+    rgb_matrix::Canvas* target;
+    PixelCanvas* memory;        // the target if it can blend
+    const int box_x;
+    const int box_y;
+    int origin_x;
+    int origin_y;
+    Step x_step;
+    Step y_step;
+    const rgb_matrix::Color tint;
+    const uint8_t opacity;
+  };
+
+
+  struct PackedImage;
+
   class Sprite : public CanvasObject {
   public:
     Sprite();
     Sprite(const std::string filename);
     ~Sprite();
 
-    void setContent(const std::string filename, size_t index = 0);
+    void setContent(const std::string& filename);
+    void setContent(const PackedImage& packed);
     const std::string& getContent() const;
     void setWidth(int width);
     size_t getWidth() const;
@@ -130,12 +247,37 @@ namespace Sprites {
     void setPixel(const size_t x, const size_t y, const char r, const char g, const char b);
     void setPixel(const Point point, const Pixel pixel);
     const Pixel getPixel(const size_t x, const size_t y) const;
-    const Points getOverlap(const Sprite*) const;
-    void draw(rgb_matrix::FrameCanvas* canvas) const;
+    void setPixels(const uint8_t* rgb, const size_t width, const size_t height,
+                   const uint8_t* opacity = nullptr);
+    uint8_t* getPixelData();
+    // The current image as Magick image and replacing it with an already
+    // transformed one (resize factor and rotation describe the result)
+    const Magick::Image& getImage();
+    void setImage(const Magick::Image& image, const double resize_factor,
+                  const double rotation);
+    // The same with packed pixels, which are copied without involving Magick
+    void setImage(const PackedImage& packed, const double resize_factor,
+                  const double rotation);
+    // Fills points (cleared first), so a caller can reuse its vector
+    void getOverlap(const Sprite* other, Points* points) const;
+    void draw(rgb_matrix::Canvas* canvas) const;
 
   protected:
+    void updatePixels();
+    void updateImage();
+    void ownPixels();
+    void drawAttributed(rgb_matrix::Canvas* canvas, const int x0,
+                        const int y0) const;
+
     std::string filename;
     Magick::Image img;
+    // What is drawn: packed RGB and one opacity byte per pixel. They point
+    // into the buffers below or into an AssetPack.
+    const uint8_t* pixels;
+    const uint8_t* mask;
+    std::vector<uint8_t> pixel_buffer;
+    std::vector<uint8_t> mask_buffer;
+    bool image_stale;
     double resize_factor;
     double rotation;
   };
@@ -147,30 +289,54 @@ namespace Sprites {
     Text(const std::string fontfilename, const std::string content = "");
     ~Text();
 
-    void setContent(const std::string filename);
+    void setContent(const std::string& content);
     const std::string& getContent() const;
     // void setWidth(int width);   // not implemented
     // void setHeight(int height); // not implemented
 
-    void setFont(std::string content);
+    void setFont(const std::string& fontfilename);
     const std::string& getFont() const;
     void setKerning(const float kerning);
     const int& getKerning() const;
-    void draw(rgb_matrix::FrameCanvas* canvas) const;
+    void setColor(const uint8_t r, const uint8_t g, const uint8_t b);
+    const rgb_matrix::Color& getColor() const;
+    void draw(rgb_matrix::Canvas* canvas) const;
 
   protected:
-    void loadFont(const std::string fontfilename);
+    void loadFont(const std::string& fontfilename);
+    void updateTextWidth();
 
     rgb_matrix::Font font;
     rgb_matrix::Color color;
     std::string fontfilename;
     std::string text;
     int kerning;
+    int text_width;
   };
 
   typedef std::map<CanvasObjectID, CanvasObject*> CanvasObjectList;
   typedef CanvasObjectList::iterator CanvasObjectListIterator;
 
+  // Stable sort by z (see CanvasObject::setZ). It takes its scratch space
+  // from the current FrameArena, so drawing does not allocate
+  void sortByZ(std::vector<CanvasObject*>* objects);
+
+  // Bulk updates: ids[i] gets values[i]. All of them are applied while holding
+  // data_mutex (if given), so the animation loop shows them in the same frame.
+  // Unknown IDs are skipped, the number of updated objects is returned.
+  size_t setPositions(CanvasObjectList* cvos,
+                      const std::vector<CanvasObjectID>& ids,
+                      const std::vector<Point>& positions,
+                      std::mutex* data_mutex = nullptr);
+  size_t setSpeeds(CanvasObjectList* cvos,
+                   const std::vector<CanvasObjectID>& ids,
+                   const std::vector<double>& speeds,
+                   std::mutex* data_mutex = nullptr);
+  size_t setVisibilities(CanvasObjectList* cvos,
+                         const std::vector<CanvasObjectID>& ids,
+                         const std::vector<bool>& visibilities,
+                         std::mutex* data_mutex = nullptr);
+
 } // end namespace Sprites
 
 #endif
@@ -0,0 +1,105 @@
+#ifndef TILE_MAP_H
+#define TILE_MAP_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "canvas.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+  // A sprite sheet cut into equally sized tiles, numbered left to right and
+  // top to bottom. Atlases are decoded once (or taken from an AssetPack) and
+  // shared by all TileMaps that use the same file and tile size.
+  class TileAtlas {
+  public:
+    TileAtlas();
+
+    bool load(const std::string& filename, const size_t tile_width,
+              const size_t tile_height);
+    const std::string& getFilename() const;
+    size_t getTileWidth() const;
+    size_t getTileHeight() const;
+    size_t getTileCount() const;
+    // Start of the first row of the tile, rows are getStride() pixels apart
+    const uint8_t* getTilePixels(const size_t index) const;
+    const uint8_t* getTileMask(const size_t index) const;
+    size_t getStride() const;
+
+    // nullptr if the file cannot be read
+    static std::shared_ptr<const TileAtlas> get(const std::string& filename,
+                                                const size_t tile_width,
+                                                const size_t tile_height);
+
+  private:
+    std::string filename;
+    size_t tile_width;
+    size_t tile_height;
+    size_t columns;
+    size_t rows;
+    size_t image_width;
+    // packed RGB and one opacity byte per pixel, pointing into the buffers
+    // or into an AssetPack
+    const uint8_t* pixels;
+    const uint8_t* mask;
+    std::vector<uint8_t> pixel_buffer;
+    std::vector<uint8_t> mask_buffer;
+  };
+
+  // A grid of tile indices drawn from a TileAtlas. The object shows a window
+  // (the viewport, by default the panel) into the map, starting at the scroll
+  // offset; only the tiles inside it are drawn. Changing a tile only writes
+  // its index.
+  class TileMap : public CanvasObject {
+  public:
+    static const int32_t EMPTY_TILE = -1;
+
+    TileMap();
+    TileMap(const std::string atlas_filename, const size_t tile_width,
+            const size_t tile_height, const size_t columns, const size_t rows);
+
+    // The atlas file, with the tile size given before
+    void setContent(const std::string& atlas_filename);
+    const std::string& getContent() const;
+    void setTileSize(const size_t tile_width, const size_t tile_height);
+    size_t getTileCount() const;
+
+    // Reallocates the tiles, so a map that is drawn is only resized under
+    // the loop's data mutex (like all tile changes)
+    void setMapSize(const size_t columns, const size_t rows);
+    size_t getColumns() const;
+    size_t getRows() const;
+    void setTile(const size_t column, const size_t row, const int32_t index);
+    int32_t getTile(const size_t column, const size_t row) const;
+    // Row major, missing ones become EMPTY_TILE
+    void setTiles(const std::vector<int32_t>& indices);
+    void fill(const int32_t index);
+
+    void setScroll(const Point& offset);
+    const Point& getScroll() const;
+    void setViewport(const size_t width, const size_t height);
+    // Repeat the map endlessly when scrolling past its edges
+    void setWrapScroll(const bool wrap_scroll);
+    bool getWrapScroll() const;
+
+    void draw(rgb_matrix::Canvas* canvas) const;
+
+  private:
+    std::string atlas_filename;
+    size_t tile_width;
+    size_t tile_height;
+    std::shared_ptr<const TileAtlas> atlas;
+    size_t columns;
+    size_t rows;
+    std::vector<int32_t> tiles;
+    Point scroll;
+    bool wrap_scroll;
+  };
+
+} // end namespace Sprites
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Magick++.h>
+
+#include "sprite.h"
+
+
+namespace Sprites {
+
+  enum Easing {
+    LINEAR,
+    STEP,           // jump at the end of the segment
+    EASE_IN,        // quadratic
+    EASE_OUT,
+    EASE_IN_OUT,
+    CUBIC_IN,
+    CUBIC_OUT,
+    CUBIC_IN_OUT,
+    SINE_IN_OUT,
+    BACK_OUT,       // overshoots a little
+    BOUNCE_OUT
+  };
+  Easing resolveEasing(const std::string& str);
+  // Maps t in [0, 1] to the eased progress
+  double ease(const Easing easing, const double t);
+
+  enum TimelineProperty {
+    TIMELINE_POSITION,    // x, y
+    TIMELINE_VISIBLE,     // 0 or 1, never interpolated
+    TIMELINE_ROTATION,    // degrees on top of the sprite's rotation
+    TIMELINE_SCALE,       // factor on top of the sprite's size
+    TIMELINE_COLOR,       // r, g, b (Text only)
+    N_TIMELINE_PROPERTIES
+  };
+  TimelineProperty resolveTimelineProperty(const std::string& str);
+
+  // The value of a property at a frame (counted from the start of the
+  // timeline). The easing shapes the segment from the previous keyframe.
+  struct Keyframe {
+    Keyframe(const uint32_t frame = 0, const Easing easing = LINEAR,
+             const double v0 = 0, const double v1 = 0, const double v2 = 0);
+    uint32_t frame;
+    Easing easing;
+    double value[3];
+  };
+
+  // Keyframe tracks for one object, evaluated frame-exact in doStep. A track
+  // only controls its property between its first and its last keyframe, so
+  // e.g. the speed can take over after a position track ends.
+  // Every object needs its own copy (see CanvasObject::setTimeline).
+  class Timeline {
+  public:
+    Timeline();
+
+    void addKeyframe(const TimelineProperty property, const Keyframe& key);
+    // Frames to wait before the first frame of the timeline
+    void setDelay(const uint32_t frames);
+    // How often the timeline starts over after playing once, -1 forever.
+    // A repeating timeline jumps from frame length - 1 back to 0, so the
+    // last keyframe (at frame length) is only reached at the end of the
+    // final run and never when repeating forever; a seamless loop ends on
+    // the values it starts with.
+    void setRepeat(const int repeat);
+    void reset();
+
+    uint32_t getLength() const;
+    uint32_t getFrame() const;
+    bool isFinished() const;
+
+    // Renders every rotation and scale step the tracks reach from the
+    // object's current image if it is a Sprite, so that playing them only
+    // copies pixels. The steps are quantized (see stepKey) and take one
+    // image each, at most length + 1 of them. prepare does both parts;
+    // captureBase is cheap but reads the object, so it runs under the data
+    // mutex of a drawn object, while the slow prerender touches no object
+    // and should run without it, before the timeline is handed over.
+    void captureBase(CanvasObject* cvo);
+    void prerender();
+    void prepare(CanvasObject* cvo);
+    // Applies the tracks at the current frame and advances by one frame
+    void step(CanvasObject* cvo);
+
+  private:
+    struct Track {
+      Track();
+      std::vector<Keyframe> keys;
+      size_t cursor;
+      double applied[3];
+    };
+    // A pre-rendered rotation and scale, packed like a Sprite's pixels
+    struct RenderedStep {
+      size_t width;
+      size_t height;
+      std::vector<uint8_t> pixels;
+      std::vector<uint8_t> mask;
+    };
+    typedef std::pair<long, long> StepKey;
+    bool evaluate(Track* track, const uint32_t frame, double* value) const;
+    static StepKey stepKey(const double rotation, const double scale);
+    const RenderedStep& renderStep(const double rotation, const double scale);
+    void transformSprite(Sprite* sprite);
+
+    Track tracks[N_TIMELINE_PROPERTIES];
+    uint32_t length;
+    uint32_t delay;
+    int repeat;
+    uint32_t delay_left;
+    int repeats_left;
+    uint32_t frame;
+    bool finished;
+    // Rotation and scale are always rendered from the image the sprite had
+    // when the timeline was prepared, so they do not blur over time
+    Magick::Image base_image;
+    bool has_base_image;
+    std::map<StepKey, RenderedStep> steps;
+    double base_resize;
+    double base_rotation;
+    double scale;
+    double rotation;
+  };
+
+} // end namespace Sprites
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+
+namespace Sprites {
+
+  // Timeline of what every thread spent its time on, for finding hitches.
+  // Scoped events go into a ring of RING_SIZE events per thread (allocated
+  // when the thread records its first event, and reused by a later thread
+  // once it exited) and are written on demand as
+  // Chrome trace-event JSON, which chrome://tracing and Perfetto can open.
+  // While tracing is off, an event costs one relaxed atomic load.
+  // Names and categories must be string literals, only the pointer is kept.
+  class TraceEvents {
+  public:
+    static const size_t RING_SIZE = 1 << 14;
+
+    static void setEnabled(const bool enabled);
+    static bool isEnabled() {
+      return enabled.load(std::memory_order_relaxed);
+    }
+    // Name of the calling thread in the trace
+    static void setThreadName(const char* name);
+    // Write the last RING_SIZE events of every thread
+    static bool flush(const std::string& filename);
+    static void clear();
+
+    // 0 while tracing is off
+    static uint64_t begin();
+    static void end(const char* name, const char* category, const uint64_t start_us);
+
+  private:
+    static std::atomic<bool> enabled;
+  };
+
+  // Records the time from construction to destruction
+  class ScopedTrace {
+  public:
+    ScopedTrace(const char* name, const char* category = "frame") :
+        name(name), category(category), start_us(TraceEvents::begin()) { }
+    ~ScopedTrace() {
+      if (this->start_us != 0) {
+        TraceEvents::end(this->name, this->category, this->start_us);
+      }
+    }
+  private:
+    const char* name;
+    const char* category;
+    const uint64_t start_us;
+  };
+
+  // Lock the mutex and record the time spent waiting if it was contended
+  void lockTraced(std::mutex* mutex, const char* name);
+
+} // end namespace Sprites
+
+#endif
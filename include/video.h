@@ -0,0 +1,76 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "canvas.h"
+#include "sprite.h"
+
+namespace Sprites {
+
+  // Plays a video file. A background thread lets ffmpeg decode and scale the
+  // file to the object's size and reads the raw frames straight into a ring
+  // of RING_SIZE preallocated frame buffers. doStep() presents the newest
+  // frame that is due and drops the ones it is late for; it never waits for
+  // the decoder, and the decoder waits when the ring is full.
+  class Video : public CanvasObject {
+  public:
+    static const size_t RING_SIZE = 8;
+
+    Video();
+    Video(const std::string filename, size_t width = 192, size_t height = 64);
+    ~Video();
+
+    void setContent(const std::string& filename);
+    const std::string& getContent() const;
+    void setWidth(int width);
+    void setHeight(int height);
+    void setFrameRate(double fps);
+    const double& getFrameRate() const;
+    void setLoop(bool loop);
+    bool getLoop() const;
+    size_t getDroppedFrames() const;
+
+    void doStep();
+    void draw(rgb_matrix::Canvas* canvas) const;
+
+  protected:
+    void startDecoder();
+    void stopDecoder();
+    void decodeLoop();
+    pid_t spawnDecoder(int* fd) const;
+    bool readFrame(int fd, uint8_t* buffer) const;
+
+    std::string filename;
+    double fps;
+    bool loop;
+
+    size_t frame_size;
+    std::vector<uint8_t> ring;
+    int64_t timestamps[RING_SIZE];
+    std::atomic<uint64_t> frames_written;
+    std::atomic<uint64_t> frames_read;
+    std::atomic<size_t> dropped_frames;
+    int64_t start_ms;
+    const uint8_t* current_frame;
+
+    mutable std::mutex ring_mutex;
+    std::mutex wait_mutex;
+    std::condition_variable space_available;
+    std::atomic<bool> decoding;
+    std::thread decoder_thread;
+    std::mutex pid_mutex;
+    pid_t decoder_pid;              // -1 while no ffmpeg runs
+  };
+
+} // end namespace Sprites
+
+#endif
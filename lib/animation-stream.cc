@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "animation-stream.h"
+#include "canvas.h"
+#include "sprite.h"
+
+
+namespace {
+
+const char STREAM_MAGIC[4] = {'S', 'S', 'A', 'S'};
+const uint16_t STREAM_VERSION = 1;
+// runs closer than this are merged, as a new run costs 8 bytes
+const size_t MAX_RUN_GAP = 2;
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+StreamHeader::StreamHeader() : version(STREAM_VERSION), reserved(0), width(0),
+                               height(0), frame_count(0), frame_time_ms(0),
+                               index_offset(0) {
+  std::memcpy(this->magic, STREAM_MAGIC, sizeof(this->magic));
+}
+
+
+AnimationStreamWriter::AnimationStreamWriter() : file(nullptr) { }
+AnimationStreamWriter::~AnimationStreamWriter() { this->close(); }
+
+bool AnimationStreamWriter::open(const std::string& filename, size_t width,
+                                 size_t height, uint32_t frame_time_ms) {
+  this->close();
+  this->file = fopen(filename.c_str(), "wb");
+  if (this->file == nullptr) {
+    fprintf(stderr, "Cannot open '%s' for writing\n", filename.c_str());
+    return false;
+  }
+  this->header = StreamHeader();
+  this->header.width = width;
+  this->header.height = height;
+  this->header.frame_time_ms = frame_time_ms;
+  fwrite(&this->header, sizeof(this->header), 1, this->file);
+  this->first_frame.clear();
+  this->last_frame.assign(width * height * 3, 0);
+  this->index.clear();
+  return true;
+}
+
+void AnimationStreamWriter::addFrame(const uint8_t* rgb) {
+  if (this->file == nullptr) return;
+  this->writeDelta(this->last_frame.data(), rgb);
+  std::memcpy(this->last_frame.data(), rgb, this->last_frame.size());
+  if (this->first_frame.empty()) this->first_frame = this->last_frame;
+  ++this->header.frame_count;
+}
+
+bool AnimationStreamWriter::close() {
+  if (this->file == nullptr) return false;
+  bool ok = this->header.frame_count > 0;
+  if (ok) {
+    this->writeDelta(this->last_frame.data(), this->first_frame.data());
+    this->index.push_back(ftell(this->file));
+    // align the index, readers on 32 bit ARM fault on unaligned 64 bit loads
+    const uint64_t padding = 0;
+    fwrite(&padding, 1, (8 - ftell(this->file) % 8) % 8, this->file);
+    this->header.index_offset = ftell(this->file);
+    fwrite(this->index.data(), sizeof(uint64_t), this->index.size(), this->file);
+    fseek(this->file, 0, SEEK_SET);
+    fwrite(&this->header, sizeof(this->header), 1, this->file);
+  }
+  ok = (fclose(this->file) == 0) && ok;
+  this->file = nullptr;
+  return ok;
+}
+
+void AnimationStreamWriter::writeDelta(const uint8_t* from, const uint8_t* to) {
+  this->index.push_back(ftell(this->file));
+  const uint32_t n_pixels = this->header.width * this->header.height;
+  uint32_t position = 0;
+  uint32_t pixel = 0;
+  while (pixel < n_pixels) {
+    if (std::memcmp(from + pixel * 3, to + pixel * 3, 3) == 0) {
+      ++pixel;
+      continue;
+    }
+    // extend the run as long as the gaps of unchanged pixels stay small
+    uint32_t run_end = pixel + 1;
+    uint32_t gap = 0;
+    for (uint32_t i = run_end; i < n_pixels && gap <= MAX_RUN_GAP; ++i) {
+      if (std::memcmp(from + i * 3, to + i * 3, 3) == 0) {
+        ++gap;
+      } else {
+        gap = 0;
+        run_end = i + 1;
+      }
+    }
+    const uint32_t skip = pixel - position;
+    const uint32_t count = run_end - pixel;
+    fwrite(&skip, sizeof(skip), 1, this->file);
+    fwrite(&count, sizeof(count), 1, this->file);
+    fwrite(to + pixel * 3, 3, count, this->file);
+    position = pixel = run_end;
+  }
+}
+
+
+
+AnimationStream::AnimationStream() : CanvasObject::CanvasObject(), filename(""),
+                                     data(nullptr), data_size(0), header(nullptr),
+                                     index(nullptr), next_frame(0) { }
+AnimationStream::AnimationStream(const std::string filename) : AnimationStream() {
+  this->setContent(filename);
+}
+AnimationStream::~AnimationStream() {
+  this->unmap();
+}
+
+void AnimationStream::setContent(const std::string& filename) {
+  this->unmap();
+  this->filename = filename;
+  int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(StreamHeader)) {
+    fprintf(stderr, "Cannot open animation stream '%s'\n", filename.c_str());
+    if (fd >= 0) close(fd);
+    return;
+  }
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    fprintf(stderr, "Cannot map animation stream '%s'\n", filename.c_str());
+    return;
+  }
+  this->data = static_cast<const uint8_t*>(mapped);
+  this->data_size = st.st_size;
+  const StreamHeader* header = reinterpret_cast<const StreamHeader*>(this->data);
+  const uint64_t index_size = (header->frame_count + 2) * sizeof(uint64_t);
+  if (std::memcmp(header->magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0
+      || header->version != STREAM_VERSION || header->frame_count == 0
+      || header->index_offset + index_size > this->data_size) {
+    fprintf(stderr, "'%s' is not an animation stream\n", filename.c_str());
+    this->unmap();
+    return;
+  }
+  madvise(mapped, this->data_size, MADV_WILLNEED);
+  this->header = header;
+  this->index = this->data + header->index_offset;
+  this->width = header->width;
+  this->height = header->height;
+  this->frame.assign(this->width * this->height * 3, 0);
+  this->next_frame = 0;
+}
+const std::string& AnimationStream::getContent() const {
+  return this->filename;
+}
+uint32_t AnimationStream::getFrameCount() const {
+  return this->header != nullptr ? this->header->frame_count : 0;
+}
+uint32_t AnimationStream::getFrameTime() const {
+  return this->header != nullptr ? this->header->frame_time_ms : 0;
+}
+
+void AnimationStream::unmap() {
+  if (this->data != nullptr) munmap((void*) this->data, this->data_size);
+  this->data = nullptr;
+  this->data_size = 0;
+  this->header = nullptr;
+  this->index = nullptr;
+}
+
+uint64_t AnimationStream::getDeltaOffset(const uint32_t delta) const {
+  uint64_t offset;
+  std::memcpy(&offset, this->index + delta * sizeof(uint64_t), sizeof(offset));
+  return offset;
+}
+
+void AnimationStream::applyDelta(const uint32_t delta) {
+  const uint8_t* ptr = this->data + this->getDeltaOffset(delta);
+  const uint8_t* end = this->data + std::min<uint64_t>(this->getDeltaOffset(delta + 1),
+                                                        this->data_size);
+  const size_t n_pixels = this->width * this->height;
+  size_t position = 0;
+  while (ptr + 2 * sizeof(uint32_t) <= end) {
+    uint32_t skip;
+    uint32_t count;
+    std::memcpy(&skip, ptr, sizeof(skip));
+    std::memcpy(&count, ptr + sizeof(skip), sizeof(count));
+    ptr += 2 * sizeof(uint32_t);
+    position += skip;
+    if (position + count > n_pixels || ptr + count * 3 > end) return;
+    std::memcpy(&this->frame[position * 3], ptr, count * 3);
+    ptr += count * 3;
+    position += count;
+  }
+}
+
+// One delta per frame; after the last frame comes the delta back to the first
+void AnimationStream::doStep() {
+  CanvasObject::doStep();
+  if (this->header == nullptr) return;
+  const uint32_t n_frames = this->header->frame_count;
+  const uint32_t delta = this->next_frame;
+  this->applyDelta(delta);
+  if (delta + 1 < n_frames) {
+    this->next_frame = delta + 1;
+  } else if (delta + 1 == n_frames) {
+    this->next_frame = n_frames;
+  } else {
+    this->next_frame = (n_frames > 1) ? 1 : n_frames;
+  }
+}
+
+void AnimationStream::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible() || this->header == nullptr) return;
+  const int x0 = std::round(this->getWorldPosition().x);
+  const int y0 = std::round(this->getWorldPosition().y);
+  const int x_start = std::max(0, -x0);
+  const int y_start = std::max(0, -y0);
+  const int x_end = std::min<int>(this->width, canvas->width() - x0);
+  const int y_end = std::min<int>(this->height, canvas->height() - y0);
+  for (int y = y_start; y < y_end; ++y) {
+    const uint8_t* px = &this->frame[(y * this->width + x_start) * 3];
+    for (int x = x_start; x < x_end; ++x, px += 3) {
+      if (px[0] == 0 && px[1] == 0 && px[2] == 0) continue;
+      canvas->SetPixel(x0 + x, y0 + y, px[0], px[1], px[2]);
+    }
+  }
+}
+
+} // end namespace Sprites
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "asset-pack.h"
+
+
+namespace {
+
+const char PACK_MAGIC[4] = {'S', 'S', 'A', 'P'};
+const uint16_t PACK_VERSION = 1;
+
+std::mutex& registryMutex() {
+  static std::mutex registry_mutex;
+  return registry_mutex;
+}
+std::vector<Sprites::AssetPack*>& registry() {
+  static std::vector<Sprites::AssetPack*> packs;
+  return packs;
+}
+
+int compareEntry(const Sprites::PackEntry& entry, const std::string& name,
+                 size_t height) {
+  int cmp = strncmp(entry.name, name.c_str(), sizeof(entry.name));
+  if (cmp != 0) return cmp;
+  if (entry.height < height) return -1;
+  if (entry.height > height) return 1;
+  return 0;
+}
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+PackHeader::PackHeader() : version(PACK_VERSION), reserved(0), entry_count(0),
+                           reserved2(0), index_offset(0) {
+  std::memcpy(this->magic, PACK_MAGIC, sizeof(this->magic));
+}
+PackedImage::PackedImage() : pixels(nullptr), mask(nullptr), width(0), height(0) { }
+
+
+AssetPack::AssetPack() : data(nullptr), data_size(0), header(nullptr),
+                         entries(nullptr) { }
+AssetPack::~AssetPack() { this->close(); }
+
+bool AssetPack::open(const std::string& filename) {
+  this->close();
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(PackHeader)) {
+    fprintf(stderr, "Cannot open asset pack '%s'\n", filename.c_str());
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    fprintf(stderr, "Cannot map asset pack '%s'\n", filename.c_str());
+    return false;
+  }
+  this->data = static_cast<const uint8_t*>(mapped);
+  this->data_size = st.st_size;
+  const PackHeader* header = reinterpret_cast<const PackHeader*>(this->data);
+  if (std::memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0
+      || header->version != PACK_VERSION
+      || header->index_offset + header->entry_count * sizeof(PackEntry)
+         > this->data_size) {
+    fprintf(stderr, "'%s' is not an asset pack\n", filename.c_str());
+    this->close();
+    return false;
+  }
+  this->header = header;
+  this->entries = reinterpret_cast<const PackEntry*>(this->data + header->index_offset);
+  return true;
+}
+void AssetPack::close() {
+  if (this->data != nullptr) munmap((void*) this->data, this->data_size);
+  this->data = nullptr;
+  this->data_size = 0;
+  this->header = nullptr;
+  this->entries = nullptr;
+}
+size_t AssetPack::size() const {
+  return this->header != nullptr ? this->header->entry_count : 0;
+}
+
+bool AssetPack::find(const std::string& name, size_t height,
+                     PackedImage* image) const {
+  if (this->header == nullptr) return false;
+  // binary search for the first entry with this name and at least this height
+  size_t lo = 0;
+  size_t hi = this->header->entry_count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (compareEntry(this->entries[mid], name, height) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for (size_t i = lo; i < this->header->entry_count; ++i) {
+    const PackEntry& entry = this->entries[i];
+    if (strncmp(entry.name, name.c_str(), sizeof(entry.name)) != 0) break;
+    if (height == 0 && !(entry.flags & PackEntry::NATIVE_SIZE)) continue;
+    if (height != 0 && entry.height != height) break;
+    const size_t n_pixels = (size_t) entry.width * entry.height;
+    if (entry.pixel_offset + n_pixels * 3 > this->data_size
+        || entry.mask_offset + n_pixels > this->data_size) {
+      return false;
+    }
+    image->pixels = this->data + entry.pixel_offset;
+    image->mask = this->data + entry.mask_offset;
+    image->width = entry.width;
+    image->height = entry.height;
+    return true;
+  }
+  return false;
+}
+
+bool AssetPack::load(const std::string& filename) {
+  AssetPack* pack = new AssetPack();
+  if (!pack->open(filename)) {
+    delete pack;
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(registryMutex());
+  registry().push_back(pack);
+  return true;
+}
+bool AssetPack::lookup(const std::string& name, size_t height,
+                       PackedImage* image) {
+  std::lock_guard<std::mutex> guard(registryMutex());
+  for (const AssetPack* pack : registry()) {
+    if (pack->find(name, height, image)) return true;
+  }
+  return false;
+}
+
+} // end namespace Sprites
@@ -0,0 +1,293 @@
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "command.h"
+#include "command-trace.h"
+#include "led-loop.h"
+#include "sprite.h"
+
+
+namespace {
+
+const char TRACE_MAGIC[4] = {'S', 'S', 'C', 'T'};
+const uint16_t TRACE_VERSION = 1;
+
+// Exact comparison that treats two NaNs as equal (unset goals are NaN)
+bool same(const double a, const double b) {
+  if (std::isnan(a) && std::isnan(b)) return true;
+  return a == b;
+}
+bool same(const Sprites::Point& a, const Sprites::Point& b) {
+  return same(a.x, b.x) && same(a.y, b.y);
+}
+
+// Only what ADD_SPRITE and ADD_TEXT create can be replayed, so no Sprites
+// made from pixels (they have no file). Timelines change their object
+// inside doStep, between capture and snapshot, so objects with one would
+// replay without their animation
+bool isTraceable(const Sprites::CanvasObject* cvo) {
+  if (cvo->getTimeline() != nullptr) return false;
+  const Sprites::Sprite* sprite = dynamic_cast<const Sprites::Sprite*>(cvo);
+  if (sprite != nullptr) return !sprite->getContent().empty();
+  return dynamic_cast<const Sprites::Text*>(cvo) != nullptr;
+}
+
+} // end anonymous namespace
+
+
+namespace led_loop {
+
+TraceHeader::TraceHeader() : version(TRACE_VERSION), reserved(0), frame_time_ms(0) {
+  std::memcpy(this->magic, TRACE_MAGIC, sizeof(this->magic));
+}
+
+
+CommandTraceWriter::ObjectState::ObjectState() :
+    kind(OTHER_OBJECT), goal_steps(-1), speed(0), direction(0),
+    rotation(0), resize(1), visible(true),
+    edge_behavior(Sprites::UNDEFINED_EDGE_BEHAVIOR), z(0), opacity(1),
+    tint(0xffffff), flip_x(false), flip_y(false), quarter_turns(0) { }
+
+CommandTraceWriter::CommandTraceWriter() : file(nullptr), start_ms(0) { }
+CommandTraceWriter::~CommandTraceWriter() { this->close(); }
+
+bool CommandTraceWriter::open(const std::string& filename,
+                              const tmillis_t frame_time_ms) {
+  this->close();
+  this->file = fopen(filename.c_str(), "wb");
+  if (this->file == nullptr) {
+    fprintf(stderr, "Cannot open trace file '%s'\n", filename.c_str());
+    return false;
+  }
+  TraceHeader header;
+  header.frame_time_ms = frame_time_ms;
+  fwrite(&header, sizeof(header), 1, this->file);
+  this->start_ms = getTimeInMillis();
+  this->states.clear();
+  this->untraced.clear();
+  return true;
+}
+void CommandTraceWriter::close() {
+  if (this->file == nullptr) return;
+  fclose(this->file);
+  this->file = nullptr;
+}
+bool CommandTraceWriter::isOpen() const {
+  return this->file != nullptr;
+}
+
+CommandTraceWriter::ObjectState CommandTraceWriter::getState(
+    const Sprites::CanvasObject* cvo) {
+  ObjectState state;
+  const Sprites::Sprite* sprite = dynamic_cast<const Sprites::Sprite*>(cvo);
+  const Sprites::Text* text = dynamic_cast<const Sprites::Text*>(cvo);
+  if (sprite != nullptr) {
+    state.kind = SPRITE_OBJECT;
+    state.content = sprite->getContent();
+    state.rotation = sprite->getRotation();
+    state.resize = sprite->getResize();
+  } else if (text != nullptr) {
+    state.kind = TEXT_OBJECT;
+    state.content = text->getContent();
+    state.font = text->getFont();
+  }
+  state.position = cvo->getPosition();
+  state.position_goal = cvo->getPositionGoal();
+  state.goal_steps = cvo->getGoalSteps();
+  state.speed = cvo->getSpeed();
+  state.direction = cvo->getDirection();
+  state.visible = cvo->getVisibleSetting();
+  state.edge_behavior = cvo->getEdgeBehavior();
+  state.z = cvo->getZ();
+  state.opacity = cvo->getOpacity();
+  const rgb_matrix::Color& tint = cvo->getTint();
+  state.tint = tint.r << 16 | tint.g << 8 | tint.b;
+  state.flip_x = cvo->getFlipX();
+  state.flip_y = cvo->getFlipY();
+  state.quarter_turns = cvo->getQuarterTurns();
+  return state;
+}
+
+void CommandTraceWriter::capture(const uint32_t frame,
+                                 Sprites::CanvasObjectList* canvas_objects) {
+  if (this->file == nullptr) return;
+  // removed objects, and traced ones replaced by an untraceable object
+  for (auto it = this->states.begin(); it != this->states.end(); ) {
+    auto cvo_it = canvas_objects->find(it->first);
+    if (cvo_it != canvas_objects->end() && isTraceable(cvo_it->second)) {
+      ++it;
+      continue;
+    }
+    Message msg;
+    msg.command = REMOVE_SPRITE;
+    msg.id = it->first;
+    this->record(frame, msg);
+    it = this->states.erase(it);
+  }
+  // added and modified objects
+  for (auto& cvo_pair : *canvas_objects) {
+    if (!isTraceable(cvo_pair.second)) {
+      if (this->untraced.insert(cvo_pair.first).second) {
+        fprintf(stderr, "Cannot trace '%s', it is left out of the trace\n",
+                cvo_pair.first.c_str());
+      }
+      continue;
+    }
+    const ObjectState now = getState(cvo_pair.second);
+    auto before_it = this->states.find(cvo_pair.first);
+    // a Sprite replaced by a Text or vice versa is created again
+    const bool is_new = (before_it == this->states.end()
+                         || before_it->second.kind != now.kind);
+    const ObjectState before = is_new ? ObjectState() : before_it->second;
+    Message msg;
+    msg.id = cvo_pair.first;
+    if (is_new) {
+      msg.command = (now.kind == TEXT_OBJECT) ? ADD_TEXT : ADD_SPRITE;
+      msg.filename = now.content;
+      msg.font = now.font;
+      this->record(frame, msg);
+      msg = Message();
+      msg.id = cvo_pair.first;
+    }
+    // reachPosition recalculates speed and direction, so the exact values are
+    // pinned down again by the SET that follows
+    if (is_new || !same(now.position_goal, before.position_goal)
+        || now.goal_steps != before.goal_steps) {
+      if (now.goal_steps >= 0 && !std::isnan(now.position_goal.x)) {
+        Message target;
+        target.command = TARGET;
+        target.id = cvo_pair.first;
+        target.position = now.position_goal;
+        target.duration = now.goal_steps;
+        this->record(frame, target);
+      }
+    }
+    msg.command = SET;
+    if (!is_new && now.content != before.content) msg.filename = now.content;
+    if (!same(now.resize, before.resize))         msg.resize = now.resize;
+    if (!same(now.rotation, before.rotation))     msg.rotation = now.rotation;
+    if (!same(now.position, before.position))     msg.position = now.position;
+    if (!same(now.speed, before.speed))           msg.speed = now.speed;
+    if (!same(now.direction, before.direction))   msg.direction = now.direction;
+    if (now.visible != before.visible)            msg.visible = now.visible;
+    if (now.edge_behavior != before.edge_behavior) {
+      msg.edge_behavior = now.edge_behavior;
+    }
+    if (now.z != before.z)                        msg.z = now.z;
+    if (!same(now.opacity, before.opacity))       msg.opacity = now.opacity;
+    if (now.tint != before.tint)                  msg.tint = now.tint;
+    if (now.flip_x != before.flip_x)              msg.flip_x = now.flip_x;
+    if (now.flip_y != before.flip_y)              msg.flip_y = now.flip_y;
+    if (now.quarter_turns != before.quarter_turns) {
+      msg.quarter_turns = now.quarter_turns;
+    }
+    if (msg.filename.empty() && std::isnan(msg.resize) && std::isnan(msg.rotation)
+        && std::isnan(msg.position.x) && std::isnan(msg.speed)
+        && std::isnan(msg.direction) && msg.visible < 0
+        && msg.edge_behavior == Sprites::UNDEFINED_EDGE_BEHAVIOR
+        && msg.z == INT_MIN && std::isnan(msg.opacity) && msg.tint < 0
+        && msg.flip_x < 0 && msg.flip_y < 0 && msg.quarter_turns < 0) {
+      continue;
+    }
+    this->record(frame, msg);
+  }
+  if (!this->buffer.empty()) {
+    fwrite(this->buffer.data(), 1, this->buffer.size(), this->file);
+    this->buffer.clear();
+  }
+}
+
+void CommandTraceWriter::snapshot(Sprites::CanvasObjectList* canvas_objects) {
+  if (this->file == nullptr) return;
+  for (auto& cvo_pair : *canvas_objects) {
+    if (!isTraceable(cvo_pair.second)) continue;
+    this->states[cvo_pair.first] = getState(cvo_pair.second);
+  }
+}
+
+void CommandTraceWriter::record(const uint32_t frame, const Message& msg) {
+  std::string encoded;
+  encodeMessage(msg, &encoded);
+  const uint32_t time_ms = getTimeInMillis() - this->start_ms;
+  const uint16_t length = encoded.size();
+  this->buffer.append(reinterpret_cast<const char*>(&frame), sizeof(frame));
+  this->buffer.append(reinterpret_cast<const char*>(&time_ms), sizeof(time_ms));
+  this->buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+  this->buffer.append(encoded);
+}
+
+
+
+CommandTraceReader::CommandTraceReader() :
+    file(nullptr), has_record(false), record_frame(0) { }
+CommandTraceReader::~CommandTraceReader() { this->close(); }
+
+bool CommandTraceReader::open(const std::string& filename) {
+  this->close();
+  this->file = fopen(filename.c_str(), "rb");
+  if (this->file == nullptr) {
+    fprintf(stderr, "Cannot open trace file '%s'\n", filename.c_str());
+    return false;
+  }
+  if (fread(&this->header, sizeof(this->header), 1, this->file) != 1
+      || std::memcmp(this->header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0
+      || this->header.version != TRACE_VERSION) {
+    fprintf(stderr, "'%s' is not a command trace\n", filename.c_str());
+    this->close();
+    return false;
+  }
+  this->readRecord();
+  return true;
+}
+void CommandTraceReader::close() {
+  if (this->file != nullptr) fclose(this->file);
+  this->file = nullptr;
+  this->has_record = false;
+}
+tmillis_t CommandTraceReader::getFrameTime() const {
+  return this->header.frame_time_ms;
+}
+bool CommandTraceReader::atEnd() const {
+  return !this->has_record;
+}
+
+bool CommandTraceReader::readRecord() {
+  this->has_record = false;
+  if (this->file == nullptr) return false;
+  uint32_t frame;
+  uint32_t time_ms;
+  uint16_t length;
+  if (fread(&frame, sizeof(frame), 1, this->file) != 1
+      || fread(&time_ms, sizeof(time_ms), 1, this->file) != 1
+      || fread(&length, sizeof(length), 1, this->file) != 1) {
+    return false;
+  }
+  this->buffer.resize(length);
+  if (fread(&this->buffer[0], 1, length, this->file) != length
+      || decodeMessage(this->buffer.data(), length, &this->record) == 0) {
+    fprintf(stderr, "Truncated record in command trace\n");
+    return false;
+  }
+  this->record_frame = frame;
+  this->has_record = true;
+  return true;
+}
+
+size_t CommandTraceReader::replay(const uint32_t frame,
+                                  Sprites::CanvasObjectList* canvas_objects) {
+  size_t applied = 0;
+  while (this->has_record && this->record_frame <= frame) {
+    if (applyCommand(this->record, canvas_objects) != 0) {
+      fprintf(stderr, "Replaying record of frame %u failed:\n", this->record_frame);
+      this->record.print();
+    }
+    ++applied;
+    this->readRecord();
+  }
+  return applied;
+}
+
+} // end namespace led_loop
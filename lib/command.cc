@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+
+#include "command.h"
+#include "sprite.h"
+
+
+namespace {
+
+const char* DEFAULT_FONT = "lib/rgbmatrix/fonts/10x20.bdf";
+
+// Bits of the field mask in the binary encoding
+enum MessageField {
+  FIELD_FILENAME      = 1 << 0,
+  FIELD_FONT          = 1 << 1,
+  FIELD_POSITION      = 1 << 2,
+  FIELD_SPEED         = 1 << 3,
+  FIELD_DIRECTION     = 1 << 4,
+  FIELD_ROTATION      = 1 << 5,
+  FIELD_RESIZE        = 1 << 6,
+  FIELD_DURATION      = 1 << 7,
+  FIELD_VISIBLE       = 1 << 8,
+  FIELD_EDGE_BEHAVIOR = 1 << 9,
+  FIELD_Z             = 1 << 10,
+  FIELD_OPACITY       = 1 << 11,
+  FIELD_TINT          = 1 << 12,
+  FIELD_FLIP_X        = 1 << 13,
+  FIELD_FLIP_Y        = 1 << 14,
+  FIELD_QUARTER_TURNS = 1 << 15
+};
+
+template <typename T>
+void append(std::string* out, const T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+void appendString(std::string* out, const std::string& str) {
+  append<uint16_t>(out, str.size());
+  out->append(str);
+}
+
+// Bounds-checked reading from a byte buffer
+struct Reader {
+  Reader(const char* data, size_t len) : data(data), len(len), pos(0), ok(true) { }
+  template <typename T>
+  T get() {
+    T value = T();
+    if (!this->ok || this->pos + sizeof(T) > this->len) {
+      this->ok = false;
+      return value;
+    }
+    std::memcpy(&value, this->data + this->pos, sizeof(T));
+    this->pos += sizeof(T);
+    return value;
+  }
+  std::string getString(size_t size) {
+    if (!this->ok || this->pos + size > this->len) {
+      this->ok = false;
+      return "";
+    }
+    std::string str(this->data + this->pos, size);
+    this->pos += size;
+    return str;
+  }
+  const char* data;
+  size_t len;
+  size_t pos;
+  bool ok;
+};
+
+void applyFields(const led_loop::Message& msg, Sprites::CanvasObject* cvo) {
+  Sprites::Sprite* sprite = dynamic_cast<Sprites::Sprite*>(cvo);
+  if (!msg.filename.empty() && msg.filename != cvo->getContent()) {
+    cvo->setContent(msg.filename);
+  }
+  if (sprite != nullptr) {
+    if (!std::isnan(msg.resize)) sprite->setResize(msg.resize);
+    if (!std::isnan(msg.rotation)) sprite->setRotation(msg.rotation);
+  }
+  if (!std::isnan(msg.speed)) cvo->setSpeed(msg.speed);
+  if (!std::isnan(msg.direction)) cvo->setDirection(msg.direction);
+  if (!std::isnan(msg.position.x)) cvo->setPosition(msg.position);
+  if (msg.visible >= 0) cvo->setVisible(msg.visible);
+  if (msg.edge_behavior != Sprites::UNDEFINED_EDGE_BEHAVIOR) {
+    cvo->setEdgeBehavior(msg.edge_behavior);
+  }
+  if (msg.z != INT_MIN) cvo->setZ(msg.z);
+  if (!std::isnan(msg.opacity)) cvo->setOpacity(msg.opacity);
+  if (msg.tint >= 0) {
+    cvo->setTint(msg.tint >> 16 & 0xff, msg.tint >> 8 & 0xff, msg.tint & 0xff);
+  }
+  if (msg.flip_x >= 0 || msg.flip_y >= 0) {
+    cvo->setFlip(msg.flip_x >= 0 ? msg.flip_x : cvo->getFlipX(),
+                 msg.flip_y >= 0 ? msg.flip_y : cvo->getFlipY());
+  }
+  if (msg.quarter_turns >= 0) cvo->setQuarterTurns(msg.quarter_turns);
+}
+
+void addFields(const led_loop::Message& msg, Sprites::CanvasObject* cvo) {
+  if (!std::isnan(msg.speed)) cvo->setSpeed(cvo->getSpeed() + msg.speed);
+  if (!std::isnan(msg.direction)) {
+    cvo->setDirection(cvo->getDirection() + msg.direction);
+  }
+  if (!std::isnan(msg.position.x)) {
+    const Sprites::Point& p = cvo->getPosition();
+    cvo->setPosition(Sprites::Point(p.x + msg.position.x, p.y + msg.position.y));
+  }
+}
+
+} // end anonymous namespace
+
+
+namespace led_loop {
+
+Message::Message() :
+    command(NO_COMMAND), id(""), filename(""), font(""),
+    position(nan(""), nan("")), speed(nan("")), direction(nan("")),
+    rotation(nan("")), resize(nan("")), duration(-1), visible(-1),
+    edge_behavior(Sprites::UNDEFINED_EDGE_BEHAVIOR), z(INT_MIN),
+    opacity(nan("")), tint(-1), flip_x(-1), flip_y(-1), quarter_turns(-1) { }
+
+void Message::print() const {
+  fprintf(stderr, "Command %s:\n"
+          "\tID = %s,\n"
+          "\tfilename = %s, font = %s\n"
+          "\tposition = (%f, %f)\n"
+          "\tspeed = %.2f, direction = %.2f, rotation = %.2f, resize = %.2f\n"
+          "\tduration = %i, visible = %i\n"
+          "\tedge behavior = %d\n"
+          "\tz = %i, opacity = %.2f, tint = %06x\n"
+          "\tflip = (%i, %i), quarter turns = %i\n",
+          commandName(command), id.c_str(), filename.c_str(), font.c_str(),
+          position.x, position.y, speed, direction, rotation, resize,
+          duration, visible, edge_behavior, z, opacity, tint, flip_x, flip_y,
+          quarter_turns);
+}
+
+Command resolveCommand(const std::string& str) {
+  if (str == "") return NO_COMMAND;
+  if (str == "addSprite") return ADD_SPRITE;
+  if (str == "addText") return ADD_TEXT;
+  if (str == "removeSprite") return REMOVE_SPRITE;
+  if (str == "set") return SET;
+  if (str == "add") return ADD;
+  if (str == "target") return TARGET;
+  fprintf(stderr, "UnkownCommand: %s\n", str.c_str());
+  return UNKNOWN_COMMAND;
+}
+const char* commandName(const Command command) {
+  switch (command) {
+    case NO_COMMAND :     return "";
+    case ADD_SPRITE :     return "addSprite";
+    case ADD_TEXT :       return "addText";
+    case REMOVE_SPRITE :  return "removeSprite";
+    case SET :            return "set";
+    case ADD :            return "add";
+    case TARGET :         return "target";
+    case UNKNOWN_COMMAND: return "unknown";
+    default :             return "invalid";
+  }
+}
+Sprites::EdgeBehavior resolveEdgeBehavior(const std::string& str) {
+  if (str == "loop" || str == "loop_indirect") return Sprites::LOOP_INDIRECT;
+  if (str == "loop_direct") return Sprites::LOOP_DIRECT;
+  if (str == "bounce") return Sprites::BOUNCE;
+  if (str == "stop") return Sprites::STOP;
+  if (str == "disappear") return Sprites::DISAPPEAR;
+  return Sprites::UNDEFINED_EDGE_BEHAVIOR;
+}
+
+
+static int runCommand(const Message& msg,
+                      Sprites::CanvasObjectList* canvas_objects) {
+  switch (msg.command) {
+    case ADD :
+    case SET :
+    case TARGET : {
+      if (msg.command == TARGET && (msg.duration < 0 || std::isnan(msg.position.x))) {
+        return 1;
+      }
+      Sprites::CanvasObjectListIterator it = canvas_objects->begin();
+      Sprites::CanvasObjectListIterator end = canvas_objects->end();
+      if (msg.id != "") {
+        it = canvas_objects->find(msg.id);
+        if (it == canvas_objects->end()) return 1;
+        end = std::next(it);
+      }
+      for (; it != end; ++it) {
+        Sprites::CanvasObject* cvo = it->second;
+        if (msg.command == ADD) addFields(msg, cvo);
+        if (msg.command == SET) applyFields(msg, cvo);
+        if (msg.command == TARGET) cvo->reachPosition(msg.position, msg.duration);
+      }
+      break;
+    }
+    case ADD_SPRITE :
+    case ADD_TEXT : {
+      if (msg.id == "") return 1;
+      if (msg.command == ADD_SPRITE && msg.filename == "") return 1;
+      Sprites::CanvasObject* cvo;
+      if (msg.command == ADD_SPRITE) {
+        cvo = new Sprites::Sprite(msg.filename);
+      } else {
+        cvo = new Sprites::Text(msg.font.empty() ? DEFAULT_FONT : msg.font,
+                                msg.filename);
+      }
+      cvo->setID(msg.id);
+      cvo->setOwnedByList(true);
+      auto existing = canvas_objects->find(msg.id);
+      if (existing != canvas_objects->end()
+          && existing->second->isOwnedByList()) {
+        delete existing->second;
+      }
+      (*canvas_objects)[msg.id] = cvo;
+      applyFields(msg, cvo);
+      break;
+    }
+    case REMOVE_SPRITE : {
+      auto it = canvas_objects->find(msg.id);
+      if (it == canvas_objects->end()) return 1;
+      if (it->second->isOwnedByList()) delete it->second;
+      canvas_objects->erase(it);
+      break;
+    }
+    default : {
+      fprintf(stderr, "No valid command given\n");
+      return 1;
+    }
+  }
+  return 0;
+}
+// Commands come from sockets and traces, a bad one must not take down the
+// animation thread
+int applyCommand(const Message& msg, Sprites::CanvasObjectList* canvas_objects) {
+  try {
+    return runCommand(msg, canvas_objects);
+  } catch (std::exception& e) {
+    fprintf(stderr, "Command %s for '%s' failed: %s\n", commandName(msg.command),
+            msg.id.c_str(), e.what());
+    return 1;
+  }
+}
+
+
+void encodeMessage(const Message& msg, std::string* out) {
+  uint16_t fields = 0;
+  if (!msg.filename.empty())                 fields |= FIELD_FILENAME;
+  if (!msg.font.empty())                     fields |= FIELD_FONT;
+  if (!std::isnan(msg.position.x))           fields |= FIELD_POSITION;
+  if (!std::isnan(msg.speed))                fields |= FIELD_SPEED;
+  if (!std::isnan(msg.direction))            fields |= FIELD_DIRECTION;
+  if (!std::isnan(msg.rotation))             fields |= FIELD_ROTATION;
+  if (!std::isnan(msg.resize))               fields |= FIELD_RESIZE;
+  if (msg.duration >= 0)                     fields |= FIELD_DURATION;
+  if (msg.visible >= 0)                      fields |= FIELD_VISIBLE;
+  if (msg.edge_behavior != Sprites::UNDEFINED_EDGE_BEHAVIOR) {
+    fields |= FIELD_EDGE_BEHAVIOR;
+  }
+  if (msg.z != INT_MIN)                      fields |= FIELD_Z;
+  if (!std::isnan(msg.opacity))              fields |= FIELD_OPACITY;
+  if (msg.tint >= 0)                         fields |= FIELD_TINT;
+  if (msg.flip_x >= 0)                       fields |= FIELD_FLIP_X;
+  if (msg.flip_y >= 0)                       fields |= FIELD_FLIP_Y;
+  if (msg.quarter_turns >= 0)                fields |= FIELD_QUARTER_TURNS;
+  append<uint8_t>(out, msg.command);
+  append<uint16_t>(out, fields);
+  const size_t id_length = std::min<size_t>(msg.id.size(), 255);
+  append<uint8_t>(out, id_length);
+  out->append(msg.id, 0, id_length);
+  if (fields & FIELD_FILENAME)      appendString(out, msg.filename);
+  if (fields & FIELD_FONT)          appendString(out, msg.font);
+  if (fields & FIELD_POSITION) {
+    append<double>(out, msg.position.x);
+    append<double>(out, msg.position.y);
+  }
+  if (fields & FIELD_SPEED)         append<double>(out, msg.speed);
+  if (fields & FIELD_DIRECTION)     append<double>(out, msg.direction);
+  if (fields & FIELD_ROTATION)      append<double>(out, msg.rotation);
+  if (fields & FIELD_RESIZE)        append<double>(out, msg.resize);
+  if (fields & FIELD_DURATION)      append<int32_t>(out, msg.duration);
+  if (fields & FIELD_VISIBLE)       append<uint8_t>(out, msg.visible);
+  if (fields & FIELD_EDGE_BEHAVIOR) append<uint8_t>(out, msg.edge_behavior);
+  if (fields & FIELD_Z)             append<int32_t>(out, msg.z);
+  if (fields & FIELD_OPACITY)       append<double>(out, msg.opacity);
+  if (fields & FIELD_TINT)          append<uint32_t>(out, msg.tint);
+  if (fields & FIELD_FLIP_X)        append<uint8_t>(out, msg.flip_x);
+  if (fields & FIELD_FLIP_Y)        append<uint8_t>(out, msg.flip_y);
+  if (fields & FIELD_QUARTER_TURNS) append<uint8_t>(out, msg.quarter_turns);
+}
+
+size_t decodeMessage(const char* data, size_t len, Message* msg) {
+  Reader reader(data, len);
+  *msg = Message();
+  msg->command = static_cast<Command>(reader.get<uint8_t>());
+  uint16_t fields = reader.get<uint16_t>();
+  msg->id = reader.getString(reader.get<uint8_t>());
+  if (fields & FIELD_FILENAME) {
+    msg->filename = reader.getString(reader.get<uint16_t>());
+  }
+  if (fields & FIELD_FONT) {
+    msg->font = reader.getString(reader.get<uint16_t>());
+  }
+  if (fields & FIELD_POSITION) {
+    double x = reader.get<double>();
+    double y = reader.get<double>();
+    msg->position = Sprites::Point(x, y);
+  }
+  if (fields & FIELD_SPEED)         msg->speed = reader.get<double>();
+  if (fields & FIELD_DIRECTION)     msg->direction = reader.get<double>();
+  if (fields & FIELD_ROTATION)      msg->rotation = reader.get<double>();
+  if (fields & FIELD_RESIZE)        msg->resize = reader.get<double>();
+  if (fields & FIELD_DURATION)      msg->duration = reader.get<int32_t>();
+  if (fields & FIELD_VISIBLE)       msg->visible = reader.get<uint8_t>();
+  if (fields & FIELD_EDGE_BEHAVIOR) {
+    msg->edge_behavior = static_cast<Sprites::EdgeBehavior>(reader.get<uint8_t>());
+  }
+  if (fields & FIELD_Z)             msg->z = reader.get<int32_t>();
+  if (fields & FIELD_OPACITY)       msg->opacity = reader.get<double>();
+  if (fields & FIELD_TINT)          msg->tint = reader.get<uint32_t>() & 0xffffff;
+  if (fields & FIELD_FLIP_X)        msg->flip_x = reader.get<uint8_t>();
+  if (fields & FIELD_FLIP_Y)        msg->flip_y = reader.get<uint8_t>();
+  if (fields & FIELD_QUARTER_TURNS) msg->quarter_turns = reader.get<uint8_t>();
+  if (!reader.ok) return 0;
+  return reader.pos;
+}
+
+} // end namespace led_loop
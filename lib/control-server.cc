@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "rapidjson/document.h"
+
+#include "command.h"
+#include "control-server.h"
+#include "realtime.h"
+
+
+namespace led_loop {
+
+bool parseJSONMessage(const std::string& line, const tmillis_t frame_time_ms,
+                      Message* msg) {
+  rapidjson::Document doc;
+  doc.Parse(line.c_str());
+  *msg = Message();
+  if (doc.HasParseError() || !doc.IsObject()) {
+    fprintf(stderr, "No object parsed: %s\n", line.c_str());
+    msg->command = INVALID_COMMAND;
+    return false;
+  }
+  if (doc.HasMember("command") && doc["command"].IsString()) {
+    msg->command = resolveCommand(doc["command"].GetString());
+  }
+  if (doc.HasMember("ID") && doc["ID"].IsString()) {
+    msg->id = doc["ID"].GetString();
+  }
+  if (doc.HasMember("filename") && doc["filename"].IsString()) {
+    msg->filename = doc["filename"].GetString();
+  }
+  if (doc.HasMember("font") && doc["font"].IsString()) {
+    msg->font = doc["font"].GetString();
+  }
+  if (doc.HasMember("position") && doc["position"].IsObject()
+      && doc["position"].HasMember("x") && doc["position"]["x"].IsNumber()
+      && doc["position"].HasMember("y") && doc["position"]["y"].IsNumber()) {
+    double x = doc["position"]["x"].GetDouble();
+    double y = doc["position"]["y"].GetDouble();
+    msg->position = Sprites::Point(x, y);
+  }
+  if (doc.HasMember("speed") && doc["speed"].IsNumber()) {
+    msg->speed = doc["speed"].GetDouble();
+  }
+  if (doc.HasMember("direction") && doc["direction"].IsNumber()) {
+    msg->direction = doc["direction"].GetDouble();
+  }
+  if (doc.HasMember("rotation") && doc["rotation"].IsNumber()) {
+    msg->rotation = doc["rotation"].GetDouble();
+  }
+  if (doc.HasMember("resize") && doc["resize"].IsNumber()) {
+    msg->resize = doc["resize"].GetDouble();
+  }
+  if (doc.HasMember("duration") && doc["duration"].IsUint()) {
+    msg->duration = doc["duration"].GetUint() / std::max<tmillis_t>(frame_time_ms, 1);
+  }
+  if (doc.HasMember("visible") && doc["visible"].IsBool()) {
+    msg->visible = doc["visible"].GetBool();
+  }
+  if (doc.HasMember("edge_behavior") && doc["edge_behavior"].IsString()) {
+    msg->edge_behavior = resolveEdgeBehavior(doc["edge_behavior"].GetString());
+  }
+  if (doc.HasMember("z") && doc["z"].IsInt()) {
+    msg->z = doc["z"].GetInt();
+  }
+  if (doc.HasMember("opacity") && doc["opacity"].IsNumber()) {
+    msg->opacity = doc["opacity"].GetDouble();
+  }
+  if (doc.HasMember("tint") && doc["tint"].IsObject()
+      && doc["tint"].HasMember("r") && doc["tint"]["r"].IsUint()
+      && doc["tint"].HasMember("g") && doc["tint"]["g"].IsUint()
+      && doc["tint"].HasMember("b") && doc["tint"]["b"].IsUint()) {
+    msg->tint = std::min(doc["tint"]["r"].GetUint(), 255u) << 16
+              | std::min(doc["tint"]["g"].GetUint(), 255u) << 8
+              | std::min(doc["tint"]["b"].GetUint(), 255u);
+  }
+  if (doc.HasMember("flip_x") && doc["flip_x"].IsBool()) {
+    msg->flip_x = doc["flip_x"].GetBool();
+  }
+  if (doc.HasMember("flip_y") && doc["flip_y"].IsBool()) {
+    msg->flip_y = doc["flip_y"].GetBool();
+  }
+  if (doc.HasMember("quarter_turns") && doc["quarter_turns"].IsInt()) {
+    msg->quarter_turns = (doc["quarter_turns"].GetInt() % 4 + 4) % 4;
+  }
+  return true;
+}
+
+
+ControlServer::ControlServer() : socket_path(""), frame_time_ms(50),
+                                 listen_fd(-1), epoll_fd(-1), wake_fd(-1),
+                                 is_running(false), client_count(0) { }
+ControlServer::~ControlServer() {
+  this->stop();
+}
+
+bool ControlServer::start(const std::string& socket_path,
+                          const tmillis_t frame_time_ms) {
+  this->stop();
+  this->socket_path = socket_path;
+  this->frame_time_ms = frame_time_ms;
+
+  struct sockaddr_un address;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", socket_path.c_str());
+    return false;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(socket_path.c_str());   // left over from an earlier run
+
+  this->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (this->listen_fd < 0
+      || bind(this->listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0
+      || listen(this->listen_fd, SOMAXCONN) < 0) {
+    fprintf(stderr, "Couldn't listen on '%s': %s\n", socket_path.c_str(),
+            strerror(errno));
+    this->stop();
+    return false;
+  }
+  this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->epoll_fd < 0 || this->wake_fd < 0) {
+    perror("Couldn't set up the control server");
+    this->stop();
+    return false;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = this->listen_fd;
+  epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->listen_fd, &event);
+  event.data.fd = this->wake_fd;
+  epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &event);
+
+  this->is_running = true;
+  this->server_thread = std::thread(&ControlServer::serve, this);
+  return true;
+}
+
+void ControlServer::stop() {
+  this->is_running = false;
+  if (this->server_thread.joinable()) {
+    const uint64_t one = 1;
+    if (write(this->wake_fd, &one, sizeof(one)) < 0) { }
+    this->server_thread.join();
+  }
+  for (auto& client : this->clients) close(client.first);
+  this->clients.clear();
+  this->client_count = 0;
+  if (this->listen_fd >= 0) {
+    close(this->listen_fd);
+    unlink(this->socket_path.c_str());
+  }
+  if (this->epoll_fd >= 0) close(this->epoll_fd);
+  if (this->wake_fd >= 0) close(this->wake_fd);
+  this->listen_fd = this->epoll_fd = this->wake_fd = -1;
+}
+
+bool ControlServer::isRunning() const       { return this->is_running; }
+size_t ControlServer::getClientCount() const { return this->client_count; }
+
+void ControlServer::takeMessages(std::vector<Message>* messages) {
+  messages->clear();
+  std::lock_guard<std::mutex> guard(this->queue_mutex);
+  messages->swap(this->queue);
+}
+
+void ControlServer::serve() {
+  Sprites::configureWorkerThread("control server");
+  const int MAX_EVENTS = 32;
+  struct epoll_event events[MAX_EVENTS];
+  while (this->is_running) {
+    const int n_events = epoll_wait(this->epoll_fd, events, MAX_EVENTS, -1);
+    if (n_events < 0) {
+      if (errno == EINTR) continue;
+      perror("epoll_wait");
+      break;
+    }
+    for (int i = 0; i < n_events; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == this->wake_fd) continue;
+      if (fd == this->listen_fd) {
+        this->acceptClients();
+      } else if (!this->readClient(fd)) {
+        this->dropClient(fd);
+      }
+    }
+  }
+}
+
+void ControlServer::acceptClients() {
+  int fd;
+  while ((fd = accept4(this->listen_fd, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      close(fd);
+      continue;
+    }
+    this->clients[fd] = "";
+    ++this->client_count;
+  }
+}
+
+// Reads everything that is available and queues all complete messages in one
+// go. Returns false if the client is gone or misbehaving.
+bool ControlServer::readClient(const int fd) {
+  std::string* buffer = &this->clients[fd];
+  std::vector<Message> messages;
+  char chunk[16384];
+  bool open = true;
+  while (true) {
+    const ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n > 0) {
+      buffer->append(chunk, n);
+      this->parse(buffer, &messages);
+      if (buffer->size() > MAX_PENDING_BYTES) {
+        fprintf(stderr, "Dropping control client that sent %zu bytes without "
+                "a complete message\n", buffer->size());
+        open = false;
+        break;
+      }
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) open = false;
+    break;
+  }
+  if (!messages.empty()) {
+    std::lock_guard<std::mutex> guard(this->queue_mutex);
+    this->queue.insert(this->queue.end(), messages.begin(), messages.end());
+  }
+  return open;
+}
+
+void ControlServer::parse(std::string* buffer,
+                          std::vector<Message>* messages) const {
+  size_t pos = 0;
+  while (pos < buffer->size()) {
+    if (static_cast<uint8_t>((*buffer)[pos]) == BINARY_MARKER) {
+      if (buffer->size() - pos < 3) break;
+      uint16_t length;
+      memcpy(&length, buffer->data() + pos + 1, sizeof(length));
+      if (buffer->size() - pos - 3 < length) break;
+      Message msg;
+      if (decodeMessage(buffer->data() + pos + 3, length, &msg) == length) {
+        messages->push_back(msg);
+      } else {
+        fprintf(stderr, "Malformed binary command of %u bytes\n", length);
+      }
+      pos += 3 + length;
+    } else {
+      const size_t newline = buffer->find('\n', pos);
+      if (newline == std::string::npos) break;
+      const std::string line = buffer->substr(pos, newline - pos);
+      pos = newline + 1;
+      if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+      Message msg;
+      if (parseJSONMessage(line, this->frame_time_ms, &msg)) {
+        messages->push_back(msg);
+      }
+    }
+  }
+  buffer->erase(0, pos);
+}
+
+void ControlServer::dropClient(const int fd) {
+  epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  this->clients.erase(fd);
+  --this->client_count;
+}
+
+} // end namespace led_loop
@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "event-queue.h"
+
+
+namespace led_loop {
+
+EventQueue::EventQueue(const uint32_t capacity) :
+    ring(), mask(0), head(0), tail(0), dropped(0), pushed(false) {
+  uint32_t size = 1;
+  while (size < capacity && size < (1U << 31)) size <<= 1;
+  this->ring.resize(size);
+  this->mask = size - 1;
+  this->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->fd < 0) {
+    perror("Couldn't create object event eventfd");
+  }
+}
+EventQueue::~EventQueue() {
+  if (this->fd >= 0) close(this->fd);
+}
+
+bool EventQueue::push(const uint32_t frame, const uint8_t type,
+                      const Sprites::CanvasObject& object) {
+  const uint32_t head = this->head.load(std::memory_order_relaxed);
+  const uint32_t tail = this->tail.load(std::memory_order_acquire);
+  if (head - tail > this->mask) {
+    this->dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  EventRecord& record = this->ring[head & this->mask];
+  record.frame = frame;
+  record.type = type;
+  const Sprites::Point& position = object.getWorldPosition();
+  record.x = position.x;
+  record.y = position.y;
+  strncpy(record.id, object.getID().c_str(), sizeof(record.id) - 1);
+  record.id[sizeof(record.id) - 1] = '\0';
+  this->head.store(head + 1, std::memory_order_release);
+  this->pushed = true;
+  return true;
+}
+void EventQueue::signal() {
+  if (!this->pushed || this->fd < 0) return;
+  this->pushed = false;
+  const uint64_t one = 1;
+  if (write(this->fd, &one, sizeof(one)) < 0) { }
+}
+
+size_t EventQueue::pop(EventRecord* events, const size_t max_events) {
+  std::lock_guard<std::mutex> guard(this->consumer_mutex);
+  // reset the eventfd first, so events pushed meanwhile signal it again
+  uint64_t signals;
+  if (this->fd >= 0 && read(this->fd, &signals, sizeof(signals)) < 0) { }
+  const uint32_t head = this->head.load(std::memory_order_acquire);
+  uint32_t tail = this->tail.load(std::memory_order_relaxed);
+  size_t n = 0;
+  for (; n < max_events && tail != head; ++n, ++tail) {
+    events[n] = this->ring[tail & this->mask];
+  }
+  this->tail.store(tail, std::memory_order_release);
+  if (tail != head && this->fd >= 0) {
+    // more than max_events were waiting, keep the fd readable
+    const uint64_t one = 1;
+    if (write(this->fd, &one, sizeof(one)) < 0) { }
+  }
+  return n;
+}
+int EventQueue::getFd() const {
+  return this->fd;
+}
+uint64_t EventQueue::getDropped() const {
+  return this->dropped.load(std::memory_order_relaxed);
+}
+
+} // end namespace led_loop
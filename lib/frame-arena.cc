@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <new>
+
+#include "frame-arena.h"
+
+
+namespace {
+
+thread_local Sprites::FrameArena* current_arena = nullptr;
+
+size_t alignUp(const size_t value, const size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+FrameArena::FrameArena(const size_t capacity) :
+    buffer(static_cast<char*>(::operator new(capacity))), capacity(capacity),
+    used(0), high_water(0) { }
+FrameArena::~FrameArena() {
+  this->reset();
+  ::operator delete(this->buffer);
+}
+
+void* FrameArena::allocate(const size_t size, const size_t alignment) {
+  const size_t start = alignUp(this->used, alignment);
+  this->high_water = std::max(this->high_water, start) + size;
+  if (start + size <= this->capacity) {
+    this->used = start + size;
+    return this->buffer + start;
+  }
+  // ::operator new is aligned for any fundamental type
+  void* block = ::operator new(size);
+  this->overflow.push_back(block);
+  return block;
+}
+
+void FrameArena::reset() {
+  for (void* block : this->overflow) ::operator delete(block);
+  this->overflow.clear();
+  if (this->high_water > this->capacity) {
+    // leave some room for frames that need a little more
+    const size_t capacity = this->high_water + this->high_water / 2;
+    ::operator delete(this->buffer);
+    this->buffer = static_cast<char*>(::operator new(capacity));
+    this->capacity = capacity;
+  }
+  this->used = 0;
+  this->high_water = 0;
+}
+
+size_t FrameArena::getCapacity() const { return this->capacity; }
+size_t FrameArena::getUsed() const     { return this->used; }
+
+FrameArena* FrameArena::current() {
+  return current_arena;
+}
+
+ArenaScope::ArenaScope(FrameArena* arena) : previous(current_arena) {
+  current_arena = arena;
+}
+ArenaScope::~ArenaScope() {
+  current_arena = this->previous;
+}
+
+} // end namespace Sprites
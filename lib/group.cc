@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "canvas.h"
+#include "group.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+Group::Group() : CanvasObject::CanvasObject(), name(""), children(),
+                 draw_order() { }
+Group::Group(const std::string name) : Group() {
+  this->setContent(name);
+}
+Group::~Group() {
+  for (CanvasObject* child : this->children) delete child;
+}
+
+void Group::add(CanvasObject* child) {
+  if (child == nullptr || child == this) return;
+  if (child->parent != nullptr) child->parent->remove(child->getID());
+  child->parent = this;
+  child->invalidateWorldPosition();
+  this->children.push_back(child);
+  this->updateBounds();
+}
+CanvasObject* Group::remove(const CanvasObjectID& id) {
+  auto it = std::find_if(this->children.begin(), this->children.end(),
+      [&id](const CanvasObject* child) { return child->getID() == id; });
+  if (it == this->children.end()) return nullptr;
+  CanvasObject* child = *it;
+  this->children.erase(it);
+  child->parent = nullptr;
+  child->invalidateWorldPosition();
+  this->updateBounds();
+  return child;
+}
+CanvasObject* Group::find(const CanvasObjectID& id) const {
+  for (CanvasObject* child : this->children) {
+    if (child->getID() == id) return child;
+  }
+  return nullptr;
+}
+const std::vector<CanvasObject*>& Group::getChildren() const {
+  return this->children;
+}
+
+void Group::setContent(const std::string& name)  { this->name = name; }
+const std::string& Group::getContent() const    { return this->name; }
+
+void Group::doStep() {
+  CanvasObject::doStep();
+  for (CanvasObject* child : this->children) child->doStep();
+  this->updateBounds();
+}
+
+void Group::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible()) return;
+  this->draw_order = this->children;
+  sortByZ(&this->draw_order);
+  for (const CanvasObject* child : this->draw_order) child->draw(canvas);
+}
+
+// A stale group always has stale descendants (refreshing a child refreshes
+// its ancestors first), so there is nothing to do twice
+void Group::invalidateWorldPosition() {
+  if (this->world_dirty) return;
+  this->world_dirty = true;
+  for (CanvasObject* child : this->children) child->invalidateWorldPosition();
+}
+
+// The size of the group is the box from its origin to the far edges of its
+// children, it is what the group's edge behavior works with
+void Group::updateBounds() {
+  double width = 0;
+  double height = 0;
+  for (const CanvasObject* child : this->children) {
+    width = std::max(width, child->getPosition().x + child->getWidth());
+    height = std::max(height, child->getPosition().y + child->getHeight());
+  }
+  this->width = std::ceil(width);
+  this->height = std::ceil(height);
+}
+
+} // end namespace Sprites
@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Magick++.h>
+
+#include "canvas.h"
+#include "image-scroller.h"
+#include "realtime.h"
+#include "sprite.h"
+
+
+namespace {
+
+const char BLOCK_MAGIC[4] = {'S', 'S', 'I', 'B'};
+const uint16_t BLOCK_VERSION = 1;
+const size_t BLOCK_SIZE = Sprites::ImageScroller::BLOCK_SIZE;
+const size_t BLOCK_BYTES = BLOCK_SIZE * BLOCK_SIZE * 4;
+
+// Start of a block file, the blocks follow row by row
+struct BlockFileHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t block_size;
+  uint32_t width;
+  uint32_t height;
+  uint32_t reserved;
+  int64_t source_mtime;     // of the image file it was made from
+  uint64_t source_size;
+};
+
+std::string blockFilePath(const std::string& filename) {
+  char resolved[PATH_MAX];
+  const std::string name = realpath(filename.c_str(), resolved) ? resolved : filename;
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/shapeshifter-%016zx.blocks",
+           std::hash<std::string>()(name));
+  return path;
+}
+
+bool readHeader(int fd, const struct stat& source, BlockFileHeader* header) {
+  if (pread(fd, header, sizeof(*header), 0) != sizeof(*header)) return false;
+  return std::memcmp(header->magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) == 0
+         && header->version == BLOCK_VERSION
+         && header->block_size == BLOCK_SIZE
+         && header->source_mtime == (int64_t) source.st_mtime
+         && header->source_size == (uint64_t) source.st_size;
+}
+
+// Heap ImageMagick may use for the pixels of a decoded image, larger images
+// go to a pixel cache file on disk (in MAGICK_TEMPORARY_PATH)
+const MagickCore::MagickSizeType DECODE_MEMORY = 32 << 20;
+
+// Limits ImageMagick's pixel cache while it exists. The limits are global,
+// so conversions are serialized to restore them consistently
+class PixelCacheLimit {
+public:
+  explicit PixelCacheLimit(const MagickCore::MagickSizeType limit) :
+      lock(mutex()),
+      memory(MagickCore::GetMagickResourceLimit(MagickCore::MemoryResource)),
+      map(MagickCore::GetMagickResourceLimit(MagickCore::MapResource)) {
+    MagickCore::SetMagickResourceLimit(MagickCore::MemoryResource,
+                                       std::min(limit, this->memory));
+    MagickCore::SetMagickResourceLimit(MagickCore::MapResource,
+                                       std::min(limit, this->map));
+  }
+  ~PixelCacheLimit() {
+    MagickCore::SetMagickResourceLimit(MagickCore::MemoryResource, this->memory);
+    MagickCore::SetMagickResourceLimit(MagickCore::MapResource, this->map);
+  }
+private:
+  static std::mutex& mutex() {
+    static std::mutex conversion_mutex;
+    return conversion_mutex;
+  }
+  std::lock_guard<std::mutex> lock;
+  const MagickCore::MagickSizeType memory;
+  const MagickCore::MagickSizeType map;
+};
+
+// Decode the image once and cut it into blocks, one band of block rows at a
+// time. Written to a temporary file first so that readers never see half of
+// it. Coders decode whole images (a crop on read still decodes everything),
+// so the decoded pixels are kept in a disk backed pixel cache instead: the
+// heap peaks at DECODE_MEMORY plus the coder's own buffers plus one band of
+// BLOCK_SIZE rows (width * BLOCK_SIZE * 8 bytes), whatever the image size.
+bool convertImage(const std::string& filename, const std::string& path,
+                  const struct stat& source) {
+  PixelCacheLimit limit(DECODE_MEMORY);
+  Magick::Image img;
+  try {
+    img.ping(filename);   // reads the header only, so bad files fail early
+    if (img.columns() > 0 && img.rows() > 0) img.read(filename);
+  } catch (std::exception& e) {
+    if (e.what()) fprintf(stderr, "Magickimage error: %s\n", e.what());
+    return false;
+  }
+  const size_t width = img.columns();
+  const size_t height = img.rows();
+  if (width == 0 || height == 0) {
+    fprintf(stderr, "No image found.\n");
+    return false;
+  }
+  const std::string tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror("Cannot create block file");
+    return false;
+  }
+  BlockFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+  header.version = BLOCK_VERSION;
+  header.block_size = BLOCK_SIZE;
+  header.width = width;
+  header.height = height;
+  header.source_mtime = source.st_mtime;
+  header.source_size = source.st_size;
+  bool ok = write(fd, &header, sizeof(header)) == sizeof(header);
+
+  const size_t blocks_x = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  std::vector<uint8_t> band(width * BLOCK_SIZE * 4);
+  std::vector<uint8_t> blocks(blocks_x * BLOCK_BYTES);
+  for (size_t y = 0; ok && y < height; y += BLOCK_SIZE) {
+    const size_t rows = std::min(BLOCK_SIZE, height - y);
+    img.write(0, y, width, rows, "RGBA", Magick::CharPixel, band.data());
+    std::fill(blocks.begin(), blocks.end(), 0);   // edge blocks stay empty
+    for (size_t row = 0; row < rows; ++row) {
+      for (size_t bx = 0; bx < blocks_x; ++bx) {
+        const size_t x = bx * BLOCK_SIZE;
+        const size_t columns = std::min(BLOCK_SIZE, width - x);
+        std::memcpy(&blocks[bx * BLOCK_BYTES + row * BLOCK_SIZE * 4],
+                    &band[(row * width + x) * 4], columns * 4);
+      }
+    }
+    ok = write(fd, blocks.data(), blocks.size()) == (ssize_t) blocks.size();
+  }
+  close(fd);
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    fprintf(stderr, "Cannot write block file '%s'\n", path.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// floor modulo, for scrolling to the left or up
+long wrapOffset(const long value, const long size) {
+  const long result = value % size;
+  return result < 0 ? result + size : result;
+}
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+const size_t ImageScroller::BLOCK_SIZE;
+
+ImageScroller::Block::Block() : key(-1), last_used(0), rgba(BLOCK_BYTES, 0) { }
+
+ImageScroller::ImageScroller() : CanvasObject::CanvasObject(), filename(""),
+    image_width(0), image_height(0), blocks_x(0), blocks_y(0), fd(-1),
+    data_offset(sizeof(BlockFileHeader)), scroll(0, 0), scroll_speed(0, 0),
+    wrap_scroll(false), min_cache_blocks(32), cache(), use_clock(0),
+    block_reads(0), prefetch_keys(), prefetching(false) {
+  this->setViewport(this->max_dimensions.x, this->max_dimensions.y);
+}
+ImageScroller::ImageScroller(const std::string filename,
+                             const size_t cache_blocks) : ImageScroller() {
+  this->min_cache_blocks = cache_blocks;
+  this->resizeCache();
+  this->setContent(filename);
+}
+ImageScroller::~ImageScroller() {
+  this->closeBlockFile();
+}
+
+void ImageScroller::setContent(const std::string& filename) {
+  this->closeBlockFile();
+  this->filename = filename;
+  if (!filename.empty()) this->openBlockFile();
+}
+const std::string& ImageScroller::getContent() const {
+  return this->filename;
+}
+size_t ImageScroller::getImageWidth() const   { return this->image_width; }
+size_t ImageScroller::getImageHeight() const  { return this->image_height; }
+
+void ImageScroller::setScroll(const Point& offset)      { this->scroll = offset; }
+const Point& ImageScroller::getScroll() const           { return this->scroll; }
+void ImageScroller::setScrollSpeed(const Point& speed)  { this->scroll_speed = speed; }
+const Point& ImageScroller::getScrollSpeed() const      { return this->scroll_speed; }
+void ImageScroller::setViewport(const size_t width, const size_t height) {
+  this->width = width;
+  this->height = height;
+  this->resizeCache();
+}
+void ImageScroller::setWrapScroll(const bool wrap_scroll) {
+  this->wrap_scroll = wrap_scroll;
+}
+bool ImageScroller::getWrapScroll() const   { return this->wrap_scroll; }
+size_t ImageScroller::getBlockReads() const { return this->block_reads; }
+
+void ImageScroller::openBlockFile() {
+  struct stat source;
+  if (stat(this->filename.c_str(), &source) != 0) {
+    fprintf(stderr, "Cannot open image '%s'\n", this->filename.c_str());
+    return;
+  }
+  const std::string path = blockFilePath(this->filename);
+  BlockFileHeader header;
+  this->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (this->fd < 0 || !readHeader(this->fd, source, &header)) {
+    if (this->fd >= 0) close(this->fd);
+    this->fd = -1;
+    if (!convertImage(this->filename, path, source)) return;
+    this->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->fd < 0 || !readHeader(this->fd, source, &header)) {
+      fprintf(stderr, "Cannot read block file '%s'\n", path.c_str());
+      this->closeBlockFile();
+      return;
+    }
+  }
+  this->image_width = header.width;
+  this->image_height = header.height;
+  this->blocks_x = (header.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  this->blocks_y = (header.height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  this->prefetching = true;
+  this->prefetch_thread = std::thread(&ImageScroller::prefetchLoop, this);
+}
+void ImageScroller::closeBlockFile() {
+  {
+    std::lock_guard<std::mutex> guard(this->cache_mutex);
+    this->prefetching = false;
+    this->prefetch_keys.clear();
+    for (Block& block : this->cache) block.key = -1;
+  }
+  this->prefetch_wanted.notify_all();
+  if (this->prefetch_thread.joinable()) this->prefetch_thread.join();
+  if (this->fd >= 0) close(this->fd);
+  this->fd = -1;
+  this->image_width = 0;
+  this->image_height = 0;
+  this->blocks_x = 0;
+  this->blocks_y = 0;
+}
+
+// Enough blocks for the viewport at any alignment plus one row and column
+// of blocks ahead; only here the cache is (re)allocated
+void ImageScroller::resizeCache() {
+  const size_t columns = (this->width + BLOCK_SIZE - 1) / BLOCK_SIZE + 2;
+  const size_t rows = (this->height + BLOCK_SIZE - 1) / BLOCK_SIZE + 2;
+  std::lock_guard<std::mutex> guard(this->cache_mutex);
+  this->cache.resize(std::max(this->min_cache_blocks, columns * rows));
+}
+
+ImageScroller::Block* ImageScroller::findSlot(const int64_t key) const {
+  for (Block& block : this->cache) {
+    if (block.key == key) return &block;
+  }
+  return nullptr;
+}
+
+bool ImageScroller::readBlock(const int64_t key, uint8_t* rgba) const {
+  const off_t offset = this->data_offset + key * BLOCK_BYTES;
+  if (pread(this->fd, rgba, BLOCK_BYTES, offset) != (ssize_t) BLOCK_BYTES) {
+    return false;
+  }
+  ++this->block_reads;
+  return true;
+}
+
+// Cached block or read now and evict the least recently used one
+const uint8_t* ImageScroller::getBlock(const int64_t key) const {
+  Block* block = this->findSlot(key);
+  if (block == nullptr) {
+    block = &*std::min_element(this->cache.begin(), this->cache.end(),
+        [](const Block& a, const Block& b) { return a.last_used < b.last_used; });
+    block->key = this->readBlock(key, block->rgba.data()) ? key : -1;
+    if (block->key < 0) return nullptr;
+  }
+  block->last_used = ++this->use_clock;
+  return block->rgba.data();
+}
+
+void ImageScroller::wantedBlocks(const Point& offset,
+                                 std::vector<int64_t>* keys) const {
+  const long x0 = std::floor(offset.x);
+  const long y0 = std::floor(offset.y);
+  for (long y = y0; y < y0 + (long) this->height + (long) BLOCK_SIZE; y += BLOCK_SIZE) {
+    long map_y = std::min<long>(y, y0 + this->height - 1);
+    if (this->wrap_scroll) {
+      map_y = wrapOffset(map_y, this->image_height);
+    } else if (map_y < 0 || map_y >= (long) this->image_height) {
+      continue;
+    }
+    for (long x = x0; x < x0 + (long) this->width + (long) BLOCK_SIZE; x += BLOCK_SIZE) {
+      long map_x = std::min<long>(x, x0 + this->width - 1);
+      if (this->wrap_scroll) {
+        map_x = wrapOffset(map_x, this->image_width);
+      } else if (map_x < 0 || map_x >= (long) this->image_width) {
+        continue;
+      }
+      keys->push_back(map_y / BLOCK_SIZE * this->blocks_x + map_x / BLOCK_SIZE);
+    }
+  }
+}
+
+// Move the scroll offset and hand the blocks one block ahead to the
+// prefetch thread
+void ImageScroller::doStep() {
+  CanvasObject::doStep();
+  if (this->scroll_speed.x == 0 && this->scroll_speed.y == 0) return;
+  this->scroll.x += this->scroll_speed.x;
+  this->scroll.y += this->scroll_speed.y;
+  if (this->fd < 0) return;
+  Point ahead = this->scroll;
+  if (this->scroll_speed.x != 0) {
+    ahead.x += this->scroll_speed.x > 0 ? BLOCK_SIZE : -(double) BLOCK_SIZE;
+  }
+  if (this->scroll_speed.y != 0) {
+    ahead.y += this->scroll_speed.y > 0 ? BLOCK_SIZE : -(double) BLOCK_SIZE;
+  }
+  {
+    std::lock_guard<std::mutex> guard(this->cache_mutex);
+    this->prefetch_keys.clear();
+    this->wantedBlocks(ahead, &this->prefetch_keys);
+  }
+  this->prefetch_wanted.notify_one();
+}
+
+void ImageScroller::prefetchLoop() {
+  configureWorkerThread("prefetch");
+  std::vector<int64_t> keys;
+  std::vector<uint8_t> buffer(BLOCK_BYTES);
+  std::unique_lock<std::mutex> lock(this->cache_mutex);
+  while (true) {
+    this->prefetch_wanted.wait(lock, [this] {
+      return !this->prefetching || !this->prefetch_keys.empty();
+    });
+    if (!this->prefetching) break;
+    keys.swap(this->prefetch_keys);
+    this->prefetch_keys.clear();
+    for (const int64_t key : keys) {
+      if (this->findSlot(key) != nullptr) continue;
+      lock.unlock();
+      const bool ok = this->readBlock(key, buffer.data());
+      lock.lock();
+      if (!ok || !this->prefetching || this->findSlot(key) != nullptr) continue;
+      Block* block = &*std::min_element(this->cache.begin(), this->cache.end(),
+          [](const Block& a, const Block& b) { return a.last_used < b.last_used; });
+      block->rgba.swap(buffer);
+      block->key = key;
+      block->last_used = ++this->use_clock;
+    }
+  }
+}
+
+// Like TileMap::draw, walks the rows of the viewport in spans of one block
+void ImageScroller::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible() || this->fd < 0) return;
+  const long image_w = this->image_width;
+  const long image_h = this->image_height;
+  const Point& origin = this->getWorldPosition();
+  const long x0 = std::lround(origin.x);
+  const long y0 = std::lround(origin.y);
+  const long scroll_x = std::floor(this->scroll.x);
+  const long scroll_y = std::floor(this->scroll.y);
+  const long x_begin = std::max(0L, x0);
+  const long x_end = std::min<long>(canvas->width(), x0 + this->width);
+  const long y_begin = std::max(0L, y0);
+  const long y_end = std::min<long>(canvas->height(), y0 + this->height);
+  std::lock_guard<std::mutex> guard(this->cache_mutex);
+  for (long y = y_begin; y < y_end; ++y) {
+    long map_y = y - y0 + scroll_y;
+    if (this->wrap_scroll) {
+      map_y = wrapOffset(map_y, image_h);
+    } else if (map_y < 0 || map_y >= image_h) {
+      continue;
+    }
+    const int64_t block_row = map_y / BLOCK_SIZE * this->blocks_x;
+    const size_t by = map_y % BLOCK_SIZE;
+    long x = x_begin;
+    while (x < x_end) {
+      long map_x = x - x0 + scroll_x;
+      if (this->wrap_scroll) {
+        map_x = wrapOffset(map_x, image_w);
+      } else if (map_x < 0 || map_x >= image_w) {
+        if (map_x >= image_w) break;
+        x -= map_x;
+        continue;
+      }
+      const long bx = map_x % BLOCK_SIZE;
+      // the last block of a row can reach past the image
+      const long span = std::min(std::min<long>(BLOCK_SIZE - bx, x_end - x),
+                                 image_w - map_x);
+      const uint8_t* block = this->getBlock(block_row + map_x / BLOCK_SIZE);
+      if (block != nullptr) {
+        const uint8_t* px = block + (by * BLOCK_SIZE + bx) * 4;
+        for (long i = 0; i < span; ++i, px += 4) {
+          if (px[3] == 0) continue;
+          canvas->SetPixel(x + i, y, px[0], px[1], px[2]);
+        }
+      }
+      x += span;
+    }
+  }
+}
+
+} // end namespace Sprites
@@ -1,10 +1,24 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <mutex>
+#include <sys/eventfd.h>
 #include <sys/time.h>   // gettimeofday function
+#include <unistd.h>
 
+#include "command-trace.h"
+#include "control-server.h"
+#include "event-queue.h"
+#include "frame-arena.h"
+#include "group.h"
 #include "led-loop.h"
 #include "led-matrix.h"
+#include "pixel-canvas.h"
+#include "post-process.h"
+#include "realtime.h"
+#include "shared-table.h"
 #include "sprite.h"
+#include "trace-events.h"
 
 
 namespace led_loop {
@@ -22,11 +36,41 @@ void sleepMillis(tmillis_t milli_seconds) {
   nanosleep(&ts, NULL);
 }
 
-LoopOptions::LoopOptions() : frame_time_ms(50) { }
+Scene::Scene(Sprites::CanvasObjectList* objects, std::mutex* objects_mutex) :
+    objects(objects), objects_mutex(objects_mutex) { }
+FrameTick::FrameTick() : frame(0), present_ms(0), ticks(0) { }
+LoopOptions::LoopOptions() : frame_time_ms(50), thread(), workers(),
+                             lock_memory(false) { }
+LoopStats::LoopStats() : frames(0), missed_deadlines(0), last_frame_ms(0),
+                         max_frame_ms(0), thread_configured(true),
+                         memory_locked(false) { }
 
 AnimationLoop::AnimationLoop() {
   this->frame_time_ms = 50;
   this->is_running = false;
+  this->matrix = nullptr;
+  this->canvas = nullptr;
+  this->canvas_objects = nullptr;
+  this->data_mutex = nullptr;
+  this->frame_count = 0;
+  this->trace_writer = nullptr;
+  this->control_server = nullptr;
+  this->shared_table = nullptr;
+  this->post_process = nullptr;
+  this->frame_buffer = nullptr;
+  this->layer_buffer = nullptr;
+  this->layer_objects = nullptr;
+  this->layer_mutex = nullptr;
+  this->active_scene = "";
+  this->scene_pending = false;
+  this->in_transition = false;
+  this->transition_frames = 0;
+  this->objects_mutex = nullptr;
+  this->event_mask = 0;
+  this->tick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->tick_fd < 0) {
+    perror("Couldn't create frame tick eventfd");
+  }
 }
 AnimationLoop::AnimationLoop(rgb_matrix::RGBMatrix* matrix,
                              Sprites::CanvasObjectList* canvas_objects,
@@ -36,25 +80,52 @@ AnimationLoop::AnimationLoop(rgb_matrix::RGBMatrix* matrix,
   this->matrix = matrix;
   this->canvas = this->matrix->CreateFrameCanvas();
   this->canvas_objects = canvas_objects;
-  // std::string d = "dorie";
-  // fprintf(stderr, "%f\n", this->canvas_objects->at(d)->getPosition().x);
+  this->setOptions(options, data_mutex);
+}
+AnimationLoop::AnimationLoop(rgb_matrix::Canvas* canvas,
+                             Sprites::CanvasObjectList* canvas_objects,
+                             LoopOptions* options,
+                             std::mutex* data_mutex) :
+               AnimationLoop() {
+  this->canvas = canvas;
+  this->canvas_objects = canvas_objects;
+  this->setOptions(options, data_mutex);
+}
+void AnimationLoop::setOptions(LoopOptions* options, std::mutex* data_mutex) {
   if (data_mutex != nullptr) {
     this->data_mutex = data_mutex;
   } else {
     this->data_mutex = new std::mutex;   // do i need to del?
   }
+  this->objects_mutex = this->data_mutex;
+  this->scenes[""] = Scene(this->canvas_objects, this->data_mutex);
   if (options != nullptr) {
     this->frame_time_ms = options->frame_time_ms;
+    this->options = *options;
+    Sprites::setWorkerThreadOptions(options->workers);
   }
+  this->options.frame_time_ms = this->frame_time_ms;
 }
 AnimationLoop::~AnimationLoop() {
   this->is_running = false;
   if(this->animation_thread.joinable()) {
     this->animation_thread.join();
   }
+  delete this->control_server;
+  delete this->shared_table;
+  delete this->trace_writer;
+  delete this->post_process;
+  delete this->frame_buffer;
+  delete this->layer_buffer;
+  if (this->tick_fd >= 0) close(this->tick_fd);
 }
 
 void AnimationLoop::startLoop() {
+  if (this->options.lock_memory) {
+    const bool locked = Sprites::lockMemory();
+    std::lock_guard<std::mutex> guard(this->tick_mutex);
+    this->stats.memory_locked = locked;
+  }
   this->is_running = true;
   this->animation_thread = std::thread(&AnimationLoop::animation_loop, this);
 }
@@ -68,27 +139,347 @@ const std::thread& AnimationLoop::getThread() const {
   return this->animation_thread;
 }
 void AnimationLoop::animation_loop() {
+  Sprites::TraceEvents::setThreadName("animation loop");
+  const bool configured = Sprites::applyThreadOptions(this->options.thread,
+                                                      "animation");
+  {
+    std::lock_guard<std::mutex> guard(this->tick_mutex);
+    this->stats.thread_configured = configured;
+  }
+  fprintf(stdout, "Animation thread: %s%s, %lld ms per frame; workers: %s\n",
+          Sprites::describeThreadOptions(this->options.thread).c_str(),
+          this->stats.memory_locked ? ", memory locked" : "",
+          this->frame_time_ms,
+          Sprites::describeThreadOptions(Sprites::getWorkerThreadOptions()).c_str());
   while (this->is_running) {
     this->doFrame();
   }
 }
 
 void AnimationLoop::prepareFrame() {
+  Sprites::ScopedTrace trace("prepareFrame");
+  this->frame_arena.reset();
+  Sprites::ArenaScope arena_scope(&this->frame_arena);
+  Sprites::FrameClockScope clock_scope;
   this->canvas->Clear();
-  std::lock_guard<std::mutex> guard(*(this->data_mutex));
-  for (auto &sprite_pair : *(this->canvas_objects)) {
-    Sprites::CanvasObject* sprite = sprite_pair.second;
+  Sprites::lockTraced(this->data_mutex, "wait data_mutex");
+  std::lock_guard<std::mutex> guard(*(this->data_mutex), std::adopt_lock);
+  this->updateScene();
+  std::unique_lock<std::mutex> objects_lock;
+  if (this->objects_mutex != this->data_mutex) {
+    Sprites::lockTraced(this->objects_mutex, "wait objects_mutex");
+    objects_lock = std::unique_lock<std::mutex>(*(this->objects_mutex),
+                                                std::adopt_lock);
+  }
+  if (this->control_server != nullptr) {
+    Sprites::ScopedTrace commands_trace("apply commands");
+    this->control_server->takeMessages(&this->pending_messages);
+    for (const Message& msg : this->pending_messages) {
+      if (applyCommand(msg, this->canvas_objects) != 0) {
+        fprintf(stderr, "Command failed:\n");
+        msg.print();
+      }
+    }
+  }
+  if (this->shared_table != nullptr) {
+    Sprites::ScopedTrace sync_trace("sync shared table");
+    this->shared_table->sync(this->canvas_objects);
+  }
+  if (this->trace_writer != nullptr) {
+    this->trace_writer->capture(this->frame_count, this->canvas_objects);
+  }
+  PostProcess* post = this->post_process;
+  if (post != nullptr) post->step();
+  if (post == nullptr || !post->isActive()) {
+    this->drawObjects(this->canvas_objects, &this->draw_order, this->canvas);
+  } else {
+    // render into memory so the whole frame can be color graded at once
+    if (this->frame_buffer == nullptr) {
+      this->frame_buffer = new Sprites::PixelCanvas(this->canvas->width(),
+                                                    this->canvas->height());
+    }
+    this->frame_buffer->Clear();
+    this->drawObjects(this->canvas_objects, &this->draw_order,
+                      this->frame_buffer);
+    const bool blend = this->layer_objects != nullptr
+                       && post->getLayerAlpha() > 0;
+    if (blend) {
+      if (this->layer_buffer == nullptr) {
+        this->layer_buffer = new Sprites::PixelCanvas(this->canvas->width(),
+                                                      this->canvas->height());
+      }
+      this->layer_buffer->Clear();
+      const bool lock_layer = this->layer_mutex != this->data_mutex
+                              && this->layer_mutex != this->objects_mutex;
+      if (lock_layer) Sprites::lockTraced(this->layer_mutex, "wait layer_mutex");
+      this->drawObjects(this->layer_objects, &this->layer_draw_order,
+                        this->layer_buffer);
+      if (lock_layer) this->layer_mutex->unlock();
+    }
+    Sprites::ScopedTrace post_trace("post process");
+    post->apply(this->frame_buffer, blend ? this->layer_buffer : nullptr);
+    this->frame_buffer->copyTo(this->canvas);
+  }
+  if (this->trace_writer != nullptr) {
+    this->trace_writer->snapshot(this->canvas_objects);
+  }
+}
+void AnimationLoop::drawObjects(Sprites::CanvasObjectList* canvas_objects,
+                                std::vector<Sprites::CanvasObject*>* draw_order,
+                                rgb_matrix::Canvas* canvas) {
+  Sprites::ScopedTrace trace("draw objects");
+  draw_order->clear();
+  for (auto &sprite_pair : *canvas_objects) {
+    draw_order->push_back(sprite_pair.second);
+  }
+  Sprites::sortByZ(draw_order);
+  const uint8_t event_mask = this->event_mask.load(std::memory_order_relaxed);
+  for (Sprites::CanvasObject* sprite : *draw_order) {
     sprite->doStep();
-    sprite->draw(this->canvas);
+    if (event_mask != 0) this->queueEvents(sprite, event_mask);
+    sprite->draw(canvas);
+  }
+  this->event_queue.signal();
+}
+void AnimationLoop::queueEvents(const Sprites::CanvasObject* object,
+                                const uint8_t mask) {
+  const uint8_t events = object->getStepEvents() & mask;
+  for (uint8_t type = 1; type <= events; type <<= 1) {
+    if (events & type) this->event_queue.push(this->frame_count, type, *object);
+  }
+  const Sprites::Group* group = dynamic_cast<const Sprites::Group*>(object);
+  if (group == nullptr) return;
+  for (const Sprites::CanvasObject* child : group->getChildren()) {
+    this->queueEvents(child, mask);
   }
 }
 void AnimationLoop::doFrame() {
   const tmillis_t start_ms = getTimeInMillis();
-  this->prepareFrame();
-  this->canvas = this->matrix->SwapOnVSync(this->canvas, 1);
+  {
+    Sprites::ScopedTrace trace("doFrame");
+    this->prepareFrame();
+    if (this->matrix != nullptr) {
+      Sprites::ScopedTrace swap_trace("SwapOnVSync");
+      this->canvas = this->matrix->SwapOnVSync(
+          static_cast<rgb_matrix::FrameCanvas*>(this->canvas), 1);
+    }
+    ++this->frame_count;
+    this->signalTick();
+  }
   const tmillis_t time_already_spent = getTimeInMillis() - start_ms;
+  {
+    std::lock_guard<std::mutex> guard(this->tick_mutex);
+    this->stats.frames = this->frame_count;
+    this->stats.last_frame_ms = time_already_spent;
+    this->stats.max_frame_ms = std::max(this->stats.max_frame_ms,
+                                        time_already_spent);
+    if (this->frame_time_ms > 0 && time_already_spent > this->frame_time_ms) {
+      ++this->stats.missed_deadlines;
+    }
+  }
   sleepMillis(this->frame_time_ms - time_already_spent);
 }
+uint32_t AnimationLoop::getFrameCount() const {
+  return this->frame_count;
+}
+void AnimationLoop::getStats(LoopStats* stats) {
+  std::lock_guard<std::mutex> guard(this->tick_mutex);
+  *stats = this->stats;
+}
+const LoopOptions& AnimationLoop::getOptions() const {
+  return this->options;
+}
+
+void AnimationLoop::signalTick() {
+  if (this->tick_fd < 0) return;
+  {
+    std::lock_guard<std::mutex> guard(this->tick_mutex);
+    this->last_tick.frame = this->frame_count;
+    this->last_tick.present_ms = getTimeInMillis();
+  }
+  const uint64_t one = 1;
+  // only fails (EAGAIN) if nobody read for 2^64 frames
+  if (write(this->tick_fd, &one, sizeof(one)) < 0) { }
+}
+int AnimationLoop::getTickFd() const {
+  return this->tick_fd;
+}
+bool AnimationLoop::readTick(FrameTick* tick) {
+  uint64_t ticks;
+  if (this->tick_fd < 0 || read(this->tick_fd, &ticks, sizeof(ticks)) < 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(this->tick_mutex);
+  *tick = this->last_tick;
+  tick->ticks = ticks;
+  return true;
+}
+
+// Object events (see event-queue.h)
+void AnimationLoop::setEventMask(const uint8_t mask) {
+  this->event_mask.store(mask, std::memory_order_relaxed);
+}
+uint8_t AnimationLoop::getEventMask() const {
+  return this->event_mask.load(std::memory_order_relaxed);
+}
+int AnimationLoop::getEventFd() const {
+  return this->event_queue.getFd();
+}
+size_t AnimationLoop::readEvents(EventRecord* events, const size_t max_events) {
+  return this->event_queue.pop(events, max_events);
+}
+uint64_t AnimationLoop::getDroppedEvents() const {
+  return this->event_queue.getDropped();
+}
+
+// Record all changes to the scene into a command trace (see command-trace.h)
+bool AnimationLoop::startTrace(const std::string& filename) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->trace_writer == nullptr) {
+    this->trace_writer = new CommandTraceWriter();
+  }
+  return this->trace_writer->open(filename, this->frame_time_ms);
+}
+void AnimationLoop::stopTrace() {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->trace_writer != nullptr) this->trace_writer->close();
+}
+
+bool AnimationLoop::startControlServer(const std::string& socket_path) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->control_server == nullptr) {
+    this->control_server = new ControlServer();
+  }
+  return this->control_server->start(socket_path, this->frame_time_ms);
+}
+void AnimationLoop::stopControlServer() {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->control_server != nullptr) this->control_server->stop();
+}
+
+bool AnimationLoop::startSharedTable(const std::string& name,
+                                     const uint32_t capacity) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->shared_table == nullptr) {
+    this->shared_table = new SharedTable();
+  }
+  return this->shared_table->create(name, capacity);
+}
+void AnimationLoop::stopSharedTable() {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->shared_table != nullptr) this->shared_table->close();
+}
+
+// Needs the data mutex
+PostProcess* AnimationLoop::getPostProcess() {
+  if (this->post_process == nullptr) this->post_process = new PostProcess();
+  return this->post_process;
+}
+void AnimationLoop::setFade(const double brightness, const uint32_t frames) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  this->getPostProcess()->setFade(brightness, frames);
+}
+void AnimationLoop::setGamma(const double gamma) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  this->getPostProcess()->setGamma(gamma);
+}
+void AnimationLoop::setTint(const uint8_t red, const uint8_t green,
+                            const uint8_t blue) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  this->getPostProcess()->setTint(red, green, blue);
+}
+void AnimationLoop::setInvert(const bool invert) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  this->getPostProcess()->setInvert(invert);
+}
+void AnimationLoop::setLayer(Sprites::CanvasObjectList* layer_objects,
+                             std::mutex* layer_mutex) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  this->layer_objects = layer_objects;
+  this->layer_mutex = layer_mutex != nullptr ? layer_mutex : this->data_mutex;
+}
+void AnimationLoop::setLayerAlpha(const double alpha, const uint32_t frames) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  this->getPostProcess()->setLayerAlpha(alpha, frames);
+}
+
+bool AnimationLoop::addScene(const std::string& name,
+                             Sprites::CanvasObjectList* objects,
+                             std::mutex* objects_mutex) {
+  if (objects == nullptr) return false;
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->isSceneShown(name)) {
+    fprintf(stderr, "Cannot replace scene '%s' while it is shown\n", name.c_str());
+    return false;
+  }
+  this->scenes[name] = Scene(objects, objects_mutex != nullptr ? objects_mutex
+                                                               : this->data_mutex);
+  return true;
+}
+bool AnimationLoop::removeScene(const std::string& name) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->isSceneShown(name)) {
+    fprintf(stderr, "Cannot remove scene '%s' while it is shown\n", name.c_str());
+    return false;
+  }
+  return this->scenes.erase(name) > 0;
+}
+bool AnimationLoop::switchScene(const std::string& name, const uint32_t frames) {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  if (this->scenes.count(name) == 0) {
+    fprintf(stderr, "No scene '%s'\n", name.c_str());
+    return false;
+  }
+  this->next_scene = name;
+  this->scene_pending = true;
+  this->transition_frames = frames;
+  return true;
+}
+// The active scene or the one that will become active
+bool AnimationLoop::isSceneShown(const std::string& name) const {
+  if (name == this->active_scene) return true;
+  return (this->scene_pending || this->in_transition) && name == this->next_scene;
+}
+std::string AnimationLoop::getActiveScene() const {
+  std::lock_guard<std::mutex> guard(*(this->data_mutex));
+  return this->active_scene;
+}
+
+// At the frame boundary, needs the data mutex. The switch itself only swaps
+// pointers, the objects of the new scene were prepared beforehand
+void AnimationLoop::updateScene() {
+  bool activate = false;
+  if (this->scene_pending) {
+    this->scene_pending = false;
+    if (this->in_transition) {    // a new switch interrupts the transition
+      this->in_transition = false;
+      this->layer_objects = nullptr;
+      this->getPostProcess()->setLayerAlpha(0);
+    }
+    if (this->next_scene == this->active_scene) return;
+    if (this->transition_frames == 0) {
+      activate = true;
+    } else {
+      const Scene& scene = this->scenes[this->next_scene];
+      this->layer_objects = scene.objects;
+      this->layer_mutex = scene.objects_mutex;
+      this->getPostProcess()->setLayerAlpha(0);
+      this->post_process->setLayerAlpha(1, this->transition_frames);
+      this->in_transition = true;
+    }
+  } else if (this->in_transition && this->post_process->getLayerAlpha() >= 1) {
+    activate = true;
+    this->in_transition = false;
+    this->layer_objects = nullptr;
+    this->post_process->setLayerAlpha(0);
+  }
+  if (activate) {
+    const Scene& scene = this->scenes[this->next_scene];
+    this->canvas_objects = scene.objects;
+    this->objects_mutex = scene.objects_mutex;
+    this->active_scene = this->next_scene;
+  }
+}
 
 void AnimationLoop::lock_canvas_objects() {
   this->data_mutex->lock();
@@ -100,7 +491,12 @@ std::mutex* AnimationLoop::getMutex() const {
   return this->data_mutex;
 }
 void AnimationLoop::setMutex(std::mutex* data_mutex) {
+  if (this->objects_mutex == this->data_mutex) this->objects_mutex = data_mutex;
+  this->scenes[""].objects_mutex = data_mutex;
   this->data_mutex = data_mutex;
 }
+rgb_matrix::Canvas* AnimationLoop::getCanvas() {
+  return this->canvas;
+}
 
 } // end namespace led_loop
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "canvas.h"
+#include "live-feed.h"
+#include "realtime.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+PixelFormat resolvePixelFormat(const std::string& str) {
+  if (str == "bgr24") return BGR24;
+  if (str == "rgb565" || str == "rgb565le") return RGB565;
+  if (str != "rgb24") fprintf(stderr, "Unknown pixel format '%s'\n", str.c_str());
+  return RGB24;
+}
+size_t bytesPerPixel(const PixelFormat format) {
+  return format == RGB565 ? 2 : 3;
+}
+
+
+LiveFeed::LiveFeed() : CanvasObject::CanvasObject(), source(""),
+                       format(RGB24), frame_size(0), middle(1), front(0),
+                       has_frame(false), frames_received(0), frames_shown(0),
+                       reading(false) { }
+LiveFeed::LiveFeed(const std::string source, size_t width, size_t height,
+                   PixelFormat format) : LiveFeed() {
+  this->width = width;
+  this->height = height;
+  this->format = format;
+  // allocated once: switching the source keeps the buffers that draw() reads
+  this->frame_size = width * height * bytesPerPixel(format);
+  this->buffers.assign(this->frame_size * 3, 0);
+  this->setContent(source);
+}
+LiveFeed::~LiveFeed() {
+  this->stopReader();
+}
+
+void LiveFeed::setContent(const std::string& source) {
+  this->stopReader();
+  this->source = source;
+  this->startReader();
+}
+const std::string& LiveFeed::getContent() const     { return this->source; }
+const PixelFormat& LiveFeed::getFormat() const      { return this->format; }
+size_t LiveFeed::getFramesReceived() const          { return this->frames_received; }
+size_t LiveFeed::getFramesShown() const             { return this->frames_shown; }
+
+// The shown frame stays on the panel until the new source delivers one. The
+// reader starts with the one slot that is neither shown nor published; front
+// only changes in doStep(), which runs under the same list mutex as this.
+void LiveFeed::startReader() {
+  if (this->source.empty() || this->frame_size == 0) return;
+  const uint8_t back = 3 - this->front - (this->middle.load() & ~FRESH_FRAME);
+  this->reading = true;
+  this->reader_thread = std::thread(&LiveFeed::readLoop, this, back);
+}
+void LiveFeed::stopReader() {
+  this->reading = false;
+  if (this->reader_thread.joinable()) this->reader_thread.join();
+}
+
+int LiveFeed::openSource() const {
+  if (this->source == "-") return dup(STDIN_FILENO);
+  struct stat st;
+  if (stat(this->source.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, this->source.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+  // non-blocking, so that opening a FIFO does not wait for a writer
+  return open(this->source.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+// Reads frames into the back buffer and swaps it with the middle one once a
+// frame is complete. Reconnects when the producer goes away.
+void LiveFeed::readLoop(uint8_t back) {
+  configureWorkerThread("live feed");
+  size_t filled = 0;
+  int fd = -1;
+  while (this->reading) {
+    if (fd < 0) {
+      fd = this->openSource();
+      filled = 0;
+      if (fd < 0) {
+        poll(NULL, 0, 100);
+        continue;
+      }
+    }
+    struct pollfd pollfd;
+    pollfd.fd = fd;
+    pollfd.events = POLLIN;
+    pollfd.revents = 0;
+    if (poll(&pollfd, 1, 100) <= 0) continue;
+    uint8_t* target = &this->buffers[back * this->frame_size];
+    ssize_t n = read(fd, target + filled, this->frame_size - filled);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+    if (n <= 0) {
+      // producer closed (or no writer on the FIFO yet): start over
+      close(fd);
+      fd = -1;
+      if (this->source == "-") break;
+      poll(NULL, 0, 100);
+      continue;
+    }
+    filled += n;
+    if (filled < this->frame_size) continue;
+    back = this->middle.exchange(back | FRESH_FRAME) & ~FRESH_FRAME;
+    ++this->frames_received;
+    filled = 0;
+  }
+  if (fd >= 0) close(fd);
+}
+
+void LiveFeed::doStep() {
+  CanvasObject::doStep();
+  if (!(this->middle.load() & FRESH_FRAME)) return;
+  this->front = this->middle.exchange(this->front) & ~FRESH_FRAME;
+  this->has_frame = true;
+  ++this->frames_shown;
+}
+
+void LiveFeed::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible() || !this->has_frame) return;
+  const uint8_t* frame = &this->buffers[this->front * this->frame_size];
+  const size_t bpp = bytesPerPixel(this->format);
+  const int x0 = std::round(this->getWorldPosition().x);
+  const int y0 = std::round(this->getWorldPosition().y);
+  const int x_start = std::max(0, -x0);
+  const int y_start = std::max(0, -y0);
+  const int x_end = std::min<int>(this->width, canvas->width() - x0);
+  const int y_end = std::min<int>(this->height, canvas->height() - y0);
+  for (int y = y_start; y < y_end; ++y) {
+    const uint8_t* px = frame + (y * this->width + x_start) * bpp;
+    for (int x = x_start; x < x_end; ++x, px += bpp) {
+      if (this->format == RGB24) {
+        canvas->SetPixel(x0 + x, y0 + y, px[0], px[1], px[2]);
+      } else if (this->format == BGR24) {
+        canvas->SetPixel(x0 + x, y0 + y, px[2], px[1], px[0]);
+      } else {
+        const uint16_t v = px[0] | (px[1] << 8);
+        canvas->SetPixel(x0 + x, y0 + y, (v >> 8) & 0xf8, (v >> 3) & 0xfc,
+                         (v << 3) & 0xf8);
+      }
+    }
+  }
+}
+
+} // end namespace Sprites
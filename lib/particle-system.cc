@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "canvas.h"
+#include "particle-system.h"
+#include "sprite.h"
+
+
+namespace Sprites {
+
+EmitterSettings::EmitterSettings() :
+    rate(0), min_lifetime(50), max_lifetime(100), min_speed(0.5),
+    max_speed(1.5), direction(270), spread(60), gravity_x(0), gravity_y(0.02),
+    drag(1), start_color{255, 255, 255}, end_color{0, 0, 0}, area_width(1),
+    area_height(1) { }
+
+
+ParticleSystem::ParticleSystem() : ParticleSystem("", 4096) { }
+ParticleSystem::ParticleSystem(const std::string name, const size_t capacity) :
+    CanvasObject::CanvasObject(), name(name), settings(), capacity(capacity),
+    count(0), spawn_debt(0), rng_state(2463534242u),
+    x(capacity), y(capacity), vx(capacity), vy(capacity), age(capacity),
+    aging(capacity),
+    accumulator(this->max_dimensions.x * this->max_dimensions.y * 3) {
+  this->width = 1;
+  this->height = 1;
+}
+
+void ParticleSystem::setContent(const std::string& name)  { this->name = name; }
+const std::string& ParticleSystem::getContent() const    { return this->name; }
+
+void ParticleSystem::setSettings(const EmitterSettings& settings) {
+  this->settings = settings;
+  this->settings.min_lifetime = std::max<uint32_t>(settings.min_lifetime, 1);
+  this->settings.max_lifetime = std::max(settings.max_lifetime,
+                                         this->settings.min_lifetime);
+  this->width = std::max(1.0, std::ceil(settings.area_width));
+  this->height = std::max(1.0, std::ceil(settings.area_height));
+}
+const EmitterSettings& ParticleSystem::getSettings() const {
+  return this->settings;
+}
+void ParticleSystem::burst(const size_t n)      { this->spawn(n); }
+size_t ParticleSystem::getCount() const         { return this->count; }
+size_t ParticleSystem::getCapacity() const      { return this->capacity; }
+
+// xorshift32, plenty for confetti
+uint32_t ParticleSystem::nextRandom() {
+  uint32_t state = this->rng_state;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return this->rng_state = state;
+}
+float ParticleSystem::uniform(const float min, const float max) {
+  return min + (max - min) * (this->nextRandom() >> 8) * (1.0f / 16777216.0f);
+}
+
+void ParticleSystem::spawn(size_t n) {
+  n = std::min(n, this->capacity - this->count);
+  const EmitterSettings& s = this->settings;
+  const Point& origin = this->getWorldPosition();
+  const float direction = s.direction * M_PI / 180;
+  const float spread = s.spread * M_PI / 180;
+  for (size_t i = this->count; i < this->count + n; ++i) {
+    const float angle = direction + this->uniform(-spread / 2, spread / 2);
+    const float speed = this->uniform(s.min_speed, s.max_speed);
+    this->x[i] = origin.x + this->uniform(0, s.area_width);
+    this->y[i] = origin.y + this->uniform(0, s.area_height);
+    this->vx[i] = std::cos(angle) * speed;
+    this->vy[i] = std::sin(angle) * speed;
+    this->age[i] = 0;
+    this->aging[i] = 1.0f / this->uniform(s.min_lifetime, s.max_lifetime + 1);
+  }
+  this->count += n;
+}
+
+void ParticleSystem::update() {
+  const float gx = this->settings.gravity_x;
+  const float gy = this->settings.gravity_y;
+  const float drag = this->settings.drag;
+  const size_t n = this->count;
+  float* __restrict__ px = this->x.data();
+  float* __restrict__ py = this->y.data();
+  float* __restrict__ pvx = this->vx.data();
+  float* __restrict__ pvy = this->vy.data();
+  float* __restrict__ page = this->age.data();
+  const float* __restrict__ paging = this->aging.data();
+  // branch free, so the compiler can vectorize these loops
+  for (size_t i = 0; i < n; ++i) {
+    pvx[i] = (pvx[i] + gx) * drag;
+    pvy[i] = (pvy[i] + gy) * drag;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    px[i] += pvx[i];
+    py[i] += pvy[i];
+    page[i] += paging[i];
+  }
+  // remove the dead ones by moving the last live particle into their place
+  size_t i = 0;
+  while (i < this->count) {
+    if (page[i] < 1) {
+      ++i;
+      continue;
+    }
+    const size_t last = --this->count;
+    px[i] = px[last];
+    py[i] = py[last];
+    pvx[i] = pvx[last];
+    pvy[i] = pvy[last];
+    page[i] = page[last];
+    this->aging[i] = paging[last];
+  }
+}
+
+void ParticleSystem::doStep() {
+  CanvasObject::doStep();
+  this->update();
+  this->spawn_debt += this->settings.rate;
+  if (this->spawn_debt >= 1) {
+    const size_t n = this->spawn_debt;
+    this->spawn_debt -= n;
+    this->spawn(n);
+  }
+}
+
+void ParticleSystem::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisibleSetting() || this->count == 0) return;
+  const int panel_width = std::min<int>(canvas->width(), this->max_dimensions.x);
+  const int panel_height = std::min<int>(canvas->height(), this->max_dimensions.y);
+  const EmitterSettings& s = this->settings;
+  const float start[3] = {(float)s.start_color[0], (float)s.start_color[1],
+                          (float)s.start_color[2]};
+  const float delta[3] = {(float)s.end_color[0] - start[0],
+                          (float)s.end_color[1] - start[1],
+                          (float)s.end_color[2] - start[2]};
+  uint32_t* acc = this->accumulator.data();
+  int x_min = panel_width, y_min = panel_height, x_max = -1, y_max = -1;
+  for (size_t i = 0; i < this->count; ++i) {
+    const int px = std::lround(this->x[i]);
+    const int py = std::lround(this->y[i]);
+    if (px < 0 || py < 0 || px >= panel_width || py >= panel_height) continue;
+    uint32_t* pixel = acc + (py * this->max_dimensions.x + px) * 3;
+    const float t = this->age[i];
+    pixel[0] += start[0] + delta[0] * t;
+    pixel[1] += start[1] + delta[1] * t;
+    pixel[2] += start[2] + delta[2] * t;
+    x_min = std::min(x_min, px);
+    x_max = std::max(x_max, px);
+    y_min = std::min(y_min, py);
+    y_max = std::max(y_max, py);
+  }
+  // draw and clear only the box the particles touched
+  for (int py = y_min; py <= y_max; ++py) {
+    uint32_t* row = acc + (py * this->max_dimensions.x + x_min) * 3;
+    for (int px = x_min; px <= x_max; ++px, row += 3) {
+      if ((row[0] | row[1] | row[2]) == 0) continue;
+      canvas->SetPixel(px, py, std::min<uint32_t>(row[0], 255),
+                       std::min<uint32_t>(row[1], 255),
+                       std::min<uint32_t>(row[2], 255));
+      row[0] = row[1] = row[2] = 0;
+    }
+  }
+}
+
+} // end namespace Sprites
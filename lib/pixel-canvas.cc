@@ -0,0 +1,63 @@
+#include <cstring>
+
+#include "canvas.h"
+#include "pixel-canvas.h"
+
+
+namespace Sprites {
+
+PixelCanvas::PixelCanvas(int width, int height) :
+    canvas_width(width), canvas_height(height), data(width * height * 3, 0) { }
+PixelCanvas::~PixelCanvas() { }
+
+int PixelCanvas::width() const  { return this->canvas_width; }
+int PixelCanvas::height() const { return this->canvas_height; }
+
+void PixelCanvas::SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue) {
+  if (x < 0 || x >= this->canvas_width || y < 0 || y >= this->canvas_height) return;
+  uint8_t* px = &this->data[(y * this->canvas_width + x) * 3];
+  px[0] = red;
+  px[1] = green;
+  px[2] = blue;
+}
+void PixelCanvas::blendPixel(int x, int y, uint8_t red, uint8_t green,
+                             uint8_t blue, uint8_t alpha) {
+  if (x < 0 || x >= this->canvas_width || y < 0 || y >= this->canvas_height) return;
+  uint8_t* px = &this->data[(y * this->canvas_width + x) * 3];
+  px[0] += (red - px[0]) * alpha / 255;
+  px[1] += (green - px[1]) * alpha / 255;
+  px[2] += (blue - px[2]) * alpha / 255;
+}
+void PixelCanvas::Clear() {
+  std::memset(this->data.data(), 0, this->data.size());
+}
+void PixelCanvas::Fill(uint8_t red, uint8_t green, uint8_t blue) {
+  for (size_t i = 0; i < this->data.size(); i += 3) {
+    this->data[i] = red;
+    this->data[i + 1] = green;
+    this->data[i + 2] = blue;
+  }
+}
+
+const Pixel PixelCanvas::getPixel(int x, int y) const {
+  if (x < 0 || x >= this->canvas_width || y < 0 || y >= this->canvas_height) {
+    return Pixel();
+  }
+  const uint8_t* px = &this->data[(y * this->canvas_width + x) * 3];
+  return Pixel(px[0], px[1], px[2]);
+}
+uint8_t* PixelCanvas::getData()             { return this->data.data(); }
+const uint8_t* PixelCanvas::getData() const { return this->data.data(); }
+size_t PixelCanvas::getSize() const         { return this->data.size(); }
+
+// Push the whole frame to another canvas (usually the panel's FrameCanvas)
+void PixelCanvas::copyTo(rgb_matrix::Canvas* canvas) const {
+  const uint8_t* px = this->data.data();
+  for (int y = 0; y < this->canvas_height; ++y) {
+    for (int x = 0; x < this->canvas_width; ++x, px += 3) {
+      canvas->SetPixel(x, y, px[0], px[1], px[2]);
+    }
+  }
+}
+
+} // end namespace Sprites
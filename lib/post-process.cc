@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "pixel-canvas.h"
+#include "post-process.h"
+
+
+namespace led_loop {
+
+PostProcess::Ramp::Ramp(const double value) :
+    value(value), target(value), increment(0), frames_left(0) { }
+
+void PostProcess::Ramp::set(const double target, const uint32_t frames) {
+  this->target = target;
+  if (frames == 0) {
+    this->value = target;
+    this->frames_left = 0;
+  } else {
+    this->increment = (target - this->value) / frames;
+    this->frames_left = frames;
+  }
+}
+// true if the value changed
+bool PostProcess::Ramp::advance() {
+  if (this->frames_left == 0) return false;
+  if (--this->frames_left == 0) {
+    this->value = this->target;
+  } else {
+    this->value += this->increment;
+  }
+  return true;
+}
+
+
+PostProcess::PostProcess() : fade(1), alpha(0), gamma(1), tint{255, 255, 255},
+                             invert(false), identity(true), lut_stale(true) {
+  this->buildLUT();
+}
+
+void PostProcess::setFade(const double brightness, const uint32_t frames) {
+  this->fade.set(std::max(0.0, std::min(1.0, brightness)), frames);
+  this->lut_stale = true;
+}
+double PostProcess::getFade() const { return this->fade.value; }
+void PostProcess::setGamma(const double gamma) {
+  this->gamma = gamma > 0 ? gamma : 1;
+  this->lut_stale = true;
+}
+void PostProcess::setTint(const uint8_t red, const uint8_t green,
+                          const uint8_t blue) {
+  this->tint[0] = red;
+  this->tint[1] = green;
+  this->tint[2] = blue;
+  this->lut_stale = true;
+}
+void PostProcess::setInvert(const bool invert) {
+  this->invert = invert;
+  this->lut_stale = true;
+}
+void PostProcess::setLayerAlpha(const double alpha, const uint32_t frames) {
+  this->alpha.set(std::max(0.0, std::min(1.0, alpha)), frames);
+}
+double PostProcess::getLayerAlpha() const { return this->alpha.value; }
+
+void PostProcess::step() {
+  this->alpha.advance();
+  if (this->fade.advance()) this->lut_stale = true;
+  if (this->lut_stale) this->buildLUT();
+}
+
+bool PostProcess::isActive() const {
+  return !this->identity || this->alpha.value > 0;
+}
+
+void PostProcess::buildLUT() {
+  uint8_t curve[256];
+  for (int i = 0; i < 256; ++i) {
+    double value = i / 255.0;
+    if (this->invert) value = 1 - value;
+    if (this->gamma != 1) value = std::pow(value, this->gamma);
+    curve[i] = std::lround(value * 255 * this->fade.value);
+  }
+  this->identity = true;
+  for (int c = 0; c < 3; ++c) {
+    for (int i = 0; i < 256; ++i) {
+      this->lut[c][i] = (curve[i] * this->tint[c] + 127) / 255;
+      if (this->lut[c][i] != i) this->identity = false;
+    }
+  }
+  this->lut_stale = false;
+}
+
+void PostProcess::apply(Sprites::PixelCanvas* frame,
+                        const Sprites::PixelCanvas* layer) const {
+  uint8_t* __restrict__ data = frame->getData();
+  const size_t size = frame->getSize();
+  const uint32_t alpha = std::lround(this->alpha.value * 256);
+  if (layer != nullptr && alpha > 0 && layer->getSize() == size) {
+    const uint8_t* __restrict__ over = layer->getData();
+    const uint32_t keep = 256 - alpha;
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = (data[i] * keep + over[i] * alpha) >> 8;
+    }
+  }
+  if (this->identity) return;
+  for (size_t i = 0; i < size; i += 3) {
+    data[i] = this->lut[0][data[i]];
+    data[i + 1] = this->lut[1][data[i + 1]];
+    data[i + 2] = this->lut[2][data[i + 2]];
+  }
+}
+
+} // end namespace led_loop
@@ -0,0 +1,180 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+
+
+namespace {
+
+std::mutex& workerMutex() {
+  static std::mutex worker_mutex;
+  return worker_mutex;
+}
+Sprites::ThreadOptions& workerOptions() {
+  static Sprites::ThreadOptions worker_options;
+  return worker_options;
+}
+
+int64_t steadyMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+// -1 outside of a frame
+thread_local int64_t frame_ms = -1;
+
+const char* policyName(const int policy) {
+  switch (policy) {
+    case SCHED_FIFO:  return "SCHED_FIFO";
+    case SCHED_RR:    return "SCHED_RR";
+    case SCHED_OTHER: return "SCHED_OTHER";
+    default:          return "unknown policy";
+  }
+}
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+ThreadOptions::ThreadOptions() : policy(SCHED_OTHER), priority(0), cpus() { }
+bool ThreadOptions::isRealtime() const {
+  return this->policy == SCHED_FIFO || this->policy == SCHED_RR;
+}
+
+bool applyThreadOptions(const ThreadOptions& options, const char* name) {
+  bool ok = true;
+  if (options.policy != SCHED_OTHER) {
+    struct sched_param param;
+    param.sched_priority = options.priority;
+    const int err = pthread_setschedparam(pthread_self(), options.policy, &param);
+    if (err != 0) {
+      fprintf(stderr, "Cannot schedule the %s thread with %s: %s\n", name,
+              describeThreadOptions(options).c_str(), strerror(err));
+      ok = false;
+    }
+  }
+  if (!options.cpus.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const int cpu : options.cpus) CPU_SET(cpu, &cpu_set);
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (err != 0) {
+      fprintf(stderr, "Cannot pin the %s thread: %s\n", name, strerror(err));
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void setWorkerThreadOptions(const ThreadOptions& options) {
+  std::lock_guard<std::mutex> guard(workerMutex());
+  workerOptions() = options;
+}
+ThreadOptions getWorkerThreadOptions() {
+  std::lock_guard<std::mutex> guard(workerMutex());
+  return workerOptions();
+}
+bool configureWorkerThread(const char* name) {
+  return applyThreadOptions(getWorkerThreadOptions(), name);
+}
+
+bool lockMemory() {
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("Cannot lock the memory");
+    return false;
+  }
+  return true;
+}
+
+std::string describeThreadOptions(const ThreadOptions& options) {
+  std::string description = policyName(options.policy);
+  if (options.isRealtime()) {
+    description += " priority " + std::to_string(options.priority);
+  }
+  if (!options.cpus.empty()) {
+    description += " on CPUs ";
+    for (size_t i = 0; i < options.cpus.size(); ++i) {
+      if (i > 0) description += ",";
+      description += std::to_string(options.cpus[i]);
+    }
+  }
+  return description;
+}
+
+bool parseSchedPolicy(const std::string& str, ThreadOptions* options) {
+  const size_t colon = str.find(':');
+  const std::string name = str.substr(0, colon);
+  int policy;
+  if (name == "other")      policy = SCHED_OTHER;
+  else if (name == "fifo")  policy = SCHED_FIFO;
+  else if (name == "rr")    policy = SCHED_RR;
+  else {
+    fprintf(stderr, "Unknown scheduling policy '%s'\n", name.c_str());
+    return false;
+  }
+  int priority = 0;
+  if (colon != std::string::npos) {
+    priority = strtol(str.c_str() + colon + 1, NULL, 0);
+  } else if (policy != SCHED_OTHER) {
+    priority = sched_get_priority_min(policy);
+  }
+  if (policy != SCHED_OTHER && (priority < sched_get_priority_min(policy)
+                                || priority > sched_get_priority_max(policy))) {
+    fprintf(stderr, "Priority %d is out of range for %s\n", priority,
+            policyName(policy));
+    return false;
+  }
+  options->policy = policy;
+  options->priority = policy == SCHED_OTHER ? 0 : priority;
+  return true;
+}
+
+bool parseCpuList(const std::string& str, std::vector<int>* cpus) {
+  std::vector<int> parsed;
+  const char* pos = str.c_str();
+  while (*pos != '\0') {
+    char* end;
+    const long first = strtol(pos, &end, 10);
+    long last = first;
+    if (end == pos || first < 0) break;
+    if (*end == '-') {
+      pos = end + 1;
+      last = strtol(pos, &end, 10);
+      if (end == pos || last < first) break;
+    }
+    for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+      parsed.push_back(cpu);
+    }
+    if (*end == '\0') {
+      cpus->swap(parsed);
+      return true;
+    }
+    if (*end != ',') break;
+    pos = end + 1;
+  }
+  fprintf(stderr, "Cannot parse the CPU list '%s'\n", str.c_str());
+  return false;
+}
+
+int64_t getFrameMillis() {
+  return frame_ms >= 0 ? frame_ms : steadyMillis();
+}
+
+FrameClockScope::FrameClockScope() : previous(frame_ms) {
+  frame_ms = steadyMillis();
+}
+FrameClockScope::~FrameClockScope() {
+  frame_ms = this->previous;
+}
+
+} // end namespace Sprites
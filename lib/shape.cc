@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <string>
+
+#include "canvas.h"
+#include "graphics.h"
+#include "pixel-canvas.h"
+#include "shape.h"
+#include "sprite.h"
+
+
+namespace {
+
+const int SUBSAMPLES = 4;         // sub-scanlines per row with antialiasing
+
+// Segments for a quarter of a circle, so that no segment is more than
+// 0.1 pixel away from the arc
+int arcSegments(const double radius) {
+  if (radius <= 0.5) return 1;
+  const double step = 2 * std::acos(1 - 0.1 / radius);
+  return std::min(64, std::max(1, (int) std::ceil(M_PI / 2 / step)));
+}
+// Append the arc from angle a0 to a1 (degrees, clockwise on the panel)
+void appendArc(Sprites::Points* points, const double cx, const double cy,
+               const double rx, const double ry, const double a0,
+               const double a1, const int segments) {
+  for (int i = 0; i <= segments; ++i) {
+    const double angle = (a0 + (a1 - a0) * i / segments) * M_PI / 180;
+    points->push_back(Sprites::Point(cx + rx * std::cos(angle),
+                                     cy + ry * std::sin(angle)));
+  }
+}
+double signedArea(const Sprites::Points& points) {
+  double area = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    const Sprites::Point& a = points[i];
+    const Sprites::Point& b = points[(i + 1) % points.size()];
+    area += a.x * b.y - b.x * a.y;
+  }
+  return area / 2;
+}
+// floor and ceil of a / 256 for 24.8 fixed point values
+inline int32_t fixedFloor(const int32_t a) { return a >> 8; }
+inline int32_t fixedCeil(const int32_t a)  { return -((-a) >> 8); }
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+Shape::Shape() : Shape("", SHAPE_RECT) { }
+Shape::Shape(const std::string name, const ShapeKind kind) :
+    CanvasObject::CanvasObject(), name(name), kind(kind), size_x(1),
+    size_y(1), points(), radius(0), line_width(0), color(255, 255, 255),
+    antialias(false), dirty(true), built_flip_x(false), built_flip_y(false),
+    built_quarter_turns(0), box(0, 0), edges(), min_x(0), min_y(0), max_x(0),
+    max_y(0), contour(), crossings(), coverage() {
+  this->invalidate();
+}
+
+void Shape::setContent(const std::string& name)  { this->name = name; }
+const std::string& Shape::getContent() const    { return this->name; }
+
+void Shape::setKind(const ShapeKind kind) {
+  this->kind = kind;
+  this->invalidate();
+}
+ShapeKind Shape::getKind() const { return this->kind; }
+void Shape::setSize(const double width, const double height) {
+  this->size_x = std::max(0.0, width);
+  this->size_y = std::max(0.0, height);
+  this->invalidate();
+}
+double Shape::getSizeX() const { return this->size_x; }
+double Shape::getSizeY() const { return this->size_y; }
+void Shape::setPoints(const Points& points) {
+  this->points = points;
+  this->invalidate();
+}
+const Points& Shape::getPoints() const { return this->points; }
+void Shape::setRadius(const double radius) {
+  this->radius = std::max(0.0, radius);
+  this->invalidate();
+}
+double Shape::getRadius() const { return this->radius; }
+void Shape::setLineWidth(const double line_width) {
+  this->line_width = std::max(0.0, line_width);
+  this->invalidate();
+}
+double Shape::getLineWidth() const { return this->line_width; }
+void Shape::setColor(const uint8_t r, const uint8_t g, const uint8_t b) {
+  this->color = rgb_matrix::Color(r, g, b);
+}
+const rgb_matrix::Color& Shape::getColor() const { return this->color; }
+void Shape::setAntialias(const bool antialias) { this->antialias = antialias; }
+bool Shape::getAntialias() const { return this->antialias; }
+
+// The box is the object's size for edge behaviors and overlaps
+void Shape::invalidate() {
+  this->dirty = true;
+  const Point box = this->getBox();
+  const bool turned = this->quarter_turns % 2 == 1;
+  this->width = std::ceil(turned ? box.y : box.x);
+  this->height = std::ceil(turned ? box.x : box.y);
+}
+bool Shape::isStale() const {
+  return this->dirty || this->built_flip_x != this->flip_x
+      || this->built_flip_y != this->flip_y
+      || this->built_quarter_turns != this->quarter_turns;
+}
+void Shape::doStep() {
+  CanvasObject::doStep();
+  // flips and quarter turns are set on the CanvasObject, pick them up here
+  if (this->isStale()) this->invalidate();
+}
+
+Point Shape::getBox() const {
+  if (this->kind != SHAPE_LINE && this->kind != SHAPE_POLYGON) {
+    return Point(this->size_x, this->size_y);
+  }
+  // line points are pixel centers
+  const double extra = this->kind == SHAPE_LINE ? 1 : 0;
+  const size_t n = this->kind == SHAPE_LINE
+                   ? std::min<size_t>(this->points.size(), 2)
+                   : this->points.size();
+  Point box(0, 0);
+  for (size_t i = 0; i < n; ++i) {
+    box.x = std::max(box.x, this->points[i].x + extra);
+    box.y = std::max(box.y, this->points[i].y + extra);
+  }
+  return box;
+}
+// Flip in the box, then turn clockwise about its top left corner
+Point Shape::transform(const Point& p) const {
+  double x = this->flip_x ? this->box.x - p.x : p.x;
+  double y = this->flip_y ? this->box.y - p.y : p.y;
+  double box_height = this->box.y;
+  double box_width = this->box.x;
+  for (int i = 0; i < this->quarter_turns; ++i) {
+    const double turned_x = box_height - y;
+    y = x;
+    x = turned_x;
+    std::swap(box_width, box_height);
+  }
+  return Point(x, y);
+}
+
+void Shape::rebuild() const {
+  this->edges.clear();
+  this->box = this->getBox();
+  this->built_flip_x = this->flip_x;
+  this->built_flip_y = this->flip_y;
+  this->built_quarter_turns = this->quarter_turns;
+  this->dirty = false;
+  const double w = this->size_x;
+  const double h = this->size_y;
+  const double lw = this->line_width;
+  // outlines are the outer contour with the inner one against its direction
+  const bool hollow = lw > 0 && 2 * lw < w && 2 * lw < h;
+  switch (this->kind) {
+    case SHAPE_LINE:
+      if (this->points.size() >= 2) {
+        const Point a(this->points[0].x + 0.5, this->points[0].y + 0.5);
+        const Point b(this->points[1].x + 0.5, this->points[1].y + 0.5);
+        this->addSegment(a, b, std::max(1.0, lw));
+      }
+      break;
+    case SHAPE_RECT:
+    case SHAPE_ROUNDED_RECT: {
+      const double r = this->kind == SHAPE_RECT
+                       ? 0 : std::min(this->radius, std::min(w, h) / 2);
+      this->addRect(0, 0, w, h, r, false);
+      if (hollow) this->addRect(lw, lw, w - lw, h - lw, std::max(0.0, r - lw), true);
+      break;
+    }
+    case SHAPE_ELLIPSE:
+      this->addEllipse(w / 2, h / 2, w / 2, h / 2, false);
+      if (hollow) this->addEllipse(w / 2, h / 2, w / 2 - lw, h / 2 - lw, true);
+      break;
+    case SHAPE_POLYGON:
+      if (lw > 0) {
+        for (size_t i = 0; i < this->points.size(); ++i) {
+          this->addSegment(this->points[i],
+                           this->points[(i + 1) % this->points.size()], lw);
+        }
+      } else {
+        this->addContour(this->points, false);
+      }
+      break;
+  }
+  std::sort(this->edges.begin(), this->edges.end(),
+            [](const Edge& a, const Edge& b) { return a.y_top < b.y_top; });
+  this->min_x = this->min_y = INT32_MAX;
+  this->max_x = this->max_y = INT32_MIN;
+  for (const Edge& edge : this->edges) {
+    const int32_t x_bottom = (edge.x_top + edge.slope
+                              * (edge.y_bottom - edge.y_top) / 256) >> 8;
+    this->min_x = std::min(this->min_x, (int32_t) std::min<int64_t>(edge.x_top >> 8, x_bottom));
+    this->max_x = std::max(this->max_x, (int32_t) std::max<int64_t>(edge.x_top >> 8, x_bottom));
+    this->min_y = std::min(this->min_y, edge.y_top);
+    this->max_y = std::max(this->max_y, edge.y_bottom);
+  }
+  this->crossings.reserve(this->edges.size());
+}
+
+void Shape::addContour(const Points& contour, const bool reverse) const {
+  const size_t n = contour.size();
+  if (n < 2) return;
+  for (size_t i = 0; i < n; ++i) {
+    Point a = this->transform(contour[i]);
+    Point b = this->transform(contour[(i + 1) % n]);
+    if (reverse) std::swap(a, b);
+    const int32_t ya = std::lround(a.y * 256);
+    const int32_t yb = std::lround(b.y * 256);
+    if (ya == yb) continue;
+    Edge edge;
+    edge.winding = yb > ya ? 1 : -1;
+    if (yb < ya) std::swap(a, b);
+    const double slope = (b.x - a.x) / (b.y - a.y);
+    edge.y_top = std::min(ya, yb);
+    edge.y_bottom = std::max(ya, yb);
+    edge.x_top = std::llround((a.x + slope * (edge.y_top / 256.0 - a.y)) * 65536);
+    edge.slope = std::llround(slope * 65536);
+    this->edges.push_back(edge);
+  }
+}
+void Shape::addRect(const double x0, const double y0, const double x1,
+                    const double y1, const double radius,
+                    const bool reverse) const {
+  this->contour.clear();
+  if (radius <= 0) {
+    this->contour.push_back(Point(x0, y0));
+    this->contour.push_back(Point(x1, y0));
+    this->contour.push_back(Point(x1, y1));
+    this->contour.push_back(Point(x0, y1));
+  } else {
+    const int n = arcSegments(radius);
+    appendArc(&this->contour, x1 - radius, y0 + radius, radius, radius, -90, 0, n);
+    appendArc(&this->contour, x1 - radius, y1 - radius, radius, radius, 0, 90, n);
+    appendArc(&this->contour, x0 + radius, y1 - radius, radius, radius, 90, 180, n);
+    appendArc(&this->contour, x0 + radius, y0 + radius, radius, radius, 180, 270, n);
+  }
+  this->addContour(this->contour, reverse);
+}
+void Shape::addEllipse(const double cx, const double cy, const double rx,
+                       const double ry, const bool reverse) const {
+  if (rx <= 0 || ry <= 0) return;
+  this->contour.clear();
+  appendArc(&this->contour, cx, cy, rx, ry, 0, 360,
+            4 * arcSegments(std::max(rx, ry)));
+  this->contour.pop_back();   // the same as the first point
+  this->addContour(this->contour, reverse);
+}
+// A rectangle around the segment that reaches half the width past its
+// ends. All of them have the same direction, so they add up where they meet
+void Shape::addSegment(const Point& a, const Point& b, const double width) const {
+  const double half = width / 2;
+  const double length = std::hypot(b.x - a.x, b.y - a.y);
+  const double dx = length > 0 ? (b.x - a.x) / length : 1;
+  const double dy = length > 0 ? (b.y - a.y) / length : 0;
+  const Point start(a.x - dx * half, a.y - dy * half);
+  const Point end(b.x + dx * half, b.y + dy * half);
+  this->contour.clear();
+  this->contour.push_back(Point(start.x - dy * half, start.y + dx * half));
+  this->contour.push_back(Point(end.x - dy * half, end.y + dx * half));
+  this->contour.push_back(Point(end.x + dy * half, end.y - dx * half));
+  this->contour.push_back(Point(start.x + dy * half, start.y - dx * half));
+  if (signedArea(this->contour) < 0) {
+    std::reverse(this->contour.begin(), this->contour.end());
+  }
+  this->addContour(this->contour, false);
+}
+
+// Every sub-scanline collects where the edges cross it, sorts the crossings
+// and walks them with the winding count. Spans where the count is not 0 add
+// their pixel coverage to a row buffer, which is written once per row.
+void Shape::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible() || this->opacity == 0) return;
+  if (this->isStale()) this->rebuild();
+  if (this->edges.empty()) return;
+  const Point& origin = this->getWorldPosition();
+  const int32_t ox = std::lround(origin.x * 256);
+  const int32_t oy = std::lround(origin.y * 256);
+  const int row_first = std::max(0, fixedFloor(this->min_y + oy));
+  const int row_end = std::min(canvas->height(), fixedCeil(this->max_y + oy));
+  const int clip_left = std::max(0, fixedFloor(this->min_x + ox));
+  const int clip_right = std::min(canvas->width(), fixedCeil(this->max_x + ox) + 1);
+  if (row_first >= row_end || clip_left >= clip_right) return;
+  if (this->coverage.size() < (size_t) (clip_right - clip_left)) {
+    this->coverage.resize(clip_right - clip_left, 0);
+  }
+  PixelCanvas* memory = dynamic_cast<PixelCanvas*>(canvas);
+  const uint8_t red = this->color.r * this->tint.r / 255;
+  const uint8_t green = this->color.g * this->tint.g / 255;
+  const uint8_t blue = this->color.b * this->tint.b / 255;
+  const int subsamples = this->antialias ? SUBSAMPLES : 1;
+  // indexed by panel x
+  uint16_t* const row_coverage = this->coverage.data();
+  auto coverage = [&](const int x) -> uint16_t& {
+    return row_coverage[x - clip_left];
+  };
+  int span_min, span_max;
+
+  // [xa, xb) in 24.8 panel coordinates
+  auto addSpan = [&](int32_t xa, int32_t xb) {
+    int first, last;
+    if (!this->antialias) {
+      // the pixels whose center is inside
+      first = std::max(clip_left, fixedCeil(xa - 128));
+      last = std::min(clip_right, fixedCeil(xb - 128)) - 1;
+      for (int x = first; x <= last; ++x) coverage(x) += 256;
+    } else {
+      xa = std::max(xa, clip_left * 256);
+      xb = std::min(xb, clip_right * 256);
+      if (xa >= xb) return;
+      first = fixedFloor(xa);
+      last = fixedFloor(xb - 1);
+      if (first == last) {
+        coverage(first) += xb - xa;
+      } else {
+        coverage(first) += 256 - (xa & 255);
+        for (int x = first + 1; x < last; ++x) coverage(x) += 256;
+        coverage(last) += xb - last * 256;
+      }
+    }
+    if (first > last) return;
+    span_min = std::min(span_min, first);
+    span_max = std::max(span_max, last);
+  };
+
+  for (int row = row_first; row < row_end; ++row) {
+    span_min = INT_MAX;
+    span_max = INT_MIN;
+    for (int sub = 0; sub < subsamples; ++sub) {
+      const int32_t y = row * 256 + (2 * sub + 1) * 128 / subsamples - oy;
+      this->crossings.clear();
+      for (const Edge& edge : this->edges) {
+        if (edge.y_top > y) break;
+        if (y >= edge.y_bottom) continue;
+        Crossing crossing;
+        crossing.x = ((edge.x_top + edge.slope * (y - edge.y_top) / 256) >> 8) + ox;
+        crossing.winding = edge.winding;
+        // insertion sort, there are only a few crossings per line
+        size_t i = this->crossings.size();
+        this->crossings.push_back(crossing);
+        for (; i > 0 && this->crossings[i - 1].x > crossing.x; --i) {
+          this->crossings[i] = this->crossings[i - 1];
+        }
+        this->crossings[i] = crossing;
+      }
+      int winding = 0;
+      int32_t span_start = 0;
+      for (const Crossing& crossing : this->crossings) {
+        const int before = winding;
+        winding += crossing.winding;
+        if (before == 0 && winding != 0) span_start = crossing.x;
+        else if (before != 0 && winding == 0) addSpan(span_start, crossing.x);
+      }
+    }
+    for (int x = span_min; x <= span_max; ++x) {
+      if (coverage(x) == 0) continue;
+      const uint32_t alpha = std::min(256, coverage(x) / subsamples)
+                             * this->opacity >> 8;
+      coverage(x) = 0;
+      if (alpha >= 255) {
+        canvas->SetPixel(x, row, red, green, blue);
+      } else if (alpha == 0) {
+        continue;
+      } else if (memory != nullptr) {
+        memory->blendPixel(x, row, red, green, blue, alpha);
+      } else {
+        canvas->SetPixel(x, row, red * alpha / 255, green * alpha / 255,
+                         blue * alpha / 255);
+      }
+    }
+  }
+}
+
+} // end namespace Sprites
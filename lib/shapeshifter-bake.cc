@@ -0,0 +1,107 @@
+// standard library:
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <mutex>
+
+// POSIX/UNIX specific:
+#include <unistd.h>     // getopt
+
+// external libraries:
+#include <Magick++.h>
+
+// project headers
+#include "animation-stream.h"
+#include "command-trace.h"
+#include "led-loop.h"
+#include "pixel-canvas.h"
+#include "sprite.h"
+
+using Sprites::AnimationStreamWriter;
+using Sprites::CanvasObjectList;
+using Sprites::PixelCanvas;
+
+
+struct Options {
+  Options() : frames(0), extra_frames(0), width(192), height(64) { }
+  uint32_t frames;
+  uint32_t extra_frames;
+  int width;
+  int height;
+};
+static bool parseOptions(int argc, char* argv[], Options* options);
+static int usage(const char *progrname, const char *msg = nullptr);
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, &options) || optind + 2 != argc) {
+    return usage(argv[0], "Failed parsing options");
+  }
+
+  Magick::InitializeMagick(*argv);
+
+  led_loop::CommandTraceReader trace;
+  if (!trace.open(argv[optind])) return 1;
+
+  led_loop::LoopOptions loop_options;
+  loop_options.frame_time_ms = 0;
+  PixelCanvas canvas(options.width, options.height);
+  CanvasObjectList sprites;
+  std::mutex sprites_mutex;
+  led_loop::AnimationLoop animation(&canvas, &sprites, &loop_options,
+                                    &sprites_mutex);
+
+  AnimationStreamWriter writer;
+  if (!writer.open(argv[optind + 1], options.width, options.height,
+                   trace.getFrameTime())) {
+    return 1;
+  }
+  uint32_t frames_left = options.extra_frames;
+  while (options.frames > 0 ? animation.getFrameCount() < options.frames
+                            : (!trace.atEnd() || frames_left-- > 0)) {
+    sprites_mutex.lock();
+    trace.replay(animation.getFrameCount(), &sprites);
+    sprites_mutex.unlock();
+    animation.doFrame();
+    writer.addFrame(canvas.getData());
+  }
+  if (!writer.close()) {
+    fprintf(stderr, "Writing the animation stream failed\n");
+    return 1;
+  }
+  fprintf(stdout, "Baked %u frames into %s\n", animation.getFrameCount(),
+          argv[optind + 1]);
+
+  for (auto& sprite_pair : sprites) delete sprite_pair.second;
+  return 0;
+}
+
+
+
+static bool parseOptions(int argc, char* argv[], Options* options) {
+  int opt;
+  while ((opt = getopt(argc, argv, "n:e:W:H:")) != -1) {
+    switch (opt) {
+      case 'n': options->frames = strtoul(optarg, NULL, 0); break;
+      case 'e': options->extra_frames = strtoul(optarg, NULL, 0); break;
+      case 'W': options->width = strtoul(optarg, NULL, 0); break;
+      case 'H': options->height = strtoul(optarg, NULL, 0); break;
+      default:  return false;
+    }
+  }
+  return true;
+}
+
+static int usage(const char *progname, const char *msg) {
+  if (msg) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Renders a command trace into an animation stream\n");
+  fprintf(stderr, "usage: %s [options] <trace> <stream>\n", progname);
+  fprintf(stderr, "Options:\n"
+          "\t-n <frames>        : Number of frames (default: length of trace).\n"
+          "\t-e <frames>        : Extra frames to run after the last record.\n"
+          "\t-W <width>         : Canvas width (default: 192).\n"
+          "\t-H <height>        : Canvas height (default: 64).\n");
+  return 1;
+}
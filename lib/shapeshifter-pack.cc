@@ -0,0 +1,180 @@
+// standard library:
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// POSIX/UNIX specific:
+#include <ftw.h>        // nftw, walking asset directories
+#include <unistd.h>     // getopt
+
+// external libraries:
+#include <Magick++.h>
+
+// project headers
+#include "asset-pack.h"
+
+using Sprites::PackEntry;
+using Sprites::PackHeader;
+
+
+struct Options {
+  Options() : verbosity(0) { }
+  std::vector<size_t> heights;
+  int verbosity;
+};
+struct Asset {
+  PackEntry entry;
+  std::vector<uint8_t> pixels;
+  std::vector<uint8_t> mask;
+};
+static bool parseOptions(int argc, char* argv[], Options* options);
+static int usage(const char *progrname, const char *msg = nullptr);
+
+static std::vector<std::string> FILES;
+static int collectFile(const char* path, const struct stat* st, int type,
+                       struct FTW* ftw) {
+  if (type != FTW_F) return 0;
+  std::string ext = path;
+  ext = ext.substr(ext.find_last_of('.') + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  if (ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "gif"
+      || ext == "svg" || ext == "bmp" || ext == "webp") {
+    FILES.push_back(path);
+  }
+  return 0;
+}
+
+static bool addAsset(const std::string& name, Magick::Image img, size_t height,
+                     std::vector<Asset>* assets) {
+  if (name.size() >= sizeof(PackEntry::name)) {
+    fprintf(stderr, "Name too long, skipping: %s\n", name.c_str());
+    return false;
+  }
+  if (height != 0) {
+    const size_t width = std::round((double) img.columns() * height / img.rows());
+    img.scale(Magick::Geometry(width, height));
+  }
+  Asset asset;
+  std::memset(&asset.entry, 0, sizeof(asset.entry));
+  strncpy(asset.entry.name, name.c_str(), sizeof(asset.entry.name) - 1);
+  asset.entry.width = img.columns();
+  asset.entry.height = img.rows();
+  asset.entry.flags = (height == 0) ? PackEntry::NATIVE_SIZE : 0;
+  const size_t n_pixels = img.columns() * img.rows();
+  std::vector<uint8_t> rgba(n_pixels * 4);
+  img.write(0, 0, img.columns(), img.rows(), "RGBA", Magick::CharPixel, rgba.data());
+  asset.pixels.resize(n_pixels * 3);
+  asset.mask.resize(n_pixels);
+  for (size_t i = 0; i < n_pixels; ++i) {
+    std::memcpy(&asset.pixels[i * 3], &rgba[i * 4], 3);
+    asset.mask[i] = rgba[i * 4 + 3];
+  }
+  assets->push_back(asset);
+  return true;
+}
+
+static void writeAligned(FILE* file, const std::vector<uint8_t>& data) {
+  static const char zeros[16] = {0};
+  fwrite(data.data(), 1, data.size(), file);
+  const long padding = (16 - ftell(file) % 16) % 16;
+  fwrite(zeros, 1, padding, file);
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, &options) || optind + 2 > argc) {
+    return usage(argv[0], "Failed parsing options");
+  }
+
+  Magick::InitializeMagick(*argv);
+
+  for (int i = optind + 1; i < argc; ++i) {
+    if (nftw(argv[i], collectFile, 16, FTW_PHYS) != 0) {
+      fprintf(stderr, "Cannot read %s\n", argv[i]);
+    }
+  }
+
+  std::vector<Asset> assets;
+  for (const std::string& filename : FILES) {
+    std::vector<Magick::Image> frames;
+    try {
+      Magick::readImages(&frames, filename);
+    } catch (std::exception& e) {
+      if (e.what()) fprintf(stderr, "Magickimage error: %s\n", e.what());
+    }
+    if (frames.size() == 0) continue;
+    addAsset(filename, frames[0], 0, &assets);
+    for (const size_t height : options.heights) {
+      if (height != frames[0].rows()) addAsset(filename, frames[0], height, &assets);
+    }
+    if (options.verbosity > 0) fprintf(stdout, "Packed %s\n", filename.c_str());
+  }
+  std::sort(assets.begin(), assets.end(), [](const Asset& a, const Asset& b) {
+    int cmp = strncmp(a.entry.name, b.entry.name, sizeof(a.entry.name));
+    if (cmp != 0) return cmp < 0;
+    return a.entry.height < b.entry.height;
+  });
+
+  FILE* file = fopen(argv[optind], "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "Cannot open '%s' for writing\n", argv[optind]);
+    return 1;
+  }
+  PackHeader header;
+  header.entry_count = assets.size();
+  fwrite(&header, sizeof(header), 1, file);
+  for (Asset& asset : assets) {
+    asset.entry.pixel_offset = ftell(file);
+    writeAligned(file, asset.pixels);
+    asset.entry.mask_offset = ftell(file);
+    writeAligned(file, asset.mask);
+  }
+  header.index_offset = ftell(file);
+  for (const Asset& asset : assets) {
+    fwrite(&asset.entry, sizeof(asset.entry), 1, file);
+  }
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Writing the asset pack failed\n");
+    return 1;
+  }
+  fprintf(stdout, "Packed %zu images (%zu files) into %s\n", assets.size(),
+          FILES.size(), argv[optind]);
+  return 0;
+}
+
+
+
+static bool parseOptions(int argc, char* argv[], Options* options) {
+  int opt;
+  while ((opt = getopt(argc, argv, "s:v")) != -1) {
+    switch (opt) {
+      case 's': options->heights.push_back(strtoul(optarg, NULL, 0)); break;
+      case 'v': options->verbosity = 1; break;
+      default:  return false;
+    }
+  }
+  return true;
+}
+
+static int usage(const char *progname, const char *msg) {
+  if (msg) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Decodes images into an asset pack that sprites can map\n");
+  fprintf(stderr, "usage: %s [options] <pack> <dir|file> [<dir|file>...]\n",
+          progname);
+  fprintf(stderr, "Images are stored under their path as given here, so run\n"
+          "this from the directory the sprites are loaded from.\n");
+  fprintf(stderr, "Options:\n"
+          "\t-s <height>        : Also store the images scaled to <height>\n"
+          "\t                     (can be given several times).\n"
+          "\t-v                 : Verbose mode.\n");
+  return 1;
+}
@@ -0,0 +1,164 @@
+// standard library:
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+// POSIX/UNIX specific:
+#include <unistd.h>     // getopt
+
+// external libraries:
+#include <Magick++.h>
+
+// project headers
+#include "command-trace.h"
+#include "led-loop.h"
+#include "pixel-canvas.h"
+#include "sprite.h"
+
+using Sprites::CanvasObjectList;
+using Sprites::PixelCanvas;
+
+
+static volatile bool INTERRUPT_RECEIVED = false;
+
+// Counting allocator for -a: heap allocations of this thread are counted
+// while count_allocations is set, i.e. during doFrame
+static thread_local bool count_allocations = false;
+static thread_local size_t allocations = 0;
+
+void* operator new(size_t size) {
+  if (count_allocations) ++allocations;
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+
+
+struct Options {
+  Options() : real_time(false), extra_frames(0), steady_frames(0),
+              width(192), height(64), verbosity(0) { }
+  bool real_time;
+  uint32_t extra_frames;
+  uint32_t steady_frames;
+  int width;
+  int height;
+  int verbosity;
+};
+static void handleInterrupt(int signo) { INTERRUPT_RECEIVED = true; }
+static bool parseOptions(int argc, char* argv[], Options* options);
+static int usage(const char *progrname, const char *msg = nullptr);
+
+// FNV-1a over the frame, so two replays can be compared for regressions
+static uint64_t hashFrame(const PixelCanvas& canvas, uint64_t hash) {
+  const uint8_t* data = canvas.getData();
+  for (size_t i = 0; i < canvas.getSize(); ++i) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+int main(int argc, char *argv[]) {
+  signal(SIGTERM, handleInterrupt);
+  signal(SIGINT, handleInterrupt);
+
+  Options options;
+  if (!parseOptions(argc, argv, &options) || optind >= argc) {
+    return usage(argv[0], "Failed parsing options");
+  }
+
+  Magick::InitializeMagick(*argv);
+
+  led_loop::CommandTraceReader trace;
+  if (!trace.open(argv[optind])) return 1;
+
+  led_loop::LoopOptions loop_options;
+  loop_options.frame_time_ms = options.real_time ? trace.getFrameTime() : 0;
+  PixelCanvas canvas(options.width, options.height);
+  CanvasObjectList sprites;
+  std::mutex sprites_mutex;
+  led_loop::AnimationLoop animation(&canvas, &sprites, &loop_options,
+                                    &sprites_mutex);
+
+  uint64_t hash = 14695981039346656037ULL;
+  uint32_t frames_left = options.extra_frames;
+  // frames since the trace last changed the scene
+  uint32_t unchanged_frames = 0;
+  size_t steady_allocations = 0;
+  const led_loop::tmillis_t start_ms = led_loop::getTimeInMillis();
+  while (!INTERRUPT_RECEIVED && (!trace.atEnd() || frames_left-- > 0)) {
+    sprites_mutex.lock();
+    const size_t applied = trace.replay(animation.getFrameCount(), &sprites);
+    sprites_mutex.unlock();
+    unchanged_frames = applied > 0 ? 0 : unchanged_frames + 1;
+    allocations = 0;
+    count_allocations = true;
+    animation.doFrame();
+    count_allocations = false;
+    if (options.steady_frames > 0 && unchanged_frames > options.steady_frames
+        && allocations > 0) {
+      fprintf(stderr, "frame %u: %zu heap allocations in a steady scene\n",
+              animation.getFrameCount(), allocations);
+      steady_allocations += allocations;
+    }
+    hash = hashFrame(canvas, hash);
+    if (options.verbosity > 4) {
+      fprintf(stdout, "frame %u: %016llx\n", animation.getFrameCount(),
+              (unsigned long long) hash);
+    }
+  }
+  const led_loop::tmillis_t elapsed_ms = led_loop::getTimeInMillis() - start_ms;
+
+  const uint32_t frames = animation.getFrameCount();
+  fprintf(stdout, "Replayed %u frames in %lld ms (%.1f fps)\n", frames,
+          elapsed_ms, elapsed_ms > 0 ? 1000.0 * frames / elapsed_ms : 0.0);
+  fprintf(stdout, "Frame checksum: %016llx\n", (unsigned long long) hash);
+  if (options.steady_frames > 0) {
+    fprintf(stdout, "Heap allocations in steady frames: %zu\n",
+            steady_allocations);
+  }
+
+  for (auto& sprite_pair : sprites) delete sprite_pair.second;
+  return steady_allocations > 0 ? 2 : 0;
+}
+
+
+
+static bool parseOptions(int argc, char* argv[], Options* options) {
+  int opt;
+  while ((opt = getopt(argc, argv, "a:re:W:H:v")) != -1) {
+    switch (opt) {
+      case 'a': options->steady_frames = strtoul(optarg, NULL, 0); break;
+      case 'r': options->real_time = true; break;
+      case 'e': options->extra_frames = strtoul(optarg, NULL, 0); break;
+      case 'W': options->width = strtoul(optarg, NULL, 0); break;
+      case 'H': options->height = strtoul(optarg, NULL, 0); break;
+      case 'v': options->verbosity = 5; break;
+      default:  return false;
+    }
+  }
+  return true;
+}
+
+static int usage(const char *progname, const char *msg) {
+  if (msg) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  fprintf(stderr, "Replays a command trace off-hardware, e.g. for profiling\n");
+  fprintf(stderr, "usage: %s [options] <trace>\n", progname);
+  fprintf(stderr, "Options:\n"
+          "\t-a <frames>        : Fail if a frame allocates after the scene was\n"
+          "\t                     unchanged for <frames> frames.\n"
+          "\t-r                 : Replay in real time (default: max speed).\n"
+          "\t-e <frames>        : Extra frames to run after the last record.\n"
+          "\t-W <width>         : Canvas width (default: 192).\n"
+          "\t-H <height>        : Canvas height (default: 64).\n"
+          "\t-v                 : Print a checksum after every frame.\n");
+  return 1;
+}
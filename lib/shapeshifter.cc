@@ -5,6 +5,7 @@
 #include <cstring>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 // POSIX/UNIX specific:
 #include <sys/types.h>  // some types (also size_t, mutex)
@@ -16,35 +17,46 @@
 
 // project headers
 #include "led-matrix.h"
+#include "animation-stream.h"
+#include "asset-pack.h"
 #include "sprite.h"
 #include "led-loop.h"
+#include "realtime.h"
+#include "trace-events.h"
+#include "video.h"
 
-using Sprites::SpriteList;
+using Sprites::CanvasObjectList;
 using Sprites::Sprite;
+using Sprites::Video;
 
 
 static volatile bool INTERRUPT_RECEIVED = false;
 
 
-void animate(led_loop::SpriteAnimationLoop* animation) {
-  animation->startLoop();
-}
-void dostuff(SpriteList* sprites, std::mutex* sprites_mutex) {
-  Sprite* werder = (*sprites)["werder"];
+void dostuff(CanvasObjectList* sprites, std::mutex* sprites_mutex) {
+  Sprites::configureWorkerThread("worker");
+  Sprites::CanvasObject* werder = (*sprites)["werder"];
   while (!INTERRUPT_RECEIVED) {
     led_loop::sleepMillis(1000);
     sprites_mutex->lock();    // is it even necessary?
-    werder->addSpeed(0.1);
+    werder->setSpeed(werder->getSpeed() + 0.1);
     sprites_mutex->unlock();
   }
 }
 
 
 struct Options {
+  Options() : verbosity(0), trace_filename(nullptr), socket_path(nullptr),
+              shared_table(nullptr), trace_events_filename(nullptr) { }
   rgb_matrix::RuntimeOptions rgb_runtime;
   rgb_matrix::RGBMatrix::Options matrix;
   led_loop::LoopOptions loop;
   int verbosity;
+  const char* trace_filename;
+  const char* socket_path;
+  const char* shared_table;
+  const char* trace_events_filename;
+  std::vector<const char*> videos;
 };
 static void handleInterrupt(int signo) { INTERRUPT_RECEIVED = true; }
 static bool parseOptions(int argc, char* argv[], Options* options);
@@ -67,11 +79,26 @@ int main(int argc, char *argv[]) {
   if (matrix == NULL) {
     return usage(argv[0], "Matrix creation failed");
   }
-  SpriteList* sprites = new SpriteList();
+  CanvasObjectList* sprites = new CanvasObjectList();
+
+  if (options->trace_events_filename != nullptr) {
+    Sprites::TraceEvents::setEnabled(true);
+  }
 
   std::mutex sprites_mutex;
-  led_loop::SpriteAnimationLoop animation(
-      matrix, sprites, &sprites_mutex, &(options->loop));
+  led_loop::AnimationLoop animation(
+      matrix, sprites, &(options->loop), &sprites_mutex);
+  if (options->trace_filename != nullptr) {
+    animation.startTrace(options->trace_filename);
+  }
+  if (options->socket_path != nullptr
+      && !animation.startControlServer(options->socket_path)) {
+    return usage(argv[0], "Couldn't start the control server");
+  }
+  if (options->shared_table != nullptr
+      && !animation.startSharedTable(options->shared_table)) {
+    return usage(argv[0], "Couldn't create the shared table");
+  }
 
   Sprite* werder = new Sprite("sprites/clubs/bremen42.png");
   werder->setID("werder");
@@ -80,11 +107,38 @@ int main(int argc, char *argv[]) {
   werder->setSpeed(0.5);
   (*sprites)["werder"] = werder;
 
-  std::thread animation_thread(animate, &animation);
+  // videos given on the command line share the panel side by side, baked
+  // animation streams (*.ssa) keep their own size
+  const size_t n_videos = options->videos.size();
+  for (size_t i = 0; i < n_videos; ++i) {
+    const size_t video_width = matrix->width() / n_videos;
+    const std::string filename = options->videos[i];
+    Sprites::CanvasObject* video;
+    if (filename.size() > 4 && filename.substr(filename.size() - 4) == ".ssa") {
+      video = new Sprites::AnimationStream(filename);
+    } else {
+      video = new Video(filename, video_width, matrix->height());
+    }
+    video->setID("video_" + std::to_string(i));
+    video->setPosition(Sprites::Point(i * video_width, 0));
+    (*sprites)[video->getID()] = video;
+  }
+
+  animation.startLoop();
   std::thread worker_thread(dostuff, sprites, &sprites_mutex);
 
-  animation_thread.join();
   worker_thread.join();
+  animation.endLoop();
+  animation.stopControlServer();
+  animation.stopSharedTable();
+  animation.stopTrace();
+  led_loop::LoopStats stats;
+  animation.getStats(&stats);
+  fprintf(stdout, "%u frames, %u missed deadlines, slowest frame %lld ms\n",
+          stats.frames, stats.missed_deadlines, stats.max_frame_ms);
+  if (options->trace_events_filename != nullptr) {
+    Sprites::TraceEvents::flush(options->trace_events_filename);
+  }
 
   if (INTERRUPT_RECEIVED) {
     fprintf(stderr, "Caught interrupt signal. Exiting.\n");
@@ -116,13 +170,39 @@ static bool parseOptions(int argc, char* argv[], Options* options) {
   }
 
   int opt;
-  while ((opt = getopt(argc, argv, "f:v")) != -1) {
+  while ((opt = getopt(argc, argv, "C:e:f:Lm:p:R:s:t:vw:W:")) != -1) {
     switch (opt) {
+      case 'C':
+        if (!Sprites::parseCpuList(optarg, &options->loop.thread.cpus)) return false;
+        break;
+      case 'L': options->loop.lock_memory = true; break;
+      case 'R':
+        if (!Sprites::parseSchedPolicy(optarg, &options->loop.thread)) return false;
+        break;
+      case 'w':
+        if (!Sprites::parseSchedPolicy(optarg, &options->loop.workers)) return false;
+        break;
+      case 'W':
+        if (!Sprites::parseCpuList(optarg, &options->loop.workers.cpus)) return false;
+        break;
+      case 'e': options->trace_events_filename = optarg; break;
       case 'f': options->loop.frame_time_ms = strtoul(optarg, NULL, 0); break;
+      case 'm': options->shared_table = optarg; break;
+      case 'p': if (!Sprites::AssetPack::load(optarg)) return false; break;
+      case 's': options->socket_path = optarg; break;
+      case 't': options->trace_filename = optarg; break;
       case 'v': options->verbosity = 5; break;
       default:  return false;
     }
   }
+  for (int i = optind; i < argc; ++i) {
+    options->videos.push_back(argv[i]);
+  }
+  // real-time policies and mlockall need the root rights rgbmatrix drops
+  if (options->loop.thread.isRealtime() || options->loop.workers.isRealtime()
+      || options->loop.lock_memory) {
+    options->rgb_runtime.drop_privileges = 0;
+  }
   return true;
 }
 
@@ -134,7 +214,18 @@ static int usage(const char *progname, const char *msg) {
   fprintf(stderr, "Server application that pushes a few sprites on a panel\n");
   fprintf(stderr, "usage: %s [options] <video> [<video>...]\n", progname);
   fprintf(stderr, "Options:\n"
+          "\t-C <cpus>          : Pin the animation thread, e.g. 3 or 2-3.\n"
+          "\t-e <file>          : Write Chrome trace events to <file> at exit.\n"
           "\t-f                 : Frame duration in ms.\n"
-          "\t-v                 : Verbose mode.\n");
+          "\t-L                 : Lock the memory (mlockall).\n"
+          "\t-m <name>          : Publish the objects in shared memory.\n"
+          "\t-p <pack>          : Take images from an asset pack.\n"
+          "\t-R <policy>[:<prio>]: Schedule the animation thread with other,\n"
+          "\t                     fifo or rr, e.g. fifo:50.\n"
+          "\t-s <socket>        : Accept commands on a Unix socket.\n"
+          "\t-t <file>          : Record a command trace to <file>.\n"
+          "\t-v                 : Verbose mode.\n"
+          "\t-w <policy>[:<prio>]: Schedule the worker threads.\n"
+          "\t-W <cpus>          : Pin the worker threads.\n");
   return 1;
 }
@@ -0,0 +1,274 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shared-table.h"
+#include "sprite.h"
+
+
+namespace {
+
+const char SHARED_TABLE_MAGIC[4] = {'S', 'S', 'S', 'T'};
+const uint16_t SHARED_TABLE_VERSION = 1;
+
+std::string shmName(const std::string& name) {
+  return name[0] == '/' ? name : "/" + name;
+}
+
+} // end anonymous namespace
+
+
+namespace led_loop {
+
+SharedTable::SharedTable() : name(""), header(nullptr), entries(nullptr),
+                             size(0), frame(0) { }
+SharedTable::~SharedTable() {
+  this->close();
+}
+
+bool SharedTable::create(const std::string& name, const uint32_t capacity) {
+  this->close();
+  if (name.empty() || capacity == 0) return false;
+  this->name = shmName(name);
+  int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    fprintf(stderr, "Couldn't create shared memory '%s': %s\n",
+            this->name.c_str(), strerror(errno));
+    return false;
+  }
+  fchmod(fd, 0666);   // clients usually run as another user
+  this->size = sizeof(SharedTableHeader) + capacity * sizeof(SharedEntry);
+  void* mapped = MAP_FAILED;
+  if (ftruncate(fd, this->size) == 0) {
+    mapped = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    fprintf(stderr, "Couldn't map shared memory '%s'\n", this->name.c_str());
+    shm_unlink(this->name.c_str());
+    return false;
+  }
+  memset(mapped, 0, this->size);
+  this->header = static_cast<SharedTableHeader*>(mapped);
+  this->entries = reinterpret_cast<SharedEntry*>(this->header + 1);
+  this->header->version = SHARED_TABLE_VERSION;
+  this->header->entry_size = sizeof(SharedEntry);
+  this->header->capacity = capacity;
+  memcpy(this->header->magic, SHARED_TABLE_MAGIC, sizeof(SHARED_TABLE_MAGIC));
+
+  this->free_slots.clear();
+  for (uint32_t slot = capacity; slot > 0; --slot) {
+    this->free_slots.push_back(slot - 1);
+  }
+  this->last_sequence.assign(capacity, 0);
+  this->last_writes.assign(capacity * 8, 0);
+  this->seen_in_frame.assign(capacity, 0);
+  return true;
+}
+
+void SharedTable::close() {
+  if (this->header != nullptr) {
+    munmap(this->header, this->size);
+    shm_unlink(this->name.c_str());
+  }
+  this->header = nullptr;
+  this->entries = nullptr;
+  this->slots.clear();
+}
+
+bool SharedTable::isOpen() const {
+  return this->header != nullptr;
+}
+
+void SharedTable::sync(Sprites::CanvasObjectList* canvas_objects) {
+  if (this->header == nullptr) return;
+  ++this->frame;
+  for (auto& cvo_pair : *canvas_objects) {
+    auto it = this->slots.find(cvo_pair.first);
+    if (it == this->slots.end()) {
+      if (this->free_slots.empty()
+          || cvo_pair.first.size() >= sizeof(SharedEntry::id)) {
+        continue;
+      }
+      const uint32_t slot = this->free_slots.back();
+      this->free_slots.pop_back();
+      this->bind(slot, cvo_pair.first);
+      it = this->slots.emplace(cvo_pair.first, slot).first;
+    }
+    this->seen_in_frame[it->second] = this->frame;
+    this->apply(it->second, cvo_pair.second);
+  }
+  for (auto it = this->slots.begin(); it != this->slots.end(); ) {
+    if (this->seen_in_frame[it->second] != this->frame) {
+      this->unbind(it->second);
+      it = this->slots.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  this->header->frame.store(this->frame, std::memory_order_release);
+}
+
+void SharedTable::bind(const uint32_t slot, const Sprites::CanvasObjectID& id) {
+  SharedEntry* entry = &this->entries[slot];
+  entry->used.store(0, std::memory_order_release);
+  entry->generation.fetch_add(1, std::memory_order_acq_rel);
+  memset(entry->id, 0, sizeof(entry->id));
+  memcpy(entry->id, id.data(), id.size());
+  // whatever the previous owner of the slot wrote is not applied again
+  this->last_sequence[slot] = entry->sequence.load(std::memory_order_acquire);
+  memcpy(&this->last_writes[slot * 8], entry->writes, 8);
+  entry->used.store(1, std::memory_order_release);
+}
+
+void SharedTable::unbind(const uint32_t slot) {
+  SharedEntry* entry = &this->entries[slot];
+  entry->used.store(0, std::memory_order_release);
+  entry->generation.fetch_add(1, std::memory_order_acq_rel);
+  this->free_slots.push_back(slot);
+}
+
+void SharedTable::apply(const uint32_t slot, Sprites::CanvasObject* cvo) {
+  SharedEntry* entry = &this->entries[slot];
+  const uint32_t sequence = entry->sequence.load(std::memory_order_acquire);
+  if (sequence == this->last_sequence[slot] || (sequence & 1)) return;
+  uint8_t writes[8];
+  memcpy(writes, entry->writes, sizeof(writes));
+  const double x = entry->x;
+  const double y = entry->y;
+  const double speed = entry->speed;
+  const double direction = entry->direction;
+  const int32_t visible = entry->visible;
+  const int32_t z = entry->z;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // torn read, the writer finishes before the next frame
+  if (entry->sequence.load(std::memory_order_relaxed) != sequence) return;
+
+  this->last_sequence[slot] = sequence;
+  uint8_t* last = &this->last_writes[slot * 8];
+  if (writes[SHARED_POSITION] != last[SHARED_POSITION]) {
+    cvo->setPosition(Sprites::Point(x, y));
+  }
+  if (writes[SHARED_SPEED] != last[SHARED_SPEED])         cvo->setSpeed(speed);
+  if (writes[SHARED_DIRECTION] != last[SHARED_DIRECTION]) cvo->setDirection(direction);
+  if (writes[SHARED_VISIBLE] != last[SHARED_VISIBLE])     cvo->setVisible(visible);
+  if (writes[SHARED_Z] != last[SHARED_Z])                 cvo->setZ(z);
+  memcpy(last, writes, sizeof(writes));
+}
+
+
+SharedTableClient::SharedTableClient() : header(nullptr), entries(nullptr),
+                                         size(0) { }
+SharedTableClient::~SharedTableClient() {
+  this->close();
+}
+
+bool SharedTableClient::open(const std::string& name) {
+  this->close();
+  int fd = shm_open(shmName(name).c_str(), O_RDWR | O_CLOEXEC, 0);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0
+      || (size_t) st.st_size < sizeof(SharedTableHeader)) {
+    fprintf(stderr, "Couldn't open shared table '%s'\n", name.c_str());
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+  void* mapped = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) return false;
+  this->header = static_cast<SharedTableHeader*>(mapped);
+  this->size = st.st_size;
+  if (memcmp(this->header->magic, SHARED_TABLE_MAGIC, sizeof(SHARED_TABLE_MAGIC)) != 0
+      || this->header->version != SHARED_TABLE_VERSION
+      || this->header->entry_size != sizeof(SharedEntry)
+      || sizeof(SharedTableHeader) + this->header->capacity * sizeof(SharedEntry) > this->size) {
+    fprintf(stderr, "'%s' is not a shared table of this version\n", name.c_str());
+    this->close();
+    return false;
+  }
+  this->entries = reinterpret_cast<SharedEntry*>(this->header + 1);
+  return true;
+}
+
+void SharedTableClient::close() {
+  if (this->header != nullptr) munmap(this->header, this->size);
+  this->header = nullptr;
+  this->entries = nullptr;
+  this->cache.clear();
+}
+
+bool SharedTableClient::isOpen() const {
+  return this->header != nullptr;
+}
+
+SharedEntry* SharedTableClient::find(const Sprites::CanvasObjectID& id) {
+  if (this->header == nullptr) return nullptr;
+  auto cached = this->cache.find(id);
+  if (cached != this->cache.end()) {
+    SharedEntry* entry = &this->entries[cached->second.slot];
+    if (entry->used.load(std::memory_order_acquire)
+        && entry->generation.load(std::memory_order_acquire) == cached->second.generation) {
+      return entry;
+    }
+    this->cache.erase(cached);
+  }
+  for (uint32_t slot = 0; slot < this->header->capacity; ++slot) {
+    SharedEntry* entry = &this->entries[slot];
+    const uint32_t generation = entry->generation.load(std::memory_order_acquire);
+    if (!entry->used.load(std::memory_order_acquire)
+        || strncmp(entry->id, id.c_str(), sizeof(entry->id)) != 0
+        || entry->generation.load(std::memory_order_acquire) != generation) {
+      continue;
+    }
+    this->cache[id] = CachedSlot{slot, generation};
+    return entry;
+  }
+  return nullptr;
+}
+
+template <typename Write>
+bool SharedTableClient::write(const Sprites::CanvasObjectID& id,
+                              const SharedField field, Write write_value) {
+  SharedEntry* entry = this->find(id);
+  if (entry == nullptr) return false;
+  // odd while writing (also recovers from a writer that died halfway)
+  const uint32_t sequence = (entry->sequence.load(std::memory_order_relaxed) + 1) | 1;
+  entry->sequence.store(sequence, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  write_value(entry);
+  ++entry->writes[field];
+  entry->sequence.store(sequence + 1, std::memory_order_release);
+  return true;
+}
+
+bool SharedTableClient::setPosition(const Sprites::CanvasObjectID& id,
+                                    const Sprites::Point& p) {
+  return this->write(id, SHARED_POSITION,
+                     [&p](SharedEntry* entry) { entry->x = p.x; entry->y = p.y; });
+}
+bool SharedTableClient::setSpeed(const Sprites::CanvasObjectID& id,
+                                 const double speed) {
+  return this->write(id, SHARED_SPEED,
+                     [speed](SharedEntry* entry) { entry->speed = speed; });
+}
+bool SharedTableClient::setDirection(const Sprites::CanvasObjectID& id,
+                                     const double direction) {
+  return this->write(id, SHARED_DIRECTION,
+                     [direction](SharedEntry* entry) { entry->direction = direction; });
+}
+bool SharedTableClient::setVisible(const Sprites::CanvasObjectID& id,
+                                   const bool visible) {
+  return this->write(id, SHARED_VISIBLE,
+                     [visible](SharedEntry* entry) { entry->visible = visible; });
+}
+bool SharedTableClient::setZ(const Sprites::CanvasObjectID& id, const int z) {
+  return this->write(id, SHARED_Z, [z](SharedEntry* entry) { entry->z = z; });
+}
+
+} // end namespace led_loop
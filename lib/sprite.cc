@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <mutex>
 
 #include <Magick++.h>
 // #include <magick/image.h>
@@ -7,7 +10,13 @@
 #include "led-matrix.h"
 #include "graphics.h"
 
+#include "asset-pack.h"
+#include "frame-arena.h"
+#include "group.h"
+#include "pixel-canvas.h"
 #include "sprite.h"
+#include "timeline.h"
+#include "trace-events.h"
 
 
 namespace {
@@ -18,6 +27,11 @@ std::string generateID() {
     return std::to_string(idx);
 }
 
+uint64_t nextSerial() {
+  static std::atomic<uint64_t> serial(0);
+  return ++serial;
+}
+
 } // end anonymous namespace
 
 
@@ -28,7 +42,7 @@ PanelSize::PanelSize(size_t x, size_t y) : x(x), y(y) { };
 Point::Point(double x, double y) : x(x), y(y) { };
 Pixel::Pixel(char red, char green, char blue) : red(red), green(green), blue(blue) { };
 bool operator==(const Pixel& lhs, const Pixel& rhs) {
-  if (lhs.red == rhs.red && lhs.green && rhs.green && lhs.blue == rhs.blue) return true;
+  if (lhs.red == rhs.red && lhs.green == rhs.green && lhs.blue == rhs.blue) return true;
   return false;
 }
 
@@ -37,19 +51,23 @@ std::string& cython_abstract() { throw std::logic_error("CanvasObject is abstrac
 
 CanvasObject::CanvasObject() :
     width(0), height(0), max_dimensions(), edge_behavior(LOOP_INDIRECT),
-    visible(true), out_of_bounds(false), wrapped(false),
+    visible(true), out_of_bounds(false), wrapped(false), step_events(0),
     position(0, 0), direction(0), speed(0),
-    position_goal(nan(""), nan("")), goal_steps(-1) { this->id = generateID(); }
+    position_goal(nan(""), nan("")), goal_steps(-1), z(0),
+    timeline(nullptr), parent(nullptr), world_position(0, 0),
+    world_dirty(true), opacity(255), tint(255, 255, 255), flip_x(false),
+    flip_y(false), quarter_turns(0), owned_by_list(false),
+    serial(nextSerial()) { this->id = generateID(); }
 CanvasObject::CanvasObject(const std::string source) : CanvasObject() { this->setContent(source); }
-CanvasObject::~CanvasObject() { }
+CanvasObject::~CanvasObject() { delete this->timeline; }
 
-void CanvasObject::setID(CanvasObjectID id)          {        this->id = id; }
+void CanvasObject::setID(const CanvasObjectID& id)   {        this->id = id; }
 const CanvasObjectID& CanvasObject::getID() const    { return this->id; }
 size_t CanvasObject::getWidth() const         { return this->width; }
 void CanvasObject::setWidth(int width)               {        cython_abstract(); }
 size_t CanvasObject::getHeight() const        { return this->height; }
 void CanvasObject::setHeight(int height)             {        cython_abstract(); }
-void CanvasObject::setContent(const std::string filename) {   cython_abstract(); }
+void CanvasObject::setContent(const std::string& filename) {  cython_abstract(); }
 const std::string& CanvasObject::getContent() const  { return cython_abstract(); }
 
 // Data regarding the sprite's behavior and status at the edge
@@ -60,6 +78,9 @@ bool CanvasObject::getVisible() const {
   if (this->out_of_bounds) return false;
   return this->visible;
 }
+bool CanvasObject::getVisibleSetting() const {
+  return this->visible;
+}
 void CanvasObject::setEdgeBehavior(EdgeBehavior edge_behavior) {
   this->edge_behavior = edge_behavior;
 }
@@ -78,25 +99,104 @@ void CanvasObject::reachPosition(const Point p, const uint steps) {
   setDirection(direction);
   setSpeed(distance / this->goal_steps);
 }
-void CanvasObject::setPosition(const Point p)     {        this->position = p; }
+const Point& CanvasObject::getPositionGoal() const { return this->position_goal; }
+int CanvasObject::getGoalSteps() const            { return this->goal_steps; }
+void CanvasObject::setPosition(const Point p) {
+  this->position = p;
+  this->invalidateWorldPosition();
+}
 const Point& CanvasObject::getPosition() const    { return this->position; }
 void CanvasObject::setDirection(double ang)       {        this->direction = ang; }
 const double& CanvasObject::getDirection() const  { return this->direction; }
 void CanvasObject::setSpeed(double speed)         {        this->speed = speed; }
 const double& CanvasObject::getSpeed() const      { return this->speed; }
+void CanvasObject::setZ(const int z)              {        this->z = z; }
+int CanvasObject::getZ() const                    { return this->z; }
+void CanvasObject::setTimeline(Timeline* timeline) {
+  if (timeline == this->timeline) return;
+  delete this->timeline;
+  this->timeline = timeline;
+}
+Timeline* CanvasObject::getTimeline() const { return this->timeline; }
+
+// Hierarchy
+Group* CanvasObject::getParent() const { return this->parent; }
+const Point& CanvasObject::getWorldPosition() const {
+  if (this->parent == nullptr) {
+    this->world_dirty = false;
+    return this->position;
+  }
+  if (this->world_dirty) {
+    const Point& origin = this->parent->getWorldPosition();
+    this->world_position = Point(origin.x + this->position.x,
+                                 origin.y + this->position.y);
+    this->world_dirty = false;
+  }
+  return this->world_position;
+}
+void CanvasObject::invalidateWorldPosition() {
+  this->world_dirty = true;
+}
+
+// Render attributes
+void CanvasObject::setOpacity(const double opacity) {
+  this->opacity = std::round(std::min(1.0, std::max(0.0, opacity)) * 255);
+}
+double CanvasObject::getOpacity() const { return this->opacity / 255.0; }
+void CanvasObject::setTint(const uint8_t r, const uint8_t g, const uint8_t b) {
+  this->tint = rgb_matrix::Color(r, g, b);
+}
+const rgb_matrix::Color& CanvasObject::getTint() const { return this->tint; }
+void CanvasObject::setFlip(const bool horizontal, const bool vertical) {
+  this->flip_x = horizontal;
+  this->flip_y = vertical;
+}
+bool CanvasObject::getFlipX() const { return this->flip_x; }
+bool CanvasObject::getFlipY() const { return this->flip_y; }
+void CanvasObject::setQuarterTurns(const int quarter_turns) {
+  this->quarter_turns = (quarter_turns % 4 + 4) % 4;
+}
+int CanvasObject::getQuarterTurns() const { return this->quarter_turns; }
+bool CanvasObject::hasRenderAttributes() const {
+  return this->opacity != 255 || this->flip_x || this->flip_y
+      || this->quarter_turns != 0 || this->tint.r != 255
+      || this->tint.g != 255 || this->tint.b != 255;
+}
+
+// Ownership
+void CanvasObject::setOwnedByList(const bool owned) {
+  this->owned_by_list = owned;
+}
+bool CanvasObject::isOwnedByList() const { return this->owned_by_list; }
+uint64_t CanvasObject::getSerial() const { return this->serial; }
 
 // Let the Sprite go in a direction
 void CanvasObject::doStep() {
   this->direction = std::fmod(this->direction + 360, 360);
   double x = this->position.x + cos(this->direction * M_PI / 180) * this->speed;
   double y = this->position.y + sin(this->direction * M_PI / 180) * this->speed;
+  const bool was_out_of_bounds = this->out_of_bounds;
   this->out_of_bounds = false;
   this->wrapped = false;
-  this->position = wrap_edge(x, y);
-  if (this->goal_steps == 0) this->speed = 0;
+  this->step_events = 0;
+  // the edge behavior of the outermost group applies to the whole subtree
+  const Point moved = this->parent == nullptr ? wrap_edge(x, y) : Point(x, y);
+  if (moved.x != this->position.x || moved.y != this->position.y) {
+    this->position = moved;
+    this->invalidateWorldPosition();
+  }
+  if (this->out_of_bounds != was_out_of_bounds) {
+    this->step_events |= this->out_of_bounds ? LEFT_SCREEN : ENTERED_SCREEN;
+  }
+  if (this->goal_steps == 0) {
+    this->speed = 0;
+    this->step_events |= GOAL_REACHED;
+  }
   if (this->goal_steps >= 0) --this->goal_steps;
+  if (this->timeline != nullptr) this->timeline->step(this);
 }
-void CanvasObject::draw(rgb_matrix::FrameCanvas* canvas) const { cython_abstract(); }
+uint8_t CanvasObject::getStepEvents() const { return this->step_events; }
+void CanvasObject::draw(rgb_matrix::Canvas* canvas) const { cython_abstract(); }
 Point CanvasObject::wrap_edge(double x, double y) {
   size_t xmax = this->max_dimensions.x;
   size_t ymax = this->max_dimensions.y;
@@ -112,13 +212,16 @@ Point CanvasObject::wrap_edge(double x, double y) {
     if (std::round(y) > ymax)       y -= ymax;
     this->wrapped = true;
   } else if (this->edge_behavior == BOUNCE) {
+    const double direction = this->direction;
     if (x < 0 || x + this->getWidth()  > xmax) setDirection(180 - this->direction);
     if (y < 0 || y + this->getHeight() > ymax) setDirection(360 - this->direction);
+    if (this->direction != direction) this->step_events |= EDGE_HIT;
   } else if (this->edge_behavior == STOP) {
     if (   (                    x < 0    && std::fmod(this->direction + 270, 360) < 180)
         || ( x + this->getWidth() > xmax && std::fmod(this->direction + 90, 360)  < 180)
         || (                    y < 0    && std::fmod(this->direction + 180, 360) < 180)
         || (y + this->getHeight() > ymax &&                       this->direction < 180)) {
+      if (this->speed != 0) this->step_events |= EDGE_HIT;
       this->speed = 0;
     }
   }
@@ -133,58 +236,215 @@ Point CanvasObject::wrap_edge(double x, double y) {
 
 
 
+// The mapping is affine, so it is kept as the canvas position of the box
+// pixel (0, 0) and the steps for one pixel to the right and one down
+RenderCanvas::RenderCanvas(rgb_matrix::Canvas* target, const CanvasObject& object,
+                           const int box_x, const int box_y, const int box_width,
+                           const int box_height) :
+    target(target), memory(dynamic_cast<PixelCanvas*>(target)), box_x(box_x),
+    box_y(box_y), tint(object.getTint()),
+    opacity(std::round(object.getOpacity() * 255)) {
+  const int w = box_width;
+  const int h = box_height;
+  const bool flip_x = object.getFlipX();
+  const bool flip_y = object.getFlipY();
+  auto map = [&](const int x, const int y) {
+    const int fx = flip_x ? w - 1 - x : x;
+    const int fy = flip_y ? h - 1 - y : y;
+    switch (object.getQuarterTurns()) {
+      case 1:  return Step{h - 1 - fy, fx};
+      case 2:  return Step{w - 1 - fx, h - 1 - fy};
+      case 3:  return Step{fy, w - 1 - fx};
+      default: return Step{fx, fy};
+    }
+  };
+  const Step origin = map(0, 0);
+  const Step right = map(1, 0);
+  const Step down = map(0, 1);
+  this->origin_x = box_x + origin.x;
+  this->origin_y = box_y + origin.y;
+  this->x_step = Step{right.x - origin.x, right.y - origin.y};
+  this->y_step = Step{down.x - origin.x, down.y - origin.y};
+}
+void RenderCanvas::put(const int x, const int y, uint8_t red, uint8_t green,
+                       uint8_t blue) {
+  red = red * this->tint.r / 255;
+  green = green * this->tint.g / 255;
+  blue = blue * this->tint.b / 255;
+  if (this->opacity == 255) {
+    this->target->SetPixel(x, y, red, green, blue);
+  } else if (this->memory != nullptr) {
+    this->memory->blendPixel(x, y, red, green, blue, this->opacity);
+  } else {
+    this->target->SetPixel(x, y, red * this->opacity / 255,
+                           green * this->opacity / 255,
+                           blue * this->opacity / 255);
+  }
+}
+int RenderCanvas::width() const  { return this->target->width(); }
+int RenderCanvas::height() const { return this->target->height(); }
+void RenderCanvas::SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue) {
+  x -= this->box_x;
+  y -= this->box_y;
+  this->put(this->mapX(x, y), this->mapY(x, y), red, green, blue);
+}
+void RenderCanvas::Clear() { this->target->Clear(); }
+void RenderCanvas::Fill(uint8_t red, uint8_t green, uint8_t blue) {
+  this->target->Fill(red, green, blue);
+}
+
+
+
 // Sprite constructor and Image loading / initialization
-Sprite::Sprite() : CanvasObject::CanvasObject(), img(), resize_factor(1.0),
+Sprite::Sprite() : CanvasObject::CanvasObject(), img(), pixels(nullptr),
+                   mask(nullptr), image_stale(false), resize_factor(1.0),
                    rotation(0) { }
 Sprite::Sprite(const std::string filename) : Sprite() { this->setContent(filename); }
 Sprite::~Sprite() { }
 
-void Sprite::setContent(const std::string filename, size_t index) {
+void Sprite::setContent(const std::string& filename) {
+  ScopedTrace trace("Sprite::setContent", "decode");
+  this->filename = filename;
+  this->resize_factor = 1.0;
+  this->rotation = 0;
+  PackedImage packed;
+  if (AssetPack::lookup(filename, 0, &packed)) {
+    this->setContent(packed);
+    return;
+  }
   std::vector<Magick::Image> frames;
   try {
     Magick::readImages(&frames, filename);
   } catch (std::exception& e) {
     if (e.what()) fprintf(stderr, "Magickimage error: %s\n", e.what());
   }
-  if (frames.size() == 0) fprintf(stderr, "No image found.\n");
+  if (frames.size() == 0) {
+    fprintf(stderr, "No image found.\n");
+    return;
+  }
   this->img = frames[0];
   Magick::ColorRGB black = Magick::ColorRGB(0, 0, 0);
   this->img.backgroundColor(black);
-  // this->width = this->img.columns();
-  // this->height = this->img.rows();
+  this->updatePixels();
+}
+// Use pre-decoded pixels (e.g. from an AssetPack) without copying them
+void Sprite::setContent(const PackedImage& packed) {
+  this->img = Magick::Image();
+  this->pixel_buffer.clear();
+  this->mask_buffer.clear();
+  this->pixels = packed.pixels;
+  this->mask = packed.mask;
+  this->width = packed.width;
+  this->height = packed.height;
+  this->image_stale = true;
 }
 const std::string& Sprite::getContent() const {
   return this->filename;
 }
+
+// Export the Magick image into the pixel and mask buffers used for drawing
+void Sprite::updatePixels() {
+  this->width = this->img.columns();
+  this->height = this->img.rows();
+  const size_t n_pixels = this->width * this->height;
+  std::vector<uint8_t> rgba(n_pixels * 4);
+  if (n_pixels > 0) {
+    this->img.write(0, 0, this->width, this->height, "RGBA",
+                    Magick::CharPixel, rgba.data());
+  }
+  this->pixel_buffer.resize(n_pixels * 3);
+  this->mask_buffer.resize(n_pixels);
+  for (size_t i = 0; i < n_pixels; ++i) {
+    this->pixel_buffer[i * 3]     = rgba[i * 4];
+    this->pixel_buffer[i * 3 + 1] = rgba[i * 4 + 1];
+    this->pixel_buffer[i * 3 + 2] = rgba[i * 4 + 2];
+    this->mask_buffer[i]          = rgba[i * 4 + 3];
+  }
+  this->pixels = this->pixel_buffer.data();
+  this->mask = this->mask_buffer.data();
+  this->image_stale = false;
+}
+// Rebuild the Magick image if the pixels were changed (or came from a pack)
+void Sprite::updateImage() {
+  if (!this->image_stale) return;
+  const size_t n_pixels = this->width * this->height;
+  std::vector<uint8_t> rgba(n_pixels * 4);
+  for (size_t i = 0; i < n_pixels; ++i) {
+    rgba[i * 4]     = this->pixels[i * 3];
+    rgba[i * 4 + 1] = this->pixels[i * 3 + 1];
+    rgba[i * 4 + 2] = this->pixels[i * 3 + 2];
+    rgba[i * 4 + 3] = this->mask[i];
+  }
+  this->img.read(this->width, this->height, "RGBA", Magick::CharPixel, rgba.data());
+  this->image_stale = false;
+}
+// Copy pixels that point into a pack before they are modified
+void Sprite::ownPixels() {
+  if (this->pixels == this->pixel_buffer.data()) return;
+  const size_t n_pixels = this->width * this->height;
+  this->pixel_buffer.assign(this->pixels, this->pixels + n_pixels * 3);
+  this->mask_buffer.assign(this->mask, this->mask + n_pixels);
+  this->pixels = this->pixel_buffer.data();
+  this->mask = this->mask_buffer.data();
+}
+
 void Sprite::setResize(double resize_factor) {
   double abs_resize_factor = resize_factor / this->resize_factor;
-  const double target_width = (double) img.columns() * abs_resize_factor;
-  const double target_height = (double) img.rows() * abs_resize_factor;
+  const double target_width = (double) this->width * abs_resize_factor;
+  const double target_height = (double) this->height * abs_resize_factor;
+  // a pack may already hold the image in the requested size
+  PackedImage packed;
+  if (this->rotation == 0 && !this->filename.empty()
+      && AssetPack::lookup(this->filename, std::round(target_height), &packed)) {
+    this->setContent(packed);
+    this->resize_factor = resize_factor;
+    return;
+  }
+  this->updateImage();
   this->img.scale(Magick::Geometry(target_width, target_height));
   this->resize_factor = resize_factor;
-  // this->width = this->img.columns();
-  // this->height = this->img.rows();
+  this->updatePixels();
 }
 const double& Sprite::getResize() const {
   return this->resize_factor;
 }
-size_t Sprite::getWidth() const  { return this->img.columns(); }
+size_t Sprite::getWidth() const  { return this->width; }
 void Sprite::setWidth(int width) {
   double new_resize = width / (this->getWidth() / this->resize_factor);
   this->setResize(new_resize);
 }
-size_t Sprite::getHeight() const { return this->img.rows(); }
+size_t Sprite::getHeight() const { return this->height; }
 void Sprite::setHeight(const int height) {
   double new_resize = height / (this->getHeight() / this->resize_factor);
   this->setResize(new_resize);
 }
 void Sprite::setRotation(double rotation) {
   double rotation_diff = rotation - this->rotation;
+  this->updateImage();
   this->img.rotate(rotation_diff);
+  this->rotation = rotation;
+  this->updatePixels();
 }
 const double& Sprite::getRotation() const {
   return this->rotation;
 }
+const Magick::Image& Sprite::getImage() {
+  this->updateImage();
+  return this->img;
+}
+void Sprite::setImage(const Magick::Image& image, const double resize_factor,
+                      const double rotation) {
+  this->img = image;
+  this->resize_factor = resize_factor;
+  this->rotation = rotation;
+  this->updatePixels();
+}
+void Sprite::setImage(const PackedImage& packed, const double resize_factor,
+                      const double rotation) {
+  this->setPixels(packed.pixels, packed.width, packed.height, packed.mask);
+  this->resize_factor = resize_factor;
+  this->rotation = rotation;
+}
 
 
 // Non-interface methods
@@ -192,54 +452,108 @@ void Sprite::setPixel(const Point point, const Pixel pixel) {
   this->setPixel(point.x, point.y, pixel.red, pixel.green, pixel.blue);
 }
 void Sprite::setPixel(const size_t x, const size_t y, const char r, const char g, const char b) {
-  if (x > this->getWidth() || y > this->getHeight()) return;
-  Magick::ColorRGB c = Magick::ColorRGB(r / 255, g / 255, b / 255);
-  this->img.pixelColor(x, y, c);
+  if (x >= this->getWidth() || y >= this->getHeight()) return;
+  this->ownPixels();
+  const size_t idx = y * this->width + x;
+  this->pixel_buffer[idx * 3]     = r;
+  this->pixel_buffer[idx * 3 + 1] = g;
+  this->pixel_buffer[idx * 3 + 2] = b;
+  this->mask_buffer[idx] = 255;
+  this->image_stale = true;
+}
+// Replace the whole image with packed RGB data (and optionally opacities)
+void Sprite::setPixels(const uint8_t* rgb, const size_t width, const size_t height,
+                       const uint8_t* opacity) {
+  const size_t n_pixels = width * height;
+  this->pixel_buffer.resize(n_pixels * 3);
+  this->mask_buffer.resize(n_pixels);
+  std::memcpy(this->pixel_buffer.data(), rgb, n_pixels * 3);
+  if (opacity != nullptr) {
+    std::memcpy(this->mask_buffer.data(), opacity, n_pixels);
+  } else {
+    std::memset(this->mask_buffer.data(), 255, n_pixels);
+  }
+  this->pixels = this->pixel_buffer.data();
+  this->mask = this->mask_buffer.data();
+  this->width = width;
+  this->height = height;
+  this->resize_factor = 1.0;
+  this->rotation = 0;
+  this->image_stale = true;
+}
+// Writable packed RGB pixels (width * height * 3 bytes). They stay valid until
+// the image is replaced, resized or rotated.
+uint8_t* Sprite::getPixelData() {
+  this->ownPixels();
+  this->image_stale = true;
+  return this->pixel_buffer.data();
 }
 static Pixel EMPTY_PIXEL = {0, 0, 0};
 const Pixel Sprite::getPixel(const size_t x, const size_t y) const {
   if (!this->visible) return EMPTY_PIXEL;
-  if ((size_t) x > this->getWidth()) return EMPTY_PIXEL;
-  if ((size_t) y > this->getHeight()) return EMPTY_PIXEL;
-
-  const Magick::Color &c = this->img.pixelColor(x, y);
-  char red   = (char) ScaleQuantumToChar(c.redQuantum());
-  char green = (char) ScaleQuantumToChar(c.greenQuantum());
-  char blue  = (char) ScaleQuantumToChar(c.blueQuantum());
-  Pixel pixel = Pixel({red, green, blue});
-  return pixel;
-}
-const Points Sprite::getOverlap(const Sprite* other) const {
-  Points points;
-  if (!this->getVisible() or !other->getVisible()) return points;
-  double dx = this->getPosition().x - other->getPosition().x;
-  double dy = this->getPosition().y - other->getPosition().y;
+  if ((size_t) x >= this->getWidth()) return EMPTY_PIXEL;
+  if ((size_t) y >= this->getHeight()) return EMPTY_PIXEL;
+  const size_t idx = y * this->width + x;
+  if (this->mask[idx] == 0) return EMPTY_PIXEL;
+  const uint8_t* px = this->pixels + idx * 3;
+  return Pixel(px[0], px[1], px[2]);
+}
+void Sprite::getOverlap(const Sprite* other, Points* points) const {
+  points->clear();
+  if (!this->getVisible() or !other->getVisible()) return;
+  double dx = this->getWorldPosition().x - other->getWorldPosition().x;
+  double dy = this->getWorldPosition().y - other->getWorldPosition().y;
   for (size_t img_y = 0; img_y < this->getHeight(); ++img_y) {
     for (size_t img_x = 0; img_x < this->getWidth(); ++img_x) {
       const Pixel px = this->getPixel(img_x, img_y);
       const Pixel px_o = other->getPixel(img_x - dx, img_y - dy);
       if (px == EMPTY_PIXEL and px_o == EMPTY_PIXEL) continue;
-      Point p = Point(img_x, img_y);
-      points.push_back(p);
+      points->push_back(Point(img_x, img_y));
     }
   }
-  return points;
 }
-void Sprite::draw(rgb_matrix::FrameCanvas* canvas) const {
-  if (!this->getVisible()) return;
-  int x0 = std::round(this->getPosition().x);
-  int y0 = std::round(this->getPosition().y);
+void Sprite::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible() || this->pixels == nullptr) return;
+  int x0 = std::round(this->getWorldPosition().x);
+  int y0 = std::round(this->getWorldPosition().y);
+  if (this->hasRenderAttributes()) {
+    this->drawAttributed(canvas, x0, y0);
+    return;
+  }
   for (size_t img_y = 0; img_y < this->getHeight(); ++img_y) {
+    const size_t row = img_y * this->width;
     for (size_t img_x = 0; img_x < this->getWidth(); ++img_x) {
-      const Pixel pix = this->getPixel(img_x, img_y);
-      if (pix == EMPTY_PIXEL) continue;
+      if (this->mask[row + img_x] == 0) continue;
+      const uint8_t* px = this->pixels + (row + img_x) * 3;
+      if (px[0] == 0 && px[1] == 0 && px[2] == 0) continue;
       int x = img_x + x0;
       int y = img_y + y0;
       if (this->wrapped) {
         if (x > canvas->width())  x -= canvas->width();
         if (y > canvas->height()) y -= canvas->height();
       }
-      canvas->SetPixel(x, y, pix.red, pix.green, pix.blue);
+      canvas->SetPixel(x, y, px[0], px[1], px[2]);
+    }
+  }
+}
+// The same blit, with every pixel mapped through the flips and turns
+void Sprite::drawAttributed(rgb_matrix::Canvas* canvas, const int x0,
+                            const int y0) const {
+  if (this->opacity == 0) return;
+  RenderCanvas render(canvas, *this, x0, y0, this->width, this->height);
+  for (size_t img_y = 0; img_y < this->getHeight(); ++img_y) {
+    const size_t row = img_y * this->width;
+    for (size_t img_x = 0; img_x < this->getWidth(); ++img_x) {
+      if (this->mask[row + img_x] == 0) continue;
+      const uint8_t* px = this->pixels + (row + img_x) * 3;
+      if (px[0] == 0 && px[1] == 0 && px[2] == 0) continue;
+      int x = render.mapX(img_x, img_y);
+      int y = render.mapY(img_x, img_y);
+      if (this->wrapped) {
+        if (x > canvas->width())  x -= canvas->width();
+        if (y > canvas->height()) y -= canvas->height();
+      }
+      render.put(x, y, px[0], px[1], px[2]);
     }
   }
 }
@@ -247,27 +561,29 @@ void Sprite::draw(rgb_matrix::FrameCanvas* canvas) const {
 
 
 Text::Text() : CanvasObject::CanvasObject(), color(255, 255, 255),
-               fontfilename(""), text(""), kerning(0) { }
+               fontfilename(""), text(""), kerning(0), text_width(0) { }
 Text::Text(const std::string fontfilename, const std::string content) : Text() {
   this->setContent(content);
   this->setFont(fontfilename);
 }
 Text::~Text() { }
 
-void Text::setContent(const std::string content) {
+void Text::setContent(const std::string& content) {
   this->text = content;
+  this->updateTextWidth();
 }
 const std::string& Text::getContent() const {
   return this->text;
 }
 
 // Non-interface methods
-void Text::setFont(const std::string fontfilename) {
+void Text::setFont(const std::string& fontfilename) {
   if (!this->font.LoadFont(fontfilename.c_str())) {
     fprintf(stderr, "Couldn't load font '%s'\n", fontfilename.c_str());
     return;
   }
   this->fontfilename = fontfilename;
+  this->updateTextWidth();
 }
 const std::string& Text::getFont() const {
   return this->fontfilename;
@@ -275,17 +591,120 @@ const std::string& Text::getFont() const {
 
 void Text::setKerning(const float kerning) {
   this->kerning = (int)kerning;
+  this->updateTextWidth();
 }
 const int& Text::getKerning() const {
   return this->kerning;
 }
-void Text::draw(rgb_matrix::FrameCanvas* canvas) const {
+void Text::setColor(const uint8_t r, const uint8_t g, const uint8_t b) {
+  this->color = rgb_matrix::Color(r, g, b);
+}
+const rgb_matrix::Color& Text::getColor() const {
+  return this->color;
+}
+// The box of the text for flips and turns, DrawText returns the advance
+void Text::updateTextWidth() {
+  if (this->fontfilename.empty()) return;
+  PixelCanvas measure(0, 0);
+  this->text_width = rgb_matrix::DrawText(&measure, this->font, 0,
+                                          this->font.baseline(), this->color,
+                                          NULL, this->text.c_str(),
+                                          this->kerning);
+}
+void Text::draw(rgb_matrix::Canvas* canvas) const {
   if (this->fontfilename.empty()) { return; }
-  rgb_matrix::DrawText(canvas, this->font, this->position.x,
-                       this->position.y + this->font.baseline(),
+  const Point& origin = this->getWorldPosition();
+  RenderCanvas render(canvas, *this, origin.x, origin.y, this->text_width,
+                      this->font.height());
+  if (this->hasRenderAttributes()) {
+    if (this->opacity == 0) return;
+    canvas = &render;
+  }
+  rgb_matrix::DrawText(canvas, this->font, origin.x,
+                       origin.y + this->font.baseline(),
                        this->color, NULL, this->text.c_str(),
                        this->kerning);
 }
 
 
+
+// Merges runs of doubling length back and forth between the list and the
+// scratch space. std::merge takes from the first run on ties, which keeps
+// objects of equal z in list (ID) order
+void sortByZ(std::vector<CanvasObject*>* objects) {
+  auto by_z = [](const CanvasObject* a, const CanvasObject* b) {
+    return a->getZ() < b->getZ();
+  };
+  const size_t n = objects->size();
+  if (std::is_sorted(objects->begin(), objects->end(), by_z)) return;
+  FrameArena* arena = FrameArena::current();
+  if (arena == nullptr) {
+    std::stable_sort(objects->begin(), objects->end(), by_z);
+    return;
+  }
+  CanvasObject** src = objects->data();
+  CanvasObject** dst = arena->allocate<CanvasObject*>(n);
+  for (size_t run = 1; run < n; run *= 2) {
+    for (size_t begin = 0; begin < n; begin += 2 * run) {
+      const size_t middle = std::min(begin + run, n);
+      const size_t end = std::min(begin + 2 * run, n);
+      std::merge(src + begin, src + middle, src + middle, src + end,
+                 dst + begin, by_z);
+    }
+    std::swap(src, dst);
+  }
+  if (src != objects->data()) std::copy(src, src + n, objects->data());
+}
+
+
+
+// Bulk updates
+namespace {
+
+template <typename T, typename Setter>
+size_t applyToObjects(CanvasObjectList* cvos,
+                      const std::vector<CanvasObjectID>& ids,
+                      const std::vector<T>& values,
+                      std::mutex* data_mutex, Setter setter) {
+  const size_t n = std::min(ids.size(), values.size());
+  size_t n_updated = 0;
+  std::unique_lock<std::mutex> guard;
+  if (data_mutex != nullptr) {
+    lockTraced(data_mutex, "wait bulk update lock");
+    guard = std::unique_lock<std::mutex>(*data_mutex, std::adopt_lock);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    CanvasObjectListIterator it = cvos->find(ids[i]);
+    if (it == cvos->end()) continue;
+    setter(it->second, values[i]);
+    ++n_updated;
+  }
+  return n_updated;
+}
+
+} // end anonymous namespace
+
+size_t setPositions(CanvasObjectList* cvos,
+                    const std::vector<CanvasObjectID>& ids,
+                    const std::vector<Point>& positions,
+                    std::mutex* data_mutex) {
+  return applyToObjects(cvos, ids, positions, data_mutex,
+      [](CanvasObject* cvo, const Point& p) { cvo->setPosition(p); });
+}
+size_t setSpeeds(CanvasObjectList* cvos,
+                 const std::vector<CanvasObjectID>& ids,
+                 const std::vector<double>& speeds,
+                 std::mutex* data_mutex) {
+  return applyToObjects(cvos, ids, speeds, data_mutex,
+      [](CanvasObject* cvo, double speed) { cvo->setSpeed(speed); });
+}
+size_t setVisibilities(CanvasObjectList* cvos,
+                       const std::vector<CanvasObjectID>& ids,
+                       const std::vector<bool>& visibilities,
+                       std::mutex* data_mutex) {
+  return applyToObjects(cvos, ids, visibilities, data_mutex,
+      [](CanvasObject* cvo, bool visible) { cvo->setVisible(visible); });
+}
+
+
 } // end namespace Sprites
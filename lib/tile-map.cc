@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <Magick++.h>
+
+#include "asset-pack.h"
+#include "canvas.h"
+#include "sprite.h"
+#include "tile-map.h"
+
+
+namespace {
+
+typedef std::tuple<std::string, size_t, size_t> AtlasKey;
+
+std::mutex& atlasMutex() {
+  static std::mutex atlas_mutex;
+  return atlas_mutex;
+}
+// Atlases stay alive as long as a TileMap uses them
+std::map<AtlasKey, std::weak_ptr<const Sprites::TileAtlas>>& atlases() {
+  static std::map<AtlasKey, std::weak_ptr<const Sprites::TileAtlas>> cache;
+  return cache;
+}
+
+// floor modulo, for scrolling to the left or up
+long wrap(const long value, const long size) {
+  const long result = value % size;
+  return result < 0 ? result + size : result;
+}
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+TileAtlas::TileAtlas() : filename(""), tile_width(0), tile_height(0),
+                         columns(0), rows(0), image_width(0), pixels(nullptr),
+                         mask(nullptr) { }
+
+bool TileAtlas::load(const std::string& filename, const size_t tile_width,
+                     const size_t tile_height) {
+  if (tile_width == 0 || tile_height == 0) {
+    fprintf(stderr, "Tile size of atlas '%s' must not be 0\n", filename.c_str());
+    return false;
+  }
+  size_t image_height = 0;
+  PackedImage packed;
+  if (AssetPack::lookup(filename, 0, &packed)) {
+    this->pixels = packed.pixels;
+    this->mask = packed.mask;
+    this->image_width = packed.width;
+    image_height = packed.height;
+  } else {
+    Magick::Image img;
+    try {
+      img.read(filename);
+    } catch (std::exception& e) {
+      if (e.what()) fprintf(stderr, "Magickimage error: %s\n", e.what());
+      return false;
+    }
+    this->image_width = img.columns();
+    image_height = img.rows();
+    const size_t n_pixels = this->image_width * image_height;
+    std::vector<uint8_t> rgba(n_pixels * 4);
+    if (n_pixels > 0) {
+      img.write(0, 0, this->image_width, image_height, "RGBA",
+                Magick::CharPixel, rgba.data());
+    }
+    this->pixel_buffer.resize(n_pixels * 3);
+    this->mask_buffer.resize(n_pixels);
+    for (size_t i = 0; i < n_pixels; ++i) {
+      this->pixel_buffer[i * 3]     = rgba[i * 4];
+      this->pixel_buffer[i * 3 + 1] = rgba[i * 4 + 1];
+      this->pixel_buffer[i * 3 + 2] = rgba[i * 4 + 2];
+      this->mask_buffer[i]          = rgba[i * 4 + 3];
+    }
+    this->pixels = this->pixel_buffer.data();
+    this->mask = this->mask_buffer.data();
+  }
+  this->filename = filename;
+  this->tile_width = tile_width;
+  this->tile_height = tile_height;
+  this->columns = this->image_width / tile_width;
+  this->rows = image_height / tile_height;
+  if (this->getTileCount() == 0) {
+    fprintf(stderr, "Atlas '%s' is smaller than one tile\n", filename.c_str());
+    return false;
+  }
+  return true;
+}
+const std::string& TileAtlas::getFilename() const { return this->filename; }
+size_t TileAtlas::getTileWidth() const  { return this->tile_width; }
+size_t TileAtlas::getTileHeight() const { return this->tile_height; }
+size_t TileAtlas::getTileCount() const  { return this->columns * this->rows; }
+size_t TileAtlas::getStride() const     { return this->image_width; }
+const uint8_t* TileAtlas::getTilePixels(const size_t index) const {
+  const size_t x = index % this->columns * this->tile_width;
+  const size_t y = index / this->columns * this->tile_height;
+  return this->pixels + (y * this->image_width + x) * 3;
+}
+const uint8_t* TileAtlas::getTileMask(const size_t index) const {
+  const size_t x = index % this->columns * this->tile_width;
+  const size_t y = index / this->columns * this->tile_height;
+  return this->mask + y * this->image_width + x;
+}
+
+std::shared_ptr<const TileAtlas> TileAtlas::get(const std::string& filename,
+                                                const size_t tile_width,
+                                                const size_t tile_height) {
+  std::lock_guard<std::mutex> guard(atlasMutex());
+  const AtlasKey key(filename, tile_width, tile_height);
+  std::shared_ptr<const TileAtlas> atlas = atlases()[key].lock();
+  if (atlas != nullptr) return atlas;
+  std::shared_ptr<TileAtlas> loaded = std::make_shared<TileAtlas>();
+  if (!loaded->load(filename, tile_width, tile_height)) {
+    atlases().erase(key);
+    return nullptr;
+  }
+  atlases()[key] = loaded;
+  return loaded;
+}
+
+
+TileMap::TileMap() : CanvasObject::CanvasObject(), atlas_filename(""),
+                     tile_width(8), tile_height(8), atlas(), columns(0),
+                     rows(0), tiles(), scroll(0, 0), wrap_scroll(false) {
+  this->setViewport(this->max_dimensions.x, this->max_dimensions.y);
+}
+TileMap::TileMap(const std::string atlas_filename, const size_t tile_width,
+                 const size_t tile_height, const size_t columns,
+                 const size_t rows) : TileMap() {
+  this->setMapSize(columns, rows);
+  this->setTileSize(tile_width, tile_height);
+  this->setContent(atlas_filename);
+}
+
+void TileMap::setContent(const std::string& atlas_filename) {
+  this->atlas_filename = atlas_filename;
+  if (atlas_filename.empty()) {
+    this->atlas = nullptr;
+    return;
+  }
+  this->atlas = TileAtlas::get(atlas_filename, this->tile_width,
+                               this->tile_height);
+}
+const std::string& TileMap::getContent() const {
+  return this->atlas_filename;
+}
+void TileMap::setTileSize(const size_t tile_width, const size_t tile_height) {
+  this->tile_width = tile_width;
+  this->tile_height = tile_height;
+  if (!this->atlas_filename.empty()) this->setContent(this->atlas_filename);
+}
+size_t TileMap::getTileCount() const {
+  return this->atlas != nullptr ? this->atlas->getTileCount() : 0;
+}
+
+void TileMap::setMapSize(const size_t columns, const size_t rows) {
+  std::vector<int32_t> tiles(columns * rows, EMPTY_TILE);
+  for (size_t row = 0; row < std::min(rows, this->rows); ++row) {
+    for (size_t column = 0; column < std::min(columns, this->columns); ++column) {
+      tiles[row * columns + column] = this->tiles[row * this->columns + column];
+    }
+  }
+  this->tiles.swap(tiles);
+  this->columns = columns;
+  this->rows = rows;
+}
+size_t TileMap::getColumns() const  { return this->columns; }
+size_t TileMap::getRows() const     { return this->rows; }
+void TileMap::setTile(const size_t column, const size_t row, const int32_t index) {
+  if (column >= this->columns || row >= this->rows) return;
+  this->tiles[row * this->columns + column] = index;
+}
+int32_t TileMap::getTile(const size_t column, const size_t row) const {
+  if (column >= this->columns || row >= this->rows) return EMPTY_TILE;
+  return this->tiles[row * this->columns + column];
+}
+void TileMap::setTiles(const std::vector<int32_t>& indices) {
+  const size_t n = std::min(indices.size(), this->tiles.size());
+  std::copy(indices.begin(), indices.begin() + n, this->tiles.begin());
+  std::fill(this->tiles.begin() + n, this->tiles.end(), EMPTY_TILE);
+}
+void TileMap::fill(const int32_t index) {
+  std::fill(this->tiles.begin(), this->tiles.end(), index);
+}
+
+void TileMap::setScroll(const Point& offset)  { this->scroll = offset; }
+const Point& TileMap::getScroll() const       { return this->scroll; }
+void TileMap::setViewport(const size_t width, const size_t height) {
+  this->width = width;
+  this->height = height;
+}
+void TileMap::setWrapScroll(const bool wrap_scroll) {
+  this->wrap_scroll = wrap_scroll;
+}
+bool TileMap::getWrapScroll() const { return this->wrap_scroll; }
+
+// Walks the visible rows of the viewport in spans of one tile each, so the
+// tile index is looked up once per span and not once per pixel
+void TileMap::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible() || this->atlas == nullptr || this->tiles.empty()) return;
+  const TileAtlas& atlas = *this->atlas;
+  const long tile_w = this->tile_width;
+  const long tile_h = this->tile_height;
+  const long map_w = this->columns * tile_w;
+  const long map_h = this->rows * tile_h;
+  const int32_t n_tiles = atlas.getTileCount();
+  const size_t stride = atlas.getStride();
+  const Point& origin = this->getWorldPosition();
+  const long x0 = std::lround(origin.x);
+  const long y0 = std::lround(origin.y);
+  const long scroll_x = std::lround(this->scroll.x);
+  const long scroll_y = std::lround(this->scroll.y);
+  // the part of the viewport that is on the canvas
+  const long x_begin = std::max(0L, x0);
+  const long x_end = std::min<long>(canvas->width(), x0 + this->width);
+  const long y_begin = std::max(0L, y0);
+  const long y_end = std::min<long>(canvas->height(), y0 + this->height);
+  for (long y = y_begin; y < y_end; ++y) {
+    long map_y = y - y0 + scroll_y;
+    if (this->wrap_scroll) {
+      map_y = wrap(map_y, map_h);
+    } else if (map_y < 0 || map_y >= map_h) {
+      continue;
+    }
+    const int32_t* tile_row = this->tiles.data() + map_y / tile_h * this->columns;
+    const size_t ty = map_y % tile_h;
+    long x = x_begin;
+    while (x < x_end) {
+      long map_x = x - x0 + scroll_x;
+      if (this->wrap_scroll) {
+        map_x = wrap(map_x, map_w);
+      } else if (map_x < 0 || map_x >= map_w) {
+        // jump to where the map starts or stop after it
+        if (map_x >= map_w) break;
+        x -= map_x;
+        continue;
+      }
+      const long tx = map_x % tile_w;
+      const long span = std::min(tile_w - tx, x_end - x);
+      const int32_t index = tile_row[map_x / tile_w];
+      if (index >= 0 && index < n_tiles) {
+        const uint8_t* px = atlas.getTilePixels(index) + (ty * stride + tx) * 3;
+        const uint8_t* opacity = atlas.getTileMask(index) + ty * stride + tx;
+        for (long i = 0; i < span; ++i, px += 3) {
+          if (opacity[i] == 0) continue;
+          canvas->SetPixel(x + i, y, px[0], px[1], px[2]);
+        }
+      }
+      x += span;
+    }
+  }
+}
+
+} // end namespace Sprites
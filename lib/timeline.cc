@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include <Magick++.h>
+
+#include "asset-pack.h"
+#include "sprite.h"
+#include "timeline.h"
+
+
+namespace Sprites {
+
+Easing resolveEasing(const std::string& str) {
+  if (str == "" || str == "linear") return LINEAR;
+  if (str == "step") return STEP;
+  if (str == "ease_in") return EASE_IN;
+  if (str == "ease_out") return EASE_OUT;
+  if (str == "ease_in_out") return EASE_IN_OUT;
+  if (str == "cubic_in") return CUBIC_IN;
+  if (str == "cubic_out") return CUBIC_OUT;
+  if (str == "cubic_in_out") return CUBIC_IN_OUT;
+  if (str == "sine_in_out") return SINE_IN_OUT;
+  if (str == "back_out") return BACK_OUT;
+  if (str == "bounce_out") return BOUNCE_OUT;
+  fprintf(stderr, "Unknown easing '%s', using linear\n", str.c_str());
+  return LINEAR;
+}
+
+double ease(const Easing easing, const double t) {
+  switch (easing) {
+    case STEP :         return t < 1 ? 0 : 1;
+    case EASE_IN :      return t * t;
+    case EASE_OUT :     return t * (2 - t);
+    case EASE_IN_OUT :  return t < 0.5 ? 2 * t * t : -1 + (4 - 2 * t) * t;
+    case CUBIC_IN :     return t * t * t;
+    case CUBIC_OUT :    return 1 + pow(t - 1, 3);
+    case CUBIC_IN_OUT : return t < 0.5 ? 4 * t * t * t : 1 + 4 * pow(t - 1, 3);
+    case SINE_IN_OUT :  return 0.5 - 0.5 * cos(t * M_PI);
+    case BACK_OUT : {
+      const double s = 1.70158;
+      return 1 + (s + 1) * pow(t - 1, 3) + s * pow(t - 1, 2);
+    }
+    case BOUNCE_OUT : {
+      const double n = 7.5625;
+      const double d = 2.75;
+      if (t < 1 / d)   return n * t * t;
+      if (t < 2 / d)   return n * (t - 1.5 / d) * (t - 1.5 / d) + 0.75;
+      if (t < 2.5 / d) return n * (t - 2.25 / d) * (t - 2.25 / d) + 0.9375;
+      return n * (t - 2.625 / d) * (t - 2.625 / d) + 0.984375;
+    }
+    default :           return t;
+  }
+}
+
+TimelineProperty resolveTimelineProperty(const std::string& str) {
+  if (str == "position") return TIMELINE_POSITION;
+  if (str == "visible") return TIMELINE_VISIBLE;
+  if (str == "rotation") return TIMELINE_ROTATION;
+  if (str == "scale") return TIMELINE_SCALE;
+  if (str == "color") return TIMELINE_COLOR;
+  fprintf(stderr, "Unknown timeline property '%s'\n", str.c_str());
+  return N_TIMELINE_PROPERTIES;
+}
+
+
+Keyframe::Keyframe(const uint32_t frame, const Easing easing,
+                   const double v0, const double v1, const double v2) :
+    frame(frame), easing(easing), value{v0, v1, v2} { }
+
+Timeline::Track::Track() : keys(), cursor(0),
+                           applied{nan(""), nan(""), nan("")} { }
+
+Timeline::Timeline() : length(0), delay(0), repeat(0), delay_left(0),
+                       repeats_left(0), frame(0), finished(false),
+                       base_image(), has_base_image(false), steps(),
+                       base_resize(1),
+                       base_rotation(0), scale(1), rotation(0) { }
+
+void Timeline::addKeyframe(const TimelineProperty property, const Keyframe& key) {
+  if (property >= N_TIMELINE_PROPERTIES) return;
+  std::vector<Keyframe>& keys = this->tracks[property].keys;
+  // keep the keys sorted by frame, a key at the same frame replaces the old
+  auto it = std::lower_bound(keys.begin(), keys.end(), key,
+      [](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+  if (it != keys.end() && it->frame == key.frame) {
+    *it = key;
+  } else {
+    keys.insert(it, key);
+  }
+  this->length = std::max(this->length, key.frame);
+}
+void Timeline::setDelay(const uint32_t frames) {
+  this->delay = frames;
+  this->delay_left = frames;
+}
+void Timeline::setRepeat(const int repeat) {
+  this->repeat = repeat;
+  this->repeats_left = repeat;
+}
+void Timeline::reset() {
+  this->delay_left = this->delay;
+  this->repeats_left = this->repeat;
+  this->frame = 0;
+  this->finished = false;
+  for (Track& track : this->tracks) track.cursor = 0;
+}
+uint32_t Timeline::getLength() const  { return this->length; }
+uint32_t Timeline::getFrame() const   { return this->frame; }
+bool Timeline::isFinished() const     { return this->finished; }
+
+// Value of the track at the frame; false outside of its first and last key
+bool Timeline::evaluate(Track* track, const uint32_t frame, double* value) const {
+  const std::vector<Keyframe>& keys = track->keys;
+  if (keys.empty() || frame < keys.front().frame || frame > keys.back().frame) {
+    return false;
+  }
+  if (frame < keys[track->cursor].frame) track->cursor = 0;   // started over
+  while (track->cursor + 1 < keys.size() && keys[track->cursor + 1].frame <= frame) {
+    ++track->cursor;
+  }
+  const Keyframe& from = keys[track->cursor];
+  if (track->cursor + 1 == keys.size() || frame == from.frame) {
+    std::copy(from.value, from.value + 3, value);
+    return true;
+  }
+  const Keyframe& to = keys[track->cursor + 1];
+  const double t = ease(to.easing, (double)(frame - from.frame) / (to.frame - from.frame));
+  for (int i = 0; i < 3; ++i) {
+    value[i] = from.value[i] + (to.value[i] - from.value[i]) * t;
+  }
+  return true;
+}
+
+void Timeline::step(CanvasObject* cvo) {
+  if (this->finished) return;
+  if (this->delay_left > 0) {
+    --this->delay_left;
+    return;
+  }
+  double value[3];
+  Track* track = &this->tracks[TIMELINE_POSITION];
+  if (this->evaluate(track, this->frame, value)) {
+    cvo->setPosition(Point(value[0], value[1]));
+  }
+  track = &this->tracks[TIMELINE_VISIBLE];
+  if (this->evaluate(track, this->frame, value)) {
+    cvo->setVisible(value[0] >= 0.5);
+  }
+  Sprite* sprite = dynamic_cast<Sprite*>(cvo);
+  bool transformed = false;
+  track = &this->tracks[TIMELINE_ROTATION];
+  if (sprite != nullptr && this->evaluate(track, this->frame, value)
+      && value[0] != track->applied[0]) {
+    this->rotation = track->applied[0] = value[0];
+    transformed = true;
+  }
+  track = &this->tracks[TIMELINE_SCALE];
+  if (sprite != nullptr && this->evaluate(track, this->frame, value)
+      && value[0] != track->applied[0]) {
+    this->scale = track->applied[0] = value[0];
+    transformed = true;
+  }
+  if (transformed) this->transformSprite(sprite);
+  Text* text = dynamic_cast<Text*>(cvo);
+  track = &this->tracks[TIMELINE_COLOR];
+  if (text != nullptr && this->evaluate(track, this->frame, value)) {
+    text->setColor(std::round(std::max(0.0, std::min(255.0, value[0]))),
+                   std::round(std::max(0.0, std::min(255.0, value[1]))),
+                   std::round(std::max(0.0, std::min(255.0, value[2]))));
+  }
+
+  ++this->frame;
+  // frame length is skipped when starting over, see setRepeat
+  if (this->repeats_left != 0 && this->frame >= this->length) {
+    this->frame = 0;
+    if (this->repeats_left > 0) --this->repeats_left;
+  } else if (this->frame > this->length) {
+    this->finished = true;
+  }
+}
+
+void Timeline::captureBase(CanvasObject* cvo) {
+  Sprite* sprite = dynamic_cast<Sprite*>(cvo);
+  if (sprite == nullptr || (this->tracks[TIMELINE_ROTATION].keys.empty()
+                            && this->tracks[TIMELINE_SCALE].keys.empty())) {
+    return;
+  }
+  // Magick images share their pixels until one is modified, so this copy
+  // is cheap and stays valid when the sprite changes its image later
+  this->base_image = sprite->getImage();
+  this->base_resize = sprite->getResize();
+  this->base_rotation = sprite->getRotation();
+  this->has_base_image = true;
+  this->steps.clear();
+}
+
+void Timeline::prerender() {
+  if (!this->has_base_image) return;
+  // play the tracks like step does (twice when repeating, the values of one
+  // track carry over into the next run of the other)
+  Track rotation_track = this->tracks[TIMELINE_ROTATION];
+  Track scale_track = this->tracks[TIMELINE_SCALE];
+  rotation_track.cursor = scale_track.cursor = 0;
+  double rotation = 0;
+  double scale = 1;
+  double value[3];
+  const int runs = (this->repeat != 0) ? 2 : 1;
+  for (int run = 0; run < runs; ++run) {
+    for (uint32_t frame = 0; frame <= this->length; ++frame) {
+      if (this->evaluate(&rotation_track, frame, value)) rotation = value[0];
+      if (this->evaluate(&scale_track, frame, value)) scale = value[0];
+      this->renderStep(rotation, scale);
+    }
+  }
+}
+
+void Timeline::prepare(CanvasObject* cvo) {
+  this->captureBase(cvo);
+  this->prerender();
+}
+
+// Steps closer than 1/10 degree and 1/1000 scale share one image
+Timeline::StepKey Timeline::stepKey(const double rotation, const double scale) {
+  return StepKey(std::lround(rotation * 10), std::lround(scale * 1000));
+}
+
+const Timeline::RenderedStep& Timeline::renderStep(const double rotation,
+                                                   const double scale) {
+  const StepKey key = stepKey(rotation, scale);
+  auto it = this->steps.find(key);
+  if (it != this->steps.end()) return it->second;
+  RenderedStep& step = this->steps[key];
+  Magick::Image image = this->base_image;
+  if (scale != 1) {
+    const double width = std::max(1.0, std::round(image.columns() * scale));
+    const double height = std::max(1.0, std::round(image.rows() * scale));
+    image.scale(Magick::Geometry(width, height));
+  }
+  if (rotation != 0) image.rotate(rotation);
+  step.width = image.columns();
+  step.height = image.rows();
+  const size_t n_pixels = step.width * step.height;
+  std::vector<uint8_t> rgba(n_pixels * 4);
+  if (n_pixels > 0) {
+    image.write(0, 0, step.width, step.height, "RGBA", Magick::CharPixel,
+                rgba.data());
+  }
+  step.pixels.resize(n_pixels * 3);
+  step.mask.resize(n_pixels);
+  for (size_t i = 0; i < n_pixels; ++i) {
+    step.pixels[i * 3]     = rgba[i * 4];
+    step.pixels[i * 3 + 1] = rgba[i * 4 + 1];
+    step.pixels[i * 3 + 2] = rgba[i * 4 + 2];
+    step.mask[i]           = rgba[i * 4 + 3];
+  }
+  return step;
+}
+
+// Copies the pre-rendered step; a timeline that was not prepared and steps
+// prepare did not foresee are rendered here, in the animation thread
+void Timeline::transformSprite(Sprite* sprite) {
+  if (!this->has_base_image) this->prepare(sprite);
+  if (this->base_image.columns() == 0 || this->base_image.rows() == 0) return;
+  const RenderedStep& step = this->renderStep(this->rotation, this->scale);
+  PackedImage packed;
+  packed.pixels = step.pixels.data();
+  packed.mask = step.mask.data();
+  packed.width = step.width;
+  packed.height = step.height;
+  sprite->setImage(packed, this->base_resize * this->scale,
+                   this->base_rotation + this->rotation);
+}
+
+} // end namespace Sprites
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace-events.h"
+
+
+namespace {
+
+struct Event {
+  const char* name;
+  const char* category;
+  uint64_t start_us;
+  uint64_t duration_us;
+};
+
+// Written only by its thread. The mutex is only ever contended while the
+// ring is flushed or handed to another thread
+struct ThreadRing {
+  ThreadRing() : tid(0), name(nullptr), head(0),
+                 events(Sprites::TraceEvents::RING_SIZE), in_use(false) { }
+  long tid;
+  const char* name;
+  uint64_t head;
+  std::vector<Event> events;
+  std::mutex mutex;
+  std::atomic<bool> in_use;
+};
+
+std::mutex& ringsMutex() {
+  static std::mutex rings_mutex;
+  return rings_mutex;
+}
+// Rings outlive their threads so that their events can still be flushed,
+// until a new thread reuses them. So there are never more rings than threads
+// that recorded at the same time, however many short-lived threads come
+std::vector<std::shared_ptr<ThreadRing>>& rings() {
+  static std::vector<std::shared_ptr<ThreadRing>> all_rings;
+  return all_rings;
+}
+
+thread_local ThreadRing* thread_ring = nullptr;
+thread_local const char* thread_name = nullptr;
+
+// Gives the ring of a thread free when the thread exits
+struct RingRelease {
+  ~RingRelease() {
+    if (thread_ring != nullptr) thread_ring->in_use = false;
+  }
+};
+thread_local RingRelease ring_release;
+
+// Threads get their ring with their first event, not before
+ThreadRing* getThreadRing() {
+  if (thread_ring == nullptr) {
+    (void) &ring_release;   // constructs it, so it runs at thread exit
+    std::lock_guard<std::mutex> guard(ringsMutex());
+    std::shared_ptr<ThreadRing> ring;
+    for (auto& free_ring : rings()) {
+      if (!free_ring->in_use) {
+        ring = free_ring;
+        break;
+      }
+    }
+    if (ring == nullptr) {
+      ring = std::make_shared<ThreadRing>();
+      rings().push_back(ring);
+    }
+    std::lock_guard<std::mutex> ring_guard(ring->mutex);
+    ring->tid = syscall(SYS_gettid);
+    ring->name = thread_name;
+    ring->head = 0;
+    ring->in_use = true;
+    thread_ring = ring.get();
+  }
+  return thread_ring;
+}
+
+uint64_t nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void writeString(FILE* file, const char* str) {
+  fputc('"', file);
+  for (; *str != '\0'; ++str) {
+    if (*str == '"' || *str == '\\') fputc('\\', file);
+    fputc(*str, file);
+  }
+  fputc('"', file);
+}
+
+} // end anonymous namespace
+
+
+namespace Sprites {
+
+const size_t TraceEvents::RING_SIZE;
+std::atomic<bool> TraceEvents::enabled(false);
+
+void TraceEvents::setEnabled(const bool enabled) {
+  TraceEvents::enabled = enabled;
+}
+void TraceEvents::setThreadName(const char* name) {
+  thread_name = name;
+  if (thread_ring == nullptr) return;
+  std::lock_guard<std::mutex> guard(thread_ring->mutex);
+  thread_ring->name = name;
+}
+
+uint64_t TraceEvents::begin() {
+  if (!isEnabled()) return 0;
+  return nowMicros();
+}
+void TraceEvents::end(const char* name, const char* category,
+                      const uint64_t start_us) {
+  const uint64_t end_us = nowMicros();
+  ThreadRing* ring = getThreadRing();
+  std::lock_guard<std::mutex> guard(ring->mutex);
+  Event& event = ring->events[ring->head++ % RING_SIZE];
+  event.name = name;
+  event.category = category;
+  event.start_us = start_us;
+  event.duration_us = end_us - start_us;
+}
+
+void TraceEvents::clear() {
+  std::lock_guard<std::mutex> guard(ringsMutex());
+  for (auto& ring : rings()) {
+    std::lock_guard<std::mutex> ring_guard(ring->mutex);
+    ring->head = 0;
+  }
+}
+
+bool TraceEvents::flush(const std::string& filename) {
+  FILE* file = fopen(filename.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Cannot open trace event file '%s'\n", filename.c_str());
+    return false;
+  }
+  const long pid = getpid();
+  std::vector<Event> events;
+  bool first = true;
+  fprintf(file, "{\"traceEvents\":[\n");
+  std::lock_guard<std::mutex> guard(ringsMutex());
+  for (auto& ring : rings()) {
+    // copy first, the thread keeps recording meanwhile
+    std::unique_lock<std::mutex> ring_lock(ring->mutex);
+    const uint64_t count = std::min<uint64_t>(ring->head, RING_SIZE);
+    events.clear();
+    for (uint64_t i = ring->head - count; i < ring->head; ++i) {
+      events.push_back(ring->events[i % RING_SIZE]);
+    }
+    const char* name = ring->name;
+    const long tid = ring->tid;
+    ring_lock.unlock();
+    if (name != nullptr) {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+              "\"tid\":%ld,\"args\":{\"name\":", first ? "" : ",\n", pid, tid);
+      writeString(file, name);
+      fprintf(file, "}}");
+      first = false;
+    }
+    for (const Event& event : events) {
+      fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+      writeString(file, event.name);
+      fprintf(file, ",\"cat\":");
+      writeString(file, event.category);
+      fprintf(file, ",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%ld,\"tid\":%ld}",
+              (unsigned long long) event.start_us,
+              (unsigned long long) event.duration_us, pid, tid);
+      first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  const bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+void lockTraced(std::mutex* mutex, const char* name) {
+  if (!TraceEvents::isEnabled()) {
+    mutex->lock();
+    return;
+  }
+  if (mutex->try_lock()) return;
+  const uint64_t start_us = TraceEvents::begin();
+  mutex->lock();
+  TraceEvents::end(name, "lock", start_us);
+}
+
+} // end namespace Sprites
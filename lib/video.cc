@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "canvas.h"
+#include "realtime.h"
+#include "sprite.h"
+#include "video.h"
+
+
+namespace Sprites {
+
+Video::Video() : CanvasObject::CanvasObject(), filename(""), fps(25),
+                 loop(true), frame_size(0), frames_written(0), frames_read(0),
+                 dropped_frames(0), start_ms(-1), current_frame(nullptr),
+                 decoding(false), decoder_pid(-1) {
+  this->width = 192;
+  this->height = 64;
+}
+Video::Video(const std::string filename, size_t width, size_t height) : Video() {
+  this->width = width;
+  this->height = height;
+  this->setContent(filename);
+}
+Video::~Video() {
+  this->stopDecoder();
+}
+
+// The decoder thread reads the settings, so it is stopped before they change
+void Video::setContent(const std::string& filename) {
+  this->stopDecoder();
+  this->filename = filename;
+  this->startDecoder();
+}
+const std::string& Video::getContent() const {
+  return this->filename;
+}
+void Video::setWidth(int width) {
+  this->stopDecoder();
+  {
+    // draw() must not see the new size with a frame of the old one
+    std::lock_guard<std::mutex> guard(this->ring_mutex);
+    this->width = width;
+    this->current_frame = nullptr;
+  }
+  this->startDecoder();
+}
+void Video::setHeight(int height) {
+  this->stopDecoder();
+  {
+    std::lock_guard<std::mutex> guard(this->ring_mutex);
+    this->height = height;
+    this->current_frame = nullptr;
+  }
+  this->startDecoder();
+}
+void Video::setFrameRate(double fps) {
+  if (fps <= 0) return;
+  this->stopDecoder();
+  this->fps = fps;
+  this->startDecoder();
+}
+const double& Video::getFrameRate() const {
+  return this->fps;
+}
+void Video::setLoop(bool loop) {
+  this->loop = loop;
+}
+bool Video::getLoop() const {
+  return this->loop;
+}
+size_t Video::getDroppedFrames() const {
+  return this->dropped_frames;
+}
+
+// (Re)start decoding from the beginning, e.g. after the size changed. Only
+// here the frame ring is (re)allocated.
+void Video::startDecoder() {
+  std::lock_guard<std::mutex> guard(this->ring_mutex);
+  this->stopDecoder();
+  if (this->filename.empty() || this->width == 0 || this->height == 0) return;
+  this->frame_size = this->width * this->height * 3;
+  this->ring.assign(this->frame_size * RING_SIZE, 0);
+  this->frames_written = 0;
+  this->frames_read = 0;
+  this->dropped_frames = 0;
+  this->start_ms = -1;
+  this->current_frame = nullptr;
+  this->decoding = true;
+  this->decoder_thread = std::thread(&Video::decodeLoop, this);
+}
+void Video::stopDecoder() {
+  this->decoding = false;
+  this->space_available.notify_all();
+  {
+    // the decoder thread clears the pid under this lock before it reaps the
+    // process, so the pid cannot belong to another process yet
+    std::lock_guard<std::mutex> guard(this->pid_mutex);
+    if (this->decoder_pid > 0) kill(this->decoder_pid, SIGTERM);
+  }
+  if (this->decoder_thread.joinable()) this->decoder_thread.join();
+}
+
+// ffmpeg does the decoding and scaling and writes raw RGB frames to a pipe
+pid_t Video::spawnDecoder(int* fd) const {
+  char filter[64];
+  snprintf(filter, sizeof(filter), "fps=%g,scale=%zu:%zu",
+           this->fps, this->width, this->height);
+  // close-on-exec, so other videos' decoders don't inherit this pipe and
+  // keep it open; dup2 clears the flag on the child's stdout
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC) != 0) return -1;
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(pipe_fds[1], STDOUT_FILENO);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    execlp("ffmpeg", "ffmpeg", "-loglevel", "error", "-nostdin",
+           "-i", this->filename.c_str(), "-vf", filter, "-an",
+           "-f", "rawvideo", "-pix_fmt", "rgb24", "-", (char*) NULL);
+    _exit(127);
+  }
+  close(pipe_fds[1]);
+  if (pid < 0) {
+    close(pipe_fds[0]);
+    return -1;
+  }
+  *fd = pipe_fds[0];
+  return pid;
+}
+bool Video::readFrame(int fd, uint8_t* buffer) const {
+  size_t done = 0;
+  while (done < this->frame_size) {
+    ssize_t n = read(fd, buffer + done, this->frame_size - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    done += n;
+  }
+  return true;
+}
+
+void Video::decodeLoop() {
+  configureWorkerThread("video decoder");
+  uint64_t frame_index = 0;
+  while (this->decoding) {
+    int fd = -1;
+    const pid_t pid = this->spawnDecoder(&fd);
+    if (pid < 0) {
+      fprintf(stderr, "Cannot start ffmpeg for '%s'\n", this->filename.c_str());
+      break;
+    }
+    {
+      std::lock_guard<std::mutex> guard(this->pid_mutex);
+      this->decoder_pid = pid;
+    }
+    const uint64_t first_frame = frame_index;
+    while (this->decoding) {
+      const uint64_t written = this->frames_written.load(std::memory_order_relaxed);
+      // one slot is always left for the frame on display
+      if (written - this->frames_read.load(std::memory_order_acquire) >= RING_SIZE - 1) {
+        std::unique_lock<std::mutex> lock(this->wait_mutex);
+        this->space_available.wait_for(lock, std::chrono::milliseconds(10));
+        continue;
+      }
+      const size_t slot = written % RING_SIZE;
+      if (!this->readFrame(fd, &this->ring[slot * this->frame_size])) break;
+      this->timestamps[slot] = frame_index * 1000 / this->fps;
+      ++frame_index;
+      this->frames_written.store(written + 1, std::memory_order_release);
+    }
+    {
+      std::lock_guard<std::mutex> guard(this->pid_mutex);
+      this->decoder_pid = -1;
+    }
+    close(fd);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    if (!this->loop || frame_index == first_frame) break;
+  }
+}
+
+// Present the newest frame that is due on the loop clock, dropping older ones
+void Video::doStep() {
+  CanvasObject::doStep();
+  std::unique_lock<std::mutex> lock(this->ring_mutex, std::try_to_lock);
+  if (!lock.owns_lock() || this->frame_size == 0) return;
+  const uint64_t written = this->frames_written.load(std::memory_order_acquire);
+  uint64_t read = this->frames_read.load(std::memory_order_relaxed);
+  if (read == written) return;
+  const int64_t now = getFrameMillis();
+  if (this->start_ms < 0) this->start_ms = now - this->timestamps[read % RING_SIZE];
+  size_t presented = 0;
+  while (read < written
+         && this->start_ms + this->timestamps[read % RING_SIZE] <= now) {
+    this->current_frame = &this->ring[(read % RING_SIZE) * this->frame_size];
+    ++read;
+    ++presented;
+  }
+  if (presented == 0) return;
+  this->dropped_frames += presented - 1;
+  this->frames_read.store(read, std::memory_order_release);
+  this->space_available.notify_one();
+}
+
+void Video::draw(rgb_matrix::Canvas* canvas) const {
+  if (!this->getVisible()) return;
+  std::unique_lock<std::mutex> lock(this->ring_mutex, std::try_to_lock);
+  if (!lock.owns_lock() || this->current_frame == nullptr) return;
+  const int x0 = std::round(this->getWorldPosition().x);
+  const int y0 = std::round(this->getWorldPosition().y);
+  const int x_start = std::max(0, -x0);
+  const int y_start = std::max(0, -y0);
+  const int x_end = std::min<int>(this->width, canvas->width() - x0);
+  const int y_end = std::min<int>(this->height, canvas->height() - y0);
+  for (int y = y_start; y < y_end; ++y) {
+    const uint8_t* px = this->current_frame + (y * this->width + x_start) * 3;
+    for (int x = x_start; x < x_end; ++x, px += 3) {
+      canvas->SetPixel(x0 + x, y0 + y, px[0], px[1], px[2]);
+    }
+  }
+}
+
+} // end namespace Sprites
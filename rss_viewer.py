@@ -2,6 +2,7 @@
 """Display rss feed content."""
 # pylint: disable=missing-docstring
 
+import threading
 import time
 from datetime import datetime
 import os
@@ -43,44 +44,47 @@ def main():
     #     animation.end()
     # return
 
-    for i in range(len(rss.feed.entries)):
-        entry_dict = rss.parse_entry(i)
-        img_fname = rss.load_img_url(entry_dict["img_url"])
-        if img_fname:
-            sprite = PySprite(img_fname)
-            sprite.height = 64
-            sprite.position = 0, 0
-            sprite.visible = False
-            sprites[f"img_{str(i)}"] = sprite
-        text = PyText("test")
-        text.position = 128, 32
-        text.visible = False
-        sprites[f"desc_{str(i)}"] = text
-
     animation = PyAnimationLoop(sprites, frame_time_ms=20)
     animation.start()
+    # every entry is a scene of its own, decoded while the first ones show
+    scene_names = []
+    loader = threading.Thread(
+        target=load_scenes, args=(rss, animation, scene_names), daemon=True
+    )
+    loader.start()
     try:
         active_idx = 0
         while True:
-            for i, sprite in enumerate(sprites.values()):
-                desc = sprites[f"desc_{str(i)}"]
-                if i != active_idx:
-                    sprite.visible = False
-                    desc.visible = False
-                else:
-                    sprite.visible = True
-                    desc.visible = True
-            print(desc)
+            if scene_names:
+                active_idx %= len(scene_names)
+                animation.switch_scene(scene_names[active_idx], frames=25)
+                active_idx += 1
             time.sleep(5)
-            active_idx += 1
-            if active_idx >= len(sprites):
-                active_idx = 0
     except KeyboardInterrupt:
         print("User interrupt")
     finally:
         animation.end()
 
 
+def load_scenes(rss, animation, scene_names):
+    for i in range(len(rss.feed.entries)):
+        entry_dict = rss.parse_entry(i)
+        img_fname = rss.load_img_url(entry_dict["img_url"])
+        scene = PyCanvasObjectList()
+        if img_fname:
+            sprite = PySprite(img_fname)
+            sprite.height = 64
+            sprite.position = 0, 0
+            sprite.visible = True
+            scene[f"img_{str(i)}"] = sprite
+        text = PyText("test")
+        text.position = 128, 32
+        text.visible = True
+        scene[f"desc_{str(i)}"] = text
+        animation.add_scene(f"entry_{str(i)}", scene)
+        scene_names.append(f"entry_{str(i)}")
+
+
 class RSS:
     tmp_fname = 0
     cache = ".cache/"